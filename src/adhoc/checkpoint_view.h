@@ -0,0 +1,232 @@
+#ifndef __CHECKPOINT_VIEW_H
+#define __CHECKPOINT_VIEW_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+#include "checkpoint.h"
+#include "stream.h"
+#include "decimation.h"
+#include "element.h"
+#include "shader.h"
+#include "draw.h"
+
+/*
+ * Appends the values of the reader's current chunk, as doubles.
+ */
+inline bool read_stream_values(Fem::StreamReader & reader, std::vector<double> & values)
+{
+    Fem::StreamChunkHeader const & header = reader.header();
+    void const * data = reader.data();
+    if (!data)
+        return false;
+    if (header.element_size == sizeof(double))
+        values.insert(values.end(), static_cast<double const *>(data), static_cast<double const *>(data) + header.count);
+    else if (header.element_size == sizeof(float))
+        values.insert(values.end(), static_cast<float const *>(data), static_cast<float const *>(data) + header.count);
+    else
+        return false;
+    return true;
+}
+
+/*
+ * Where a chunk of x or u starts in a stream, found by the header pass
+ * of load_stream_pyramid, so that chunks can be read in node order
+ * whatever their order in the file.
+ */
+struct StreamChunkEntry
+{
+    uint64_t first;
+    uint64_t count;
+    uint64_t offset;
+
+    bool operator<(StreamChunkEntry const & other) const
+    {
+        return first < other.first;
+    }
+};
+
+/*
+ * Index of the entry that starts at node first, skipping the entries
+ * before it; entries.size() if there is none.
+ */
+inline size_t find_stream_chunk(std::vector<StreamChunkEntry> const & entries, size_t from, uint64_t first)
+{
+    while (from < entries.size() && entries[from].first < first)
+        ++from;
+    return from < entries.size() && entries[from].first == first ? from : entries.size();
+}
+
+/*
+ * Builds the pyramid of u at the last step of a stream, reading it
+ * chunk by chunk, so at most one chunk of x and u each and the kept
+ * pyramid levels are in memory at a time. Levels finer than needed to
+ * stay within max_entries are dropped.
+ *
+ * A first pass over the headers finds the last step and where the
+ * chunks of x (written once, on the first step) and of u at that step
+ * are; the second reads them in node order, seeking to each, so chunks
+ * may come in any order and x and u may be far apart in the file.
+ */
+inline bool load_stream_pyramid(char const * path, DecimationPyramid & pyramid, int max_entries = 1 << 24)
+{
+    Fem::StreamReader reader;
+    if (!reader.open(path))
+        return false;
+    std::vector<StreamChunkEntry> x_chunks, u_chunks;
+    uint64_t step = 0;
+    uint64_t nodes = 0;
+    while (reader.next())
+    {
+        Fem::StreamChunkHeader const & header = reader.header();
+        StreamChunkEntry const entry = { header.first, header.count, reader.offset() };
+        if (header.count == 0)
+            continue;
+        if (header.field == Fem::STREAM_X)
+            x_chunks.push_back(entry);
+        if (header.field != Fem::STREAM_U)
+            continue;
+        if (header.step > step || u_chunks.empty())
+        {
+            step = header.step;
+            nodes = 0;
+            u_chunks.clear();
+        }
+        if (header.step == step)
+        {
+            nodes = std::max(nodes, header.first + header.count);
+            u_chunks.push_back(entry);
+        }
+    }
+    if (nodes == 0 || nodes > (uint64_t) std::numeric_limits<int>::max())
+    {
+        fprintf(stderr, "Error: %s has no solution that can be drawn\n", path);
+        return false;
+    }
+    std::stable_sort(x_chunks.begin(), x_chunks.end());
+    std::stable_sort(u_chunks.begin(), u_chunks.end());
+
+    // level k > 0 has about nodes / 2^(k - 1) entries
+    int first_level = 0;
+    while ((nodes >> std::max(first_level - 1, 0)) > (uint64_t) max_entries)
+        ++first_level;
+    pyramid.begin(first_level, first_level == 0 ? (int) nodes : 0);
+
+    std::vector<double> xs, us;
+    uint64_t next_u = 0;
+    uint64_t next_x = 0;
+    size_t u_index = 0;
+    size_t x_index = 0;
+    while (next_u < nodes)
+    {
+        u_index = find_stream_chunk(u_chunks, u_index, next_u);
+        if (u_index == u_chunks.size())
+        {
+            fprintf(stderr, "Error: %s lacks the solution from node %llu on\n", path, (unsigned long long) next_u);
+            return false;
+        }
+        us.clear();
+        if (!reader.seek(u_chunks[u_index].offset) || !reader.next() || !read_stream_values(reader, us))
+        {
+            fprintf(stderr, "Error: could not read the solution from node %llu on in %s\n", (unsigned long long) next_u,
+                    path);
+            return false;
+        }
+        next_u += us.size();
+
+        // x up to the end of this u chunk
+        while (next_x < next_u)
+        {
+            x_index = find_stream_chunk(x_chunks, x_index, next_x);
+            if (x_index == x_chunks.size() || !reader.seek(x_chunks[x_index].offset) || !reader.next()
+                || !read_stream_values(reader, xs))
+                break;
+            next_x += reader.header().count;
+        }
+        if (xs.size() < us.size())
+        {
+            fprintf(stderr, "Error: %s lacks node coordinates\n", path);
+            return false;
+        }
+        pyramid.append(xs.data(), us.data(), (int) us.size());
+        xs.erase(xs.begin(), xs.begin() + us.size());
+    }
+    pyramid.finish();
+    return true;
+}
+
+/*
+ * Draws a saved bar solution. Checkpoints are drawn straight from the
+ * mapped file, in whichever precision they were saved, without copying.
+ * Streams are read once into a decimation pyramid, which is all that is
+ * kept of them. Only 1D checkpoints can be drawn for now.
+ */
+class CheckpointView : public Element
+{
+public:
+    CheckpointView() {}
+    virtual ~CheckpointView() {}
+    bool open(char const * path)
+    {
+        if (Fem::StreamReader::is_stream(path))
+            return load_stream_pyramid(path, _pyramid);
+        if (!_checkpoint.open(path))
+            return false;
+
+        Fem::CheckpointHeader const & header = _checkpoint.header();
+        if (header.dimension != 1)
+        {
+            fprintf(stderr, "Error: %s is a %uD checkpoint, only 1D ones can be drawn\n", path, header.dimension);
+            _checkpoint.close();
+            return false;
+        }
+        if (header.scalar_size == sizeof(double))
+            set(_checkpoint.vector<double>(Fem::SECTION_X), _checkpoint.vector<double>(Fem::SECTION_U), _double);
+        else
+            set(_checkpoint.vector<float>(Fem::SECTION_X), _checkpoint.vector<float>(Fem::SECTION_U), _single);
+        return true;
+    }
+    Fem::Checkpoint const & checkpoint() const { return _checkpoint; }
+    void addEventHooks(EventManager * event_manager)
+    {
+        assert(event_manager);
+        event_manager->addEventHook(this, &CheckpointView::renderElementsEventHook);
+    }
+    void removeEventHooks(EventManager * event_manager)
+    {
+        assert(event_manager);
+        event_manager->removeEventHook(this, &CheckpointView::renderElementsEventHook);
+    }
+    void renderElementsEventHook(RenderElementsEvent const * event)
+    {
+        assert(event);
+        assert(event->program);
+        if (!_pyramid.levels.empty())
+            draw_pyramid_1D(_pyramid, _render_cache, event->program, event->view, event->queue);
+        else if (_double.size() > 0)
+            draw_mesh_1D(_double, _render_cache, event->program, event->view, event->queue);
+        else if (_single.size() > 0)
+            draw_mesh_1D(_single, _render_cache, event->program, event->view, event->queue);
+    }
+
+private:
+    template <typename precision>
+    static void set(typename Fem::Checkpoint::View<precision>::Type const & x,
+                    typename Fem::Checkpoint::View<precision>::Type const & u,
+                    SolutionHandle1D<precision> & solution)
+    {
+        if (x.size() > 0 && x.size() == u.size())
+            solution.set(x.data(), u.data(), (int) x.size());
+    }
+
+    Fem::Checkpoint _checkpoint;
+    SolutionHandle1D<float> _single;
+    SolutionHandle1D<double> _double;
+    DecimationPyramid _pyramid;
+    Mesh1DRenderCache _render_cache;
+};
+
+#endif  // __CHECKPOINT_VIEW_H
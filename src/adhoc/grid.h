@@ -26,8 +26,11 @@ public:
     {
         assert(event);
         assert(event->program);
-        draw_grid(event->program);
+        draw_grid(_render_cache, event->program, event->view, event->queue, event->arena);
     }
+
+private:
+    GridRenderCache _render_cache;
 };
 
 #endif  // __GRID_H
@@ -4,29 +4,11 @@
 #include <cassert>
 
 #include "fem.h"
+#include "heat_data.h"
 #include "element.h"
 #include "shader.h"
 #include "draw.h"
-
-template <typename precision>
-class ConductivityFunction : public Fem::RealFunction<precision>
-{
-public:
-    virtual precision operator()(precision x)
-    {
-        return 0.1 * (5. - 0.6 * x);
-    }
-};
-
-template <typename precision>
-class SourceFunction : public Fem::RealFunction<precision>
-{
-public:
-    virtual precision operator()(precision x)
-    {
-        return 0.03 * pow(x - 6, 4);
-    }
-};
+#include "stats.h"
 
 template<typename precision, int nodes>
 class HeatProblem : public Element
@@ -34,22 +16,17 @@ class HeatProblem : public Element
 public:
     HeatProblem()
     {
-        // setup the problem
-        int const start = 2;
-        int const end = 8;
-        precision const spacing = (precision) (end - start) / (nodes - 1);
-        for (int i = 0; i < nodes; ++i)
-            _problem.x(i) = start + i * spacing;
-        _problem.fun_a = &_conductivity;
-        _problem.fun_f = &_source;
-        _problem.k[0] = 1.0e+6f;
-        _problem.k[1] = 0.f;
-        _problem.g[0] = -1.f;
-        _problem.g[1] = 0.f;
+        setup_heat_problem(_problem, _conductivity, _source);
 
         // since it's a static (non-time-varying) problem,
         // we can just solve the problem here
+        SolveTiming timing;
+        double const start_time = stats_now();
         Fem::solve(_problem);
+        timing.solve = stats_now() - start_time;  // assembly included, fem.h has no phases
+        timing.unknowns = nodes;
+        Stats::instance().publish_solve(timing);
+        _solution.set(_problem.x, _problem.u);
     }
     virtual ~HeatProblem() {}
     void addEventHooks(EventManager * event_manager)
@@ -62,17 +39,20 @@ public:
         assert(event_manager);
         event_manager->removeEventHook(this, &HeatProblem::renderElementsEventHook);
     }
+    Fem::Problem<precision, nodes> const & problem() const { return _problem; }
     void renderElementsEventHook(RenderElementsEvent const * event)
     {
         assert(event);
         assert(event->program);
-        draw_mesh_1D<precision, nodes>(_problem.x, _problem.u, event->program);
+        draw_mesh_1D(_solution, _render_cache, event->program, event->view, event->queue);
     }
 
 private:
     ConductivityFunction<precision> _conductivity;
     SourceFunction<precision> _source;
     Fem::Problem<precision, nodes> _problem;
+    SolutionHandle1D<precision> _solution;
+    Mesh1DRenderCache _render_cache;
 };
 
 #endif  // __HEAT_H
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef __HEAT_DATA_H
+#define __HEAT_DATA_H
+
+#include <cmath>
+
+#include "fem.h"
+
+/*
+ * The heat conduction problem along a bar of chapter 2 of Larson &
+ * Bengzon, without any graphics, for the viewer and the command line
+ * tools alike.
+ */
+template <typename precision>
+class ConductivityFunction : public Fem::RealFunction<precision>
+{
+public:
+    virtual precision operator()(precision x)
+    {
+        return 0.1 * (5. - 0.6 * x);
+    }
+};
+
+template <typename precision>
+class SourceFunction : public Fem::RealFunction<precision>
+{
+public:
+    virtual precision operator()(precision x)
+    {
+        return 0.03 * pow(x - 6, 4);
+    }
+};
+
+// the bar spans [HEAT_START, HEAT_END]
+static int const HEAT_START = 2;
+static int const HEAT_END = 8;
+
+/*
+ * Equally spaced nodes, u = -1 at the left end (pseudo dirichlet) and
+ * no flux at the right end.
+ */
+template <typename precision, int nodes>
+void setup_heat_problem(Fem::Problem<precision, nodes> & p, ConductivityFunction<precision> & conductivity,
+                        SourceFunction<precision> & source)
+{
+    precision const spacing = (precision) (HEAT_END - HEAT_START) / (nodes - 1);
+    for (int i = 0; i < nodes; ++i)
+        p.x(i) = HEAT_START + i * spacing;
+    p.mesh_changed();
+    p.fun_a = &conductivity;
+    p.fun_f = &source;
+    p.k[0] = 1.0e+6f;
+    p.k[1] = 0.f;
+    p.g[0] = -1.f;
+    p.g[1] = 0.f;
+}
+
+#endif  // __HEAT_DATA_H
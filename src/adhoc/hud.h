@@ -0,0 +1,137 @@
+#ifndef __HUD_H
+#define __HUD_H
+
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+#include "element.h"
+#include "window_events.h"
+#include "draw.h"
+#include "stats.h"
+#include "stroke_font.h"
+
+/*
+ * Heads up display of the frame and solve statistics, drawn in the top
+ * left corner of the view on the overlay layer. Toggled with the h key.
+ *
+ * Everything shown is read from the lock-free Stats buffers, so it
+ * lags the frame being drawn by one frame. The upload figure includes
+ * the few kilobytes of the hud's own text. While the hud is shown, the
+ * gui redraws a few times a second even without input, so that solves
+ * finishing meanwhile show up.
+ */
+class Hud : public Element
+{
+public:
+    Hud(bool visible = false)
+    : _visible(visible)
+    , _program(NULL)
+    , _text(NULL)
+    {
+        Stats::instance().set_shown(_visible);
+    }
+    virtual ~Hud()
+    {
+        if (_visible)
+            Stats::instance().set_shown(false);
+        if (_program)
+        {
+            _program->gpu_destroy_asset(_text);
+        }
+    }
+    void addEventHooks(EventManager * event_manager)
+    {
+        assert(event_manager);
+        event_manager->addEventHook(this, &Hud::keyInputEventHook);
+        event_manager->addEventHook(this, &Hud::renderElementsEventHook);
+    }
+    void removeEventHooks(EventManager * event_manager)
+    {
+        assert(event_manager);
+        event_manager->removeEventHook(this, &Hud::keyInputEventHook);
+        event_manager->removeEventHook(this, &Hud::renderElementsEventHook);
+    }
+    void keyInputEventHook(KeyInputEvent const * event)
+    {
+        assert(event);
+        if (event->key == GLFW_KEY_H && event->action == GLFW_PRESS)
+        {
+            _visible = !_visible;
+            Stats::instance().set_shown(_visible);
+        }
+    }
+    void renderElementsEventHook(RenderElementsEvent const * event)
+    {
+        assert(event);
+        assert(event->program);
+
+        // the text is sized in pixels, so it needs to know the view
+        if (!_visible || !event->view.is_known())
+            return;
+
+        RenderView const & view = event->view;
+        float const pixels = 3.f;  // per font grid step
+        float const scale_x = pixels / view.pixels_per_unit_x;
+        float const scale_y = pixels / view.pixels_per_unit_y;
+        float const x = view.xmin + 4.f * scale_x;
+        float y = view.ymax - 8.f * scale_y;
+
+        _vertices.clear();
+        char line[128];
+        Stats const & stats = Stats::instance();
+
+        stats.frame_times.snapshot(_samples);
+        double const max = _samples.empty() ? 0.0 : *std::max_element(_samples.begin(), _samples.end());
+        double const p50 = percentile(_samples, 0.50);
+        double const p95 = percentile(_samples, 0.95);
+        double const p99 = percentile(_samples, 0.99);
+        snprintf(line, sizeof(line), "FRAME MS  P50 %.2f  P95 %.2f  P99 %.2f  MAX %.2f",
+                 1e3 * p50, 1e3 * p95, 1e3 * p99, 1e3 * max);
+        append_text(_vertices, line, x, y, scale_x, scale_y, 1.f, 1.f, 0.5f);
+        y -= 7.f * scale_y;
+
+        snprintf(line, sizeof(line), "EVENTS %.0f  DRAWS %.0f  UPLOAD KB %.1f",
+                 stats.frame_dispatches.last(), stats.frame_draw_calls.last(),
+                 stats.frame_uploads.last() / 1024.0);
+        append_text(_vertices, line, x, y, scale_x, scale_y, 1.f, 1.f, 0.5f);
+        y -= 7.f * scale_y;
+
+        SolveTiming solve;
+        if (stats.read_solve(solve))
+        {
+            snprintf(line, sizeof(line), "SOLVE MS  ASM %.2f  FACT %.2f  SOLVE %.2f  N %d",
+                     1e3 * solve.assembly, 1e3 * solve.factor, 1e3 * solve.solve, solve.unknowns);
+            append_text(_vertices, line, x, y, scale_x, scale_y, 0.5f, 1.f, 1.f);
+        }
+
+        if (_program != event->program)
+        {
+            if (_program)
+                _program->gpu_destroy_asset(_text);
+            _program = event->program;
+            _text = _program->gpu_create_asset(_vertices);
+        }
+        else
+        {
+            _program->gpu_update_asset(_text, _vertices);
+        }
+
+        if (event->queue)
+            event->queue->draw_lines(_text, 0, _text->size, RenderQueue::OVERLAY);
+        else
+            _program->gpu_draw_lines(_text, 0, _text->size);
+    }
+
+private:
+    Hud(Hud const &);
+    Hud & operator=(Hud const &);
+
+    bool _visible;
+    VertexColorShaderProgram * _program;
+    GpuAsset * _text;
+    std::vector<Vertex> _vertices;
+    std::vector<double> _samples;
+};
+
+#endif  // __HUD_H
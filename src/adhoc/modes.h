@@ -0,0 +1,68 @@
+#ifndef __MODES_H
+#define __MODES_H
+
+#include <cassert>
+#include <cmath>
+
+#include "fem.h"
+#include "modal.h"
+#include "element.h"
+#include "shader.h"
+#include "draw.h"
+#include "heat_data.h"
+
+/*
+ * Lowest modes of the bar of HeatProblem, with the conductivity as
+ * stiffness and the same boundary conditions. All modes are drawn at
+ * once as a sweep, one curve per mode, each scaled to unit amplitude
+ * with its largest value positive. Nothing is drawn if the modes could
+ * not be found, e.g. while assemble_stiffness_matrix in fem.h is empty.
+ */
+template<typename precision, int nodes>
+class ModalProblem : public Element
+{
+public:
+    explicit ModalProblem(int count = 4)
+    {
+        setup_heat_problem(_problem, _conductivity, _source);
+
+        if (!Fem::solve_modes(_problem, count, _modes))
+            return;
+
+        for (int i = 0; i < _modes.count(); ++i)
+        {
+            int peak;
+            _modes.shapes.col(i).cwiseAbs().maxCoeff(&peak);
+            _modes.shapes.col(i) /= _modes.shapes(peak, i);
+        }
+        _solution.set(_problem.x.data(), _modes.shapes.data(), nodes, _modes.count());
+    }
+    virtual ~ModalProblem() {}
+    void addEventHooks(EventManager * event_manager)
+    {
+        assert(event_manager);
+        event_manager->addEventHook(this, &ModalProblem::renderElementsEventHook);
+    }
+    void removeEventHooks(EventManager * event_manager)
+    {
+        assert(event_manager);
+        event_manager->removeEventHook(this, &ModalProblem::renderElementsEventHook);
+    }
+    void renderElementsEventHook(RenderElementsEvent const * event)
+    {
+        assert(event);
+        assert(event->program);
+        draw_mesh_1D(_solution, _render_cache, event->program, event->view, event->queue);
+    }
+    Fem::Modes<precision> const & modes() const { return _modes; }
+
+private:
+    ConductivityFunction<precision> _conductivity;
+    SourceFunction<precision> _source;
+    Fem::Problem<precision, nodes> _problem;
+    Fem::Modes<precision> _modes;
+    SolutionHandle1D<precision> _solution;
+    Mesh1DRenderCache _render_cache;
+};
+
+#endif  // __MODES_H
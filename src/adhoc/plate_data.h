@@ -0,0 +1,47 @@
+#ifndef __PLATE_DATA_H
+#define __PLATE_DATA_H
+
+#include "fem2d.h"
+
+/*
+ * Heat conduction in the unit square plate of the 2D benchmarks, hot
+ * on the left, cold at the bottom, cooled by the air above and heated
+ * through the right side.
+ */
+template <typename precision>
+class PlateConductivity : public Fem::RealFunction2D<precision>
+{
+public:
+    virtual precision operator()(precision x, precision y)
+    {
+        return 1.0 + 0.5 * x * y;
+    }
+};
+
+template <typename precision>
+class PlateSource : public Fem::RealFunction2D<precision>
+{
+public:
+    virtual precision operator()(precision x, precision y)
+    {
+        return 10.0 * (x - 0.5) * (x - 0.5) + y;
+    }
+};
+
+/*
+ * The functions and boundary conditions of the plate, for a mesh made
+ * by make_rectangle_mesh over [0, 1] x [0, 1].
+ */
+template <typename precision>
+void setup_plate_problem(Fem::Problem2D<precision> & p, PlateConductivity<precision> & conductivity,
+                         PlateSource<precision> & source)
+{
+    p.fun_a = &conductivity;
+    p.fun_f = &source;
+    p.set_boundary(Fem::BOTTOM, Fem::BoundaryCondition2D<precision>(1.0e6, 0.0));
+    p.set_boundary(Fem::LEFT, Fem::BoundaryCondition2D<precision>(1.0e6, 1.0));
+    p.set_boundary(Fem::TOP, Fem::BoundaryCondition2D<precision>(2.0, 0.5));
+    p.set_boundary(Fem::RIGHT, Fem::BoundaryCondition2D<precision>(0.0, 0.0, -1.0));
+}
+
+#endif  // __PLATE_DATA_H
@@ -1,25 +1,53 @@
 #include "gui.h"
 #include "grid.h"
 #include "heat.h"
+#include "hud.h"
+#include "checkpoint_view.h"
 
-int main(void)
+/*
+ *   arc [CHECKPOINT]
+ *
+ * Shows the heat problem, or the solution saved in a checkpoint file
+ * without solving anything.
+ */
+int main(int argc, char ** argv)
 {
     Gui gui;
     gui.initialize();
 
     Grid grid;
-    HeatProblem<float, 100> problem;
+    Hud hud;
+    Element * problem = NULL;
+    if (argc > 1)
+    {
+        CheckpointView * view = new CheckpointView();
+        if (!view->open(argv[1]))
+        {
+            delete view;
+            return EXIT_FAILURE;
+        }
+        problem = view;
+    }
+    else
+    {
+        problem = new HeatProblem<float, 100>();
+    }
 
     gui.add_element(&grid);
-    gui.add_element(&problem);
+    gui.add_element(problem);
+    gui.add_element(&hud);
 
     while (!gui.should_close())
     {
         gui.step();
     }
 
-    gui.remove_element(&problem);
+    gui.remove_element(&hud);
+    gui.remove_element(problem);
     gui.remove_element(&grid);
 
+    // before the gui, its gl context has the problem's assets
+    delete problem;
+
     return EXIT_SUCCESS;
 }
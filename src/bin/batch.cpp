@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "offscreen_renderer.h"
+#include "grid.h"
+#include "heat.h"
+#include "plate_data.h"
+#include "checkpoint_view.h"
+#include "distributed.h"
+#include "stream.h"
+#include "transport.h"
+
+/*
+ * Renders the scene of arc into image files without opening a window,
+ * for generating plots on headless machines:
+ *
+ *   arc-batch [-c CHECKPOINT] [-o CHECKPOINT] [-w STREAM] [-p CELLS] [-s WIDTHxHEIGHT] [-v XMIN XMAX YMIN YMAX]
+ *             [-j JOBS] FILE...
+ *
+ * Size and view apply to the files that follow them, so one run can
+ * write several views. The format is picked from the extension (.png
+ * or .ppm). With -j the run is spread over that many local processes,
+ * or over the ranks of mpirun when built with MPI; the files are handed
+ * out to them as they finish the ones before, each rendering with its
+ * own offscreen context.
+ *
+ * -c draws the solution saved in a checkpoint or stream instead of
+ * solving the heat problem, -o saves the heat problem's solution to a
+ * checkpoint and -w writes it, with its fluxes, as a stream (compressed
+ * when built with zlib).
+ * -p solves the 2D plate on a CELLS x CELLS mesh with conjugate
+ * gradients split over the processes, reports it and, with -o, saves
+ * it instead of the heat problem.
+ */
+
+struct Job
+{
+    char const * path;
+    int width, height;
+    bool has_view;
+    float view[4];
+};
+
+static void print_usage()
+{
+    fprintf(stderr, "usage: arc-batch [-c CHECKPOINT] [-o CHECKPOINT] [-w STREAM] [-p CELLS] [-s WIDTHxHEIGHT] "
+                    "[-v XMIN XMAX YMIN YMAX] [-j JOBS] FILE...\n");
+}
+
+/*
+ * Everything drawn into the images. Created after the renderer and
+ * destroyed before it, since the elements keep gpu assets of its context.
+ */
+struct Scene
+{
+    Scene(OffscreenRenderer & renderer_, char const * checkpoint)
+    : renderer(renderer_)
+    , problem(&heat)
+    {
+        if (checkpoint && view.open(checkpoint))
+            problem = &view;
+        renderer.add_element(&grid);
+        renderer.add_element(problem);
+    }
+    ~Scene()
+    {
+        renderer.remove_element(problem);
+        renderer.remove_element(&grid);
+    }
+
+    OffscreenRenderer & renderer;
+    Grid grid;
+    HeatProblem<float, 100> heat;
+    CheckpointView view;
+    Element * problem;
+};
+
+/*
+ * Renders the jobs the work queue hands to this process, returns the
+ * number of failures.
+ */
+static int render_jobs(std::vector<Job> const & jobs, char const * checkpoint, Fem::Transport & transport)
+{
+    int failures = 0;
+    Fem::WorkQueue queue(transport, (int) jobs.size());
+    int i = queue.next();
+    while (i >= 0)
+    {
+        // one renderer per run of jobs with the same size
+        OffscreenRenderer renderer(jobs[i].width, jobs[i].height);
+        if (!renderer.initialize())
+        {
+            fprintf(stderr, "Error: could not initialize a %dx%d offscreen renderer\n",
+                    jobs[i].width, jobs[i].height);
+            return failures + 1;
+        }
+        Scene scene(renderer, checkpoint);
+
+        for (; i >= 0 && jobs[i].width == renderer.get_width() && jobs[i].height == renderer.get_height();
+             i = queue.next())
+        {
+            Job const & job = jobs[i];
+            if (job.has_view)
+                renderer.set_view(job.view[0], job.view[1], job.view[2], job.view[3]);
+            if (!renderer.render_to_file(job.path))
+            {
+                fprintf(stderr, "Error: could not write %s\n", job.path);
+                ++failures;
+            }
+        }
+    }
+    return failures;
+}
+
+/*
+ * Solves the plate on a cells x cells mesh over the processes of
+ * transport; rank 0 reports it and saves it to output if given.
+ */
+static bool solve_plate(int cells, char const * output, Fem::Transport & transport)
+{
+    PlateConductivity<double> conductivity;
+    PlateSource<double> source;
+    Fem::Problem2D<double> p;
+    setup_plate_problem(p, conductivity, source);
+    Fem::make_rectangle_mesh(p.mesh, 0.0, 1.0, 0.0, 1.0, cells, cells);
+
+    double const start = stats_now();
+    bool const ok = Fem::solve_distributed(p, transport);
+    double const seconds = stats_now() - start;
+    if (transport.rank() != 0)
+        return ok;
+    if (!ok)
+    {
+        fprintf(stderr, "Error: could not solve the plate (%d iterations)\n", p.iterations);
+        return false;
+    }
+    printf("plate: %d nodes on %d processes, %d iterations in %.1f ms\n", p.mesh.nodes(), transport.size(),
+           p.iterations, 1e3 * seconds);
+    return !output || Fem::save_checkpoint(output, p);
+}
+
+/*
+ * Whether ok on every process, so that all take the same path on.
+ */
+static bool all_ok(Fem::Transport & transport, bool ok)
+{
+    double failed = ok ? 0.0 : 1.0;
+    return transport.sum(&failed, 1) && failed == 0.0;
+}
+
+/*
+ * Streams the heat problem's solution as its only step.
+ */
+static bool write_stream(char const * path)
+{
+    HeatProblem<float, 100> heat;
+    Fem::Problem<float, 100> p = heat.problem();
+    Fem::StreamWriter writer;
+    if (!writer.open(path, true))
+        return false;
+    Fem::write_step(writer, p, 0, 0.0);
+    if (!writer.close())
+    {
+        fprintf(stderr, "Error: could not write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    std::vector<Job> jobs;
+    Job next;
+    next.path = NULL;
+    next.width = 640;
+    next.height = 480;
+    next.has_view = false;
+    int workers = 1;
+    int plate = 0;
+    char const * checkpoint = NULL;
+    char const * output = NULL;
+    char const * stream = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &next.width, &next.height) != 2 || next.width <= 0 || next.height <= 0)
+            {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-v") == 0 && i + 4 < argc)
+        {
+            for (int k = 0; k < 4; ++k)
+                next.view[k] = (float) atof(argv[++i]);
+            next.has_view = next.view[1] > next.view[0] && next.view[3] > next.view[2];
+            if (!next.has_view)
+            {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            checkpoint = argv[++i];
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+        {
+            stream = argv[++i];
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+        {
+            plate = atoi(argv[++i]);
+            if (plate <= 0)
+            {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            workers = atoi(argv[++i]);
+            if (workers < 1)
+                workers = 1;
+        }
+        else if (argv[i][0] == '-')
+        {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            next.path = argv[i];
+            jobs.push_back(next);
+        }
+    }
+
+    if (jobs.empty() && !output && !stream && !plate)
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    if (checkpoint)
+    {
+        // fail before rendering anything, every process maps it again
+        CheckpointView view;
+        if (!view.open(checkpoint))
+            return EXIT_FAILURE;
+    }
+    if (!plate && workers > (int) jobs.size())
+        workers = std::max(1, (int) jobs.size());
+
+    Fem::SingleProcessTransport single;
+    Fem::Transport * transport = &single;
+#ifdef ARC_HAVE_MPI
+    // under mpirun the ranks are given, -j is for runs without it
+    Fem::MpiTransport * mpi = Fem::MpiTransport::start(&argc, &argv);
+    if (!mpi)
+        return EXIT_FAILURE;
+    if (mpi->size() > 1)
+    {
+        transport = mpi;
+    }
+    else
+    {
+        delete mpi;
+        mpi = NULL;
+    }
+#endif
+#ifndef _WIN32
+    Fem::SocketTransport * sockets = NULL;
+    if (transport == &single && workers > 1)
+    {
+        // fork before any gl context exists, every process creates its own
+        sockets = Fem::SocketTransport::start(workers);
+        if (!sockets)
+            return EXIT_FAILURE;
+        transport = sockets;
+    }
+#endif
+
+    bool ok = true;
+    if (output && !plate && transport->rank() == 0)
+    {
+        HeatProblem<float, 100> heat;
+        ok = Fem::save_checkpoint(output, heat.problem(), true);
+    }
+    if (stream && transport->rank() == 0)
+        ok = write_stream(stream) && ok;
+    ok = all_ok(*transport, ok);
+    if (ok && plate)
+        ok = all_ok(*transport, solve_plate(plate, output, *transport));
+    if (ok && !jobs.empty())
+        ok = all_ok(*transport, render_jobs(jobs, checkpoint, *transport) == 0);
+
+#ifndef _WIN32
+    if (sockets)
+    {
+        // the other processes exit here
+        ok = sockets->finish(ok);
+        delete sockets;
+    }
+#endif
+#ifdef ARC_HAVE_MPI
+    delete mpi;
+#endif
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
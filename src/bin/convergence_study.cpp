@@ -0,0 +1,198 @@
+// the problems are heap allocated, but eigen checks the size of their
+// fixed size stiffness matrices against its stack limit
+#define EIGEN_STACK_ALLOCATION_LIMIT 0
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "fem.h"
+#include "postprocess.h"
+#include "heat_data.h"
+#include "stats.h"
+#include "tasks.h"
+
+/*
+ * Convergence study of the heat problem of arc:
+ *
+ *   convergence-study [-j JOBS] [-p] [-t TOLERANCE]
+ *
+ * Solves the bar on meshes of 4, 8, ..., 256 elements on JOBS threads
+ * of the task pool (all cores by default, pinned to them with -p), and
+ * for a few quantities of interest reports the observed order of
+ * convergence of every three successive meshes and a Richardson
+ * extrapolation of the two finest, using the finest observed order. The
+ * difference to the extrapolated value estimates the error of every
+ * mesh, which is listed with the wall time of its solve. With -t it names the fastest mesh whose estimated
+ * relative error is below TOLERANCE for every quantity.
+ *
+ * Meshes are nested, so the quantities taken at nodes are at nodes of
+ * every mesh. Until solve in fem.h is written every solution is zero,
+ * which shows as quantities that do not converge.
+ */
+
+using namespace Fem;
+
+enum Quantity { MIDPOINT, RIGHT_END, ENERGY_NORM, QUANTITIES };
+static char const * const QUANTITY_NAMES[QUANTITIES] = { "u(5)", "u(8)", "energy norm" };
+
+struct Result
+{
+    int elements;
+    double seconds;
+    double values[QUANTITIES];
+};
+
+template <int nodes>
+static void run(Result & result)
+{
+    ConductivityFunction<double> conductivity;
+    SourceFunction<double> source;
+    Problem<double, nodes> * p = new Problem<double, nodes>();
+    setup_heat_problem(*p, conductivity, source);
+
+    double const start = stats_now();
+    solve(*p);
+    DerivedQuantities<double> derived;
+    post_process(*p, derived);
+    result.seconds = stats_now() - start;
+
+    result.elements = nodes - 1;
+    result.values[MIDPOINT] = p->u((nodes - 1) / 2);
+    result.values[RIGHT_END] = p->u(nodes - 1);
+    result.values[ENERGY_NORM] = derived.energy_norm;
+    delete p;
+}
+
+typedef void (*Run)(Result &);
+static Run const RUNS[] = { run<5>, run<9>, run<17>, run<33>, run<65>, run<129>, run<257> };
+static int const MESHES = sizeof(RUNS) / sizeof(RUNS[0]);
+
+/*
+ * Runs meshes on the task pool, finest (slowest) first, so the others
+ * fill in around them.
+ */
+class MeshRuns : public RangeTask
+{
+public:
+    MeshRuns(Result * results_)
+    : results(results_)
+    {}
+    virtual void run(int begin, int end)
+    {
+        for (int m = begin; m < end; ++m)
+            RUNS[MESHES - 1 - m](results[MESHES - 1 - m]);
+    }
+
+    Result * results;
+};
+
+/*
+ * Order p of e ~ h^p from three meshes, each twice as fine as the one
+ * before, 0 if it can't be told, e.g. when the values stopped changing.
+ */
+static double observed_order(double coarse, double middle, double fine)
+{
+    double const ratio = std::abs(coarse - middle) / std::abs(middle - fine);
+    if (!(ratio > 1) || std::isinf(ratio))
+        return 0.0;
+    return std::log(ratio) / std::log(2.0);
+}
+
+static void print_usage()
+{
+    fprintf(stderr, "usage: convergence-study [-j JOBS] [-p] [-t TOLERANCE]\n");
+}
+
+int main(int argc, char ** argv)
+{
+    int jobs = 0;
+    bool pin = false;
+    double tolerance = 0.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            jobs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-p") == 0)
+        {
+            pin = true;
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            tolerance = atof(argv[++i]);
+        }
+        else
+        {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+    TaskPool::instance().configure(jobs, pin);
+
+    std::vector<Result> results(MESHES);
+    MeshRuns runs(results.data());
+    double const start = stats_now();
+    parallel_for(0, MESHES, 1, runs);
+    double const wall = stats_now() - start;
+
+    printf("%d meshes on %d threads in %.1f ms\n", MESHES, TaskPool::instance().threads(), 1e3 * wall);
+
+    double relative[MESHES] = { 0.0 };
+    bool converged = true;
+    for (int q = 0; q < QUANTITIES; ++q)
+    {
+        double const fine = results[MESHES - 1].values[q];
+        double const order = observed_order(results[MESHES - 3].values[q], results[MESHES - 2].values[q], fine);
+        double const extrapolated = fine + (fine - results[MESHES - 2].values[q]) / (std::pow(2.0, order) - 1);
+        if (order > 0)
+            printf("\n%s  extrapolated %.10g  order %.2f\n", QUANTITY_NAMES[q], extrapolated, order);
+        else
+            printf("\n%s  does not converge\n", QUANTITY_NAMES[q]);
+        converged = converged && order > 0;
+
+        printf("%10s %12s %10s %18s %12s %8s\n", "elements", "h", "time ms", "value", "est. error", "order");
+        for (int m = 0; m < MESHES; ++m)
+        {
+            Result const & r = results[m];
+            double const error = order > 0 ? std::abs(r.values[q] - extrapolated) : 0.0;
+            relative[m] = std::max(relative[m], error / std::max(std::abs(extrapolated), 1e-300));
+            printf("%10d %12.6f %10.3f %18.10g ", r.elements, (double) (HEAT_END - HEAT_START) / r.elements,
+                   1e3 * r.seconds, r.values[q]);
+            if (order > 0)
+                printf("%12.3e", error);
+            else
+                printf("%12s", "-");
+            if (m >= 2)
+            {
+                double const o = observed_order(results[m - 2].values[q], results[m - 1].values[q], r.values[q]);
+                if (o > 0)
+                    printf(" %8.2f", o);
+                else
+                    printf(" %8s", "-");
+            }
+            printf("\n");
+        }
+    }
+
+    if (tolerance > 0)
+    {
+        printf("\n");
+        int best = -1;
+        for (int m = 0; converged && m < MESHES; ++m)
+            if (relative[m] <= tolerance && (best < 0 || results[m].seconds < results[best].seconds))
+                best = m;
+        if (!converged)
+            printf("no mesh picked, not every quantity converges\n");
+        else if (best < 0)
+            printf("no mesh reaches a relative error of %g, the finest has %.3e\n", tolerance, relative[MESHES - 1]);
+        else
+            printf("%d elements reach a relative error of %g (%.3e) in %.3f ms\n", results[best].elements,
+                   tolerance, relative[best], 1e3 * results[best].seconds);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "fem.h"
+#include "heat_data.h"
+#include "kernels.h"
+#include "stats.h"
+
+/*
+ * Throughput of the element kernels of the bar on every instruction set
+ * this build and cpu support:
+ *
+ *   kernel-benchmark [ELEMENTS]
+ *
+ * Computes the local stiffness and load of ELEMENTS elements (4096 by
+ * default, which stay in cache) of the heat problem over and over, in
+ * float and double, and reports the time per element, the elements per
+ * second and the largest difference to the scalar kernel relative to
+ * the largest value. Build with optimizations
+ * (-DCMAKE_BUILD_TYPE=Release) for meaningful numbers.
+ */
+
+using namespace Fem;
+
+/*
+ * The table the kernels read, for elements equally spaced over the bar;
+ * ElementTable of a Problem needs the node count at compile time.
+ */
+template <typename precision>
+static void fill_table(ElementTable<precision> & table, int elements)
+{
+    ConductivityFunction<precision> a;
+    SourceFunction<precision> f;
+    precision const near = gauss_near_weight<precision>();
+    precision const h = (precision) (HEAT_END - HEAT_START) / elements;
+    table.h.setConstant(elements, h);
+    table.midpoint.resize(elements);
+    table.a_mid.resize(elements);
+    table.f0.resize(elements);
+    table.f1.resize(elements);
+    for (int e = 0; e < elements; ++e)
+    {
+        precision const left = HEAT_START + e * h;
+        table.midpoint[e] = left + h / 2;
+        table.a_mid[e] = a(table.midpoint[e]);
+        table.f0[e] = f(left + (1 - near) * h);
+        table.f1[e] = f(left + near * h);
+    }
+}
+
+template <typename precision>
+static double difference(ElementSystems<precision> const & s, ElementSystems<precision> const & reference)
+{
+    double const scale = std::max(reference.k.abs().maxCoeff(),
+                                  std::max(reference.b0.abs().maxCoeff(), reference.b1.abs().maxCoeff()));
+    double const largest = std::max((s.k - reference.k).abs().maxCoeff(),
+                                    std::max((s.b0 - reference.b0).abs().maxCoeff(),
+                                             (s.b1 - reference.b1).abs().maxCoeff()));
+    return scale > 0 ? largest / scale : largest;
+}
+
+template <typename precision>
+static void run(char const * name, int elements)
+{
+    ElementTable<precision> table;
+    fill_table(table, elements);
+    ElementSystems<precision> reference;
+    element_kernels(table, reference, SIMD_SCALAR);
+
+    for (int i = 0; i < SIMD_ISAS; ++i)
+    {
+        SimdIsa const isa = (SimdIsa) i;
+        if (!simd_isa_supported(isa))
+            continue;
+
+        // repeated until the time is long enough to measure
+        ElementSystems<precision> systems;
+        int repeats = 1;
+        double seconds = 0;
+        for (;;)
+        {
+            double const start = stats_now();
+            for (int r = 0; r < repeats; ++r)
+                element_kernels(table, systems, isa);
+            seconds = stats_now() - start;
+            if (seconds > 0.2 || repeats > (1 << 28))
+                break;
+            repeats *= 2;
+        }
+
+        double const per_element = seconds / ((double) repeats * elements);
+        printf("%-8s %-8s %12.3f %12.1f %14.3e\n", name, simd_isa_name(isa), 1e9 * per_element,
+               1e-6 / per_element, difference(systems, reference));
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    int const elements = argc > 1 ? atoi(argv[1]) : 4096;
+    if (elements <= 0)
+    {
+        fprintf(stderr, "usage: kernel-benchmark [ELEMENTS]\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%d elements, widest instruction set %s\n\n", elements, simd_isa_name(best_simd_isa()));
+    printf("%-8s %-8s %12s %12s %14s\n", "type", "isa", "ns/element", "M/s", "vs scalar");
+    run<float>("float", elements);
+    run<double>("double", elements);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "fem2d.h"
+#include "plate_data.h"
+#include "renumber.h"
+#include "stats.h"
+
+/*
+ * Compares node orderings of a 2D heat problem on a plate whose nodes
+ * come in random order, as they might from a mesh generator or file:
+ *
+ *   renumber-benchmark [CELLS]
+ *
+ * For every ordering it reports the bandwidth, the fill of an LDLT
+ * factorization without a fill reducing ordering of its own (so the
+ * node order alone decides it), and the times of assembly, matrix
+ * vector products and full solves. Build with optimizations
+ * (-DCMAKE_BUILD_TYPE=Release) for meaningful numbers.
+ */
+
+using namespace Fem;
+
+/*
+ * Upper bound of the fill of a factorization in the given order:
+ * the envelope, row i spanning from its first nonzero to the diagonal.
+ * The work of the factorization, bounded by the sum of the squared
+ * column counts within the envelope, is returned in work.
+ */
+static double envelope(Mesh2D<double> const & mesh, double & work)
+{
+    std::vector<int> first(mesh.nodes());
+    for (int n = 0; n < mesh.nodes(); ++n)
+        first[n] = n;
+    for (int t = 0; t < mesh.triangles(); ++t)
+    {
+        int const c[3] = { mesh.t0[t], mesh.t1[t], mesh.t2[t] };
+        int const lo = std::min(c[0], std::min(c[1], c[2]));
+        for (int i = 0; i < 3; ++i)
+            first[c[i]] = std::min(first[c[i]], lo);
+    }
+    // rows n reach into the columns first[n] to n - 1
+    std::vector<int> starting(mesh.nodes() + 1, 0);
+    double res = 0.0;
+    for (int n = 0; n < mesh.nodes(); ++n)
+    {
+        res += n - first[n] + 1;
+        ++starting[first[n]];
+        --starting[n];
+    }
+    work = 0.0;
+    double column = 0.0;
+    for (int n = 0; n < mesh.nodes(); ++n)
+    {
+        column += starting[n];
+        work += column * column;
+    }
+    return res;
+}
+
+int main(int argc, char ** argv)
+{
+    int const cells = argc > 1 ? atoi(argv[1]) : 200;
+    if (cells <= 0)
+    {
+        fprintf(stderr, "usage: renumber-benchmark [CELLS]\n");
+        return EXIT_FAILURE;
+    }
+
+    PlateConductivity<double> a;
+    PlateSource<double> f;
+
+    // the plate with its nodes shuffled
+    Mesh2D<double> shuffled;
+    make_rectangle_mesh(shuffled, 0.0, 1.0, 0.0, 1.0, cells, cells);
+    Renumbering shuffle;
+    shuffle.set_identity(shuffled.nodes());
+    srand(1);
+    for (int i = shuffled.nodes() - 1; i > 0; --i)
+        std::swap(shuffle.old_index[i], shuffle.old_index[rand() % (i + 1)]);
+    shuffle.invert_old_index();
+    renumber(shuffled, shuffle);
+
+    printf("%d nodes, %d triangles\n\n", shuffled.nodes(), shuffled.triangles());
+    printf("%-10s %10s %12s %12s %10s %10s %10s %10s %10s\n", "ordering", "bandwidth", "envelope",
+           "fill", "factor", "assembly", "spmv", "direct", "cg");
+
+    Problem2D<double>::Vector reference;
+    char const * const names[] = { "input", "rcm", "hilbert", "morton" };
+    for (int ordering = 0; ordering < 4; ++ordering)
+    {
+        Problem2D<double> p;
+        setup_plate_problem(p, a, f);
+        p.mesh = shuffled;
+
+        Renumbering renumbering;
+        double time = stats_now();
+        switch (ordering)
+        {
+        case 0: renumbering.set_identity(p.mesh.nodes()); break;
+        case 1: rcm_ordering(p.mesh, renumbering); break;
+        case 2: curve_ordering(p.mesh, HILBERT, renumbering); break;
+        case 3: curve_ordering(p.mesh, MORTON, renumbering); break;
+        }
+        renumber(p, renumbering);
+        double const renumber_time = stats_now() - time;
+
+        // assembly with a warm pattern cache
+        assemble_stiffness_matrix(p);
+        time = stats_now();
+        assemble_stiffness_matrix(p);
+        assemble_load_vector(p);
+        double const assembly_time = stats_now() - time;
+
+        Problem2D<double>::Vector v = Problem2D<double>::Vector::Ones(p.mesh.nodes());
+        Problem2D<double>::Vector w(p.mesh.nodes());
+        int const products = 50;
+        time = stats_now();
+        for (int i = 0; i < products; ++i)
+            w.noalias() = p.A.selfadjointView<Eigen::Lower>() * v;
+        double const spmv_time = (stats_now() - time) / products;
+
+        // fill in the node order itself, skipped when it would take more than
+        // a few seconds, as for the shuffled input of all but small plates
+        double work = 0.0;
+        double const bound = envelope(p.mesh, work);
+        double fill = 0.0, factor_time = 0.0;
+        bool const factored = work < 1.0e10;
+        if (factored)
+        {
+            Eigen::SimplicialLDLT<Problem2D<double>::SparseMatrix, Eigen::Lower,
+                                  Eigen::NaturalOrdering<int> > natural;
+            time = stats_now();
+            natural.compute(p.A);
+            factor_time = stats_now() - time;
+            fill = (double) natural.matrixL().nestedExpression().nonZeros();
+        }
+
+        p.linear_solver = DIRECT;
+        time = stats_now();
+        bool ok = solve(p);
+        double const direct_time = stats_now() - time;
+
+        Problem2D<double>::Vector u;
+        renumbering.unpermute(p.u, u);
+        if (ordering == 0)
+            reference = u;
+        ok = ok && (u - reference).norm() <= 1.0e-8 * reference.norm();
+
+        p.linear_solver = ITERATIVE;
+        p.u.setZero(p.mesh.nodes());
+        time = stats_now();
+        ok = solve(p) && ok;
+        double const cg_time = stats_now() - time;
+
+        char fill_text[32] = "-", factor_text[32] = "-";
+        if (factored)
+        {
+            snprintf(fill_text, sizeof(fill_text), "%.0f", fill);
+            snprintf(factor_text, sizeof(factor_text), "%.3fs", factor_time);
+        }
+        printf("%-10s %10d %12.0f %12s %10s %9.3fs %9.5fs %9.3fs %9.3fs%s\n", names[ordering],
+               bandwidth(p.mesh), bound, fill_text, factor_text, assembly_time, spmv_time,
+               direct_time, cg_time, ok ? "" : "  FAILED");
+        if (ordering > 0)
+            printf("%-10s renumbered in %.3fs\n", "", renumber_time);
+    }
+
+    printf("\nfill and factor: LDLT in node order, - when it would take too long\n");
+    printf("direct: assembly and LDLT with its own (AMD) ordering, cg: assembly and cold cg\n");
+
+    return EXIT_SUCCESS;
+}
@@ -41,6 +41,10 @@ public:
 
         _dragging = dragging;
     }
+    bool is_dragging()
+    {
+        return _dragging;
+    }
     void set_position(float x, float y)
     {
         _x = (_out_range[1] - _out_range[0]) * ((x - _in_range[0]) / (_in_range[1] - _in_range[0])) + _out_range[0];
@@ -71,9 +75,17 @@ public:
         _xscale = x;
         _yscale = y;
     }
+    float get_translation_x()
+    {
+        return _xscale * (_dtx + _tx);
+    }
+    float get_translation_y()
+    {
+        return _yscale * (_dty + _ty);
+    }
     void apply(mat4x4 dst)
     {
-        mat4x4_translate_in_place(dst, _xscale * (_dtx + _tx), _yscale * (_dty + _ty), 0.f);
+        mat4x4_translate_in_place(dst, get_translation_x(), get_translation_y(), 0.f);
     }
 private:
     bool _dragging;
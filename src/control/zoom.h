@@ -40,6 +40,10 @@ public:
 
         _dragging = dragging;
     }
+    bool is_dragging()
+    {
+        return _dragging;
+    }
     void set_position(float x, float y)
     {
         _x = ((x - _in_range[0]) / (_in_range[1] - _in_range[0]));
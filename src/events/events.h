@@ -72,6 +72,10 @@ private:
 class EventManager
 {
 public:
+    EventManager()
+    : dispatch_count(0)
+    {}
+
     virtual ~EventManager()
     {
         // TODO: delete all EventHooks
@@ -141,9 +145,18 @@ public:
         {
             EventHookBase * hook = *it;
             hook->exec(event);
+            ++dispatch_count;
         }
     }
 
+    /*
+     * Number of hooks called so far, over all events.
+     */
+    unsigned long get_dispatch_count() const
+    {
+        return dispatch_count;
+    }
+
 private:
     
 
@@ -159,6 +172,7 @@ private:
 
     EventQueue event_queue;
     HookListMap event_hook_list_map;
+    unsigned long dispatch_count;
 };
 
 #endif  // __EVENTS
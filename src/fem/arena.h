@@ -0,0 +1,223 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace Fem
+{
+
+/*
+ * Alignment of every arena allocation: a cache line, which also suits
+ * the widest vectors Eigen uses.
+ */
+static size_t const ARENA_ALIGNMENT = 64;
+
+/*
+ * Bump allocator for temporaries whose lifetimes end together, e.g. at
+ * the end of a solve or a frame. Allocating moves a pointer along a
+ * chunk of memory and freeing single allocations does nothing; memory
+ * is given back all at once by rewinding to a mark or resetting. Chunks
+ * are kept, so once an arena has grown to what a solve or frame needs,
+ * later ones don't touch the heap at all, which keeps threads of a
+ * sweep from contending for it and long sessions from fragmenting it.
+ *
+ * An arena is not thread safe; every thread needs its own.
+ */
+class Arena
+{
+public:
+    // where allocations continue after rewinding to it
+    struct Mark
+    {
+        size_t chunk;
+        size_t offset;
+    };
+
+    explicit Arena(size_t chunk_bytes = 1 << 20)
+    : _chunk_bytes(chunk_bytes)
+    , _current(0)
+    , _offset(0)
+    {}
+    ~Arena()
+    {
+        release();
+    }
+
+    void * allocate(size_t bytes, size_t alignment = ARENA_ALIGNMENT)
+    {
+        assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+        for (;; ++_current, _offset = 0)
+        {
+            if (_current == _chunks.size())
+                add_chunk(bytes + alignment);
+            Chunk const & chunk = _chunks[_current];
+            uintptr_t const start = (uintptr_t) chunk.data + _offset;
+            size_t const padding = (alignment - start % alignment) % alignment;
+            if (_offset + padding + bytes <= chunk.size)
+            {
+                _offset += padding + bytes;
+                return (void *) (start + padding);
+            }
+        }
+    }
+
+    template <typename T>
+    T * allocate_array(size_t count)
+    {
+        return static_cast<T *>(allocate(count * sizeof(T)));
+    }
+
+    Mark mark() const
+    {
+        Mark m;
+        m.chunk = _current;
+        m.offset = _offset;
+        return m;
+    }
+
+    // frees everything allocated since m was taken
+    void rewind(Mark const & m)
+    {
+        assert(m.chunk < _chunks.size() || (m.chunk == 0 && m.offset == 0));
+        _current = m.chunk;
+        _offset = m.offset;
+    }
+
+    /*
+     * Frees everything. Several chunks are merged into one as large as
+     * all of them, so the arena settles into a single chunk.
+     */
+    void reset()
+    {
+        if (_chunks.size() > 1)
+        {
+            size_t const total = capacity();
+            release();
+            add_chunk(total);
+        }
+        _current = 0;
+        _offset = 0;
+    }
+
+    size_t capacity() const
+    {
+        size_t total = 0;
+        for (size_t c = 0; c < _chunks.size(); ++c)
+            total += _chunks[c].size;
+        return total;
+    }
+
+private:
+    struct Chunk
+    {
+        char * data;
+        size_t size;
+    };
+
+    Arena(Arena const &);
+    Arena & operator=(Arena const &);
+
+    void add_chunk(size_t bytes)
+    {
+        Chunk chunk;
+        chunk.size = std::max(bytes, _chunk_bytes);
+        chunk.data = static_cast<char *>(std::malloc(chunk.size));
+        if (!chunk.data)
+            throw std::bad_alloc();
+        _chunks.push_back(chunk);
+    }
+
+    void release()
+    {
+        for (size_t c = 0; c < _chunks.size(); ++c)
+            std::free(_chunks[c].data);
+        _chunks.clear();
+        _current = 0;
+        _offset = 0;
+    }
+
+    size_t _chunk_bytes;         // smallest chunk taken from the heap
+    std::vector<Chunk> _chunks;
+    size_t _current;             // chunk allocations come from
+    size_t _offset;              // in it
+};
+
+/*
+ * Rewinds the arena, if any, to where it was when the scope began.
+ */
+class ArenaScope
+{
+public:
+    explicit ArenaScope(Arena * arena)
+    : _arena(arena)
+    , _mark(arena ? arena->mark() : Arena::Mark())
+    {}
+    ~ArenaScope()
+    {
+        if (_arena)
+            _arena->rewind(_mark);
+    }
+
+private:
+    ArenaScope(ArenaScope const &);
+    ArenaScope & operator=(ArenaScope const &);
+
+    Arena * _arena;
+    Arena::Mark _mark;
+};
+
+/*
+ * Standard allocator on an arena, for std::vector and the like; with
+ * no arena it uses the heap. Containers should reserve what they need
+ * up front, as the memory they outgrow is only freed with the arena.
+ */
+template <typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena * arena_ = NULL)
+    : arena(arena_)
+    {}
+    template <typename U>
+    ArenaAllocator(ArenaAllocator<U> const & other)
+    : arena(other.arena)
+    {}
+
+    T * allocate(size_t count)
+    {
+        if (arena)
+            return arena->allocate_array<T>(count);
+        return static_cast<T *>(::operator new(count * sizeof(T)));
+    }
+    void deallocate(T * p, size_t)
+    {
+        if (!arena)
+            ::operator delete(p);
+    }
+
+    Arena * arena;
+};
+
+template <typename T, typename U>
+bool operator==(ArenaAllocator<T> const & a, ArenaAllocator<U> const & b)
+{
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(ArenaAllocator<T> const & a, ArenaAllocator<U> const & b)
+{
+    return a.arena != b.arena;
+}
+
+}  // namespace Fem
+
+#endif  // __ARENA_H
@@ -0,0 +1,392 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#endif
+
+namespace Fem
+{
+
+static uint64_t const SECTION_ALIGNMENT = 64;
+static char const PADDING[SECTION_ALIGNMENT] = { 0 };
+
+static uint64_t align_up(uint64_t offset)
+{
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+#ifndef _WIN32
+// makes a rename within the directory of path durable
+static bool sync_directory(char const * path)
+{
+    char const * slash = strrchr(path, '/');
+    std::string const directory = !slash ? std::string(".") : slash == path ? std::string("/")
+                                : std::string(path, slash);
+    int const file = ::open(directory.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+    bool const ok = ::fsync(file) == 0;
+    return ::close(file) == 0 && ok;
+}
+#endif
+
+CheckpointWriter::CheckpointWriter(int scalar_size, int dimension)
+{
+    assert(scalar_size == 4 || scalar_size == 8);
+    memset(&_header, 0, sizeof(_header));
+    memcpy(_header.magic, CHECKPOINT_MAGIC, sizeof(_header.magic));
+    _header.version = CHECKPOINT_VERSION;
+    _header.byte_order = CHECKPOINT_BYTE_ORDER;
+    _header.scalar_size = scalar_size;
+    _header.dimension = dimension;
+}
+
+void CheckpointWriter::set_time(double time, uint64_t step)
+{
+    _header.time = time;
+    _header.step = step;
+}
+
+void CheckpointWriter::add(uint32_t id, void const * data, uint32_t element_size, uint64_t count)
+{
+    assert(data || count == 0);
+    CheckpointSection section;
+    memset(&section, 0, sizeof(section));
+    section.id = id;
+    section.element_size = element_size;
+    section.count = count;
+    _sections.push_back(section);
+
+    Block block;
+    block.data = data;
+    block.size = element_size * count;
+    _blocks.push_back(block);
+}
+
+void CheckpointWriter::add_metadata(std::string const & key, std::string const & value)
+{
+    _metadata += key + "=" + value + "\n";
+}
+
+bool CheckpointWriter::write(char const * path)
+{
+    // the metadata goes last, the writer owns it
+    std::vector<CheckpointSection> sections = _sections;
+    std::vector<Block> blocks = _blocks;
+    if (!_metadata.empty())
+    {
+        CheckpointSection section;
+        memset(&section, 0, sizeof(section));
+        section.id = SECTION_METADATA;
+        section.element_size = 1;
+        section.count = _metadata.size();
+        sections.push_back(section);
+        Block block = { _metadata.data(), _metadata.size() };
+        blocks.push_back(block);
+    }
+
+    CheckpointHeader header = _header;
+    header.sections = (uint32_t) sections.size();
+    uint64_t offset = align_up(sizeof(header) + sections.size() * sizeof(CheckpointSection));
+    for (size_t i = 0; i < sections.size(); ++i)
+    {
+        sections[i].offset = offset;
+        offset = align_up(offset + blocks[i].size);
+    }
+
+    // header, table, then every section followed by its padding
+    std::vector<Block> parts;
+    Block part = { &header, sizeof(header) };
+    parts.push_back(part);
+    part.data = sections.data();
+    part.size = sections.size() * sizeof(CheckpointSection);
+    parts.push_back(part);
+    uint64_t written = sizeof(header) + part.size;
+    for (size_t i = 0; i < sections.size(); ++i)
+    {
+        part.data = PADDING;
+        part.size = sections[i].offset - written;
+        if (part.size > 0)
+            parts.push_back(part);
+        if (blocks[i].size > 0)
+            parts.push_back(blocks[i]);
+        written = sections[i].offset + blocks[i].size;
+    }
+
+    std::string const temporary = std::string(path) + ".tmp";
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(temporary.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "Error: could not open %s for writing\n", temporary.c_str());
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; ok && i < parts.size(); ++i)
+    {
+        char const * data = static_cast<char const *>(parts[i].data);
+        uint64_t left = parts[i].size;
+        while (ok && left > 0)
+        {
+            DWORD chunk = (DWORD) (left < (1u << 30) ? left : (1u << 30));
+            DWORD done = 0;
+            ok = WriteFile(file, data, chunk, &done, NULL) && done > 0;
+            data += done;
+            left -= done;
+        }
+    }
+    ok = ok && FlushFileBuffers(file);
+    ok = CloseHandle(file) && ok;
+    ok = ok && MoveFileExA(temporary.c_str(), path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    int const file = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0)
+    {
+        fprintf(stderr, "Error: could not open %s for writing\n", temporary.c_str());
+        return false;
+    }
+    std::vector<struct iovec> vectors(parts.size());
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        vectors[i].iov_base = const_cast<void *>(parts[i].data);
+        vectors[i].iov_len = parts[i].size;
+    }
+
+    // writev may stop short, e.g. at 2 GB on linux, so continue where it did
+    bool ok = true;
+    struct iovec * next = vectors.data();
+    struct iovec * const end = next + vectors.size();
+    while (ok && next != end)
+    {
+        int const count = (int) std::min<ptrdiff_t>(end - next, IOV_MAX);
+        ssize_t done = ::writev(file, next, count);
+        ok = done > 0;
+        for (; ok && next != end && (size_t) done >= next->iov_len; ++next)
+            done -= next->iov_len;
+        if (ok && next != end)
+        {
+            next->iov_base = static_cast<char *>(next->iov_base) + done;
+            next->iov_len -= done;
+        }
+    }
+    // the data has to be on disk before the rename is, or a crash
+    // could leave a short file under the final name
+    ok = ok && ::fsync(file) == 0;
+    ok = ::close(file) == 0 && ok;
+    ok = ok && ::rename(temporary.c_str(), path) == 0;
+    ok = ok && sync_directory(path);
+#endif
+
+    if (!ok)
+    {
+        fprintf(stderr, "Error: could not write %s\n", path);
+        remove(temporary.c_str());
+    }
+    return ok;
+}
+
+int const Checkpoint::_no_columns = 0;
+
+/*
+ * Whether a stored matrix is a well formed compressed column matrix,
+ * which Checkpoint::matrix maps without further checks: columns start
+ * at 0 and never go back, the last one ends at the number of nonzeros,
+ * and row indices are within the matrix and ascending in every column.
+ */
+static bool is_valid_matrix(Checkpoint const & checkpoint)
+{
+    uint64_t outer = 0, inner = 0, values = 0;
+    int const * starts = static_cast<int const *>(checkpoint.section(SECTION_A_OUTER, sizeof(int), outer));
+    int const * rows = static_cast<int const *>(checkpoint.section(SECTION_A_INNER, sizeof(int), inner));
+    checkpoint.section(SECTION_A_VALUES, checkpoint.header().scalar_size, values);
+    if (outer == 0 && inner == 0 && values == 0)
+        return true;
+    if (outer == 0 || inner != values || outer - 1 > (uint64_t) INT_MAX || inner > (uint64_t) INT_MAX)
+        return false;
+    int const n = (int) (outer - 1);
+    if (starts[0] != 0 || (uint64_t) starts[n] != inner)
+        return false;
+    for (int column = 0; column < n; ++column)
+    {
+        if (starts[column + 1] < starts[column])
+            return false;
+        for (int i = starts[column]; i < starts[column + 1]; ++i)
+            if (rows[i] < 0 || rows[i] >= n || (i > starts[column] && rows[i] <= rows[i - 1]))
+                return false;
+    }
+    return true;
+}
+
+Checkpoint::Checkpoint()
+: _data(NULL)
+, _size(0)
+#ifdef _WIN32
+, _file(NULL)
+, _mapping(NULL)
+#endif
+{}
+
+Checkpoint::~Checkpoint()
+{
+    close();
+}
+
+bool Checkpoint::open(char const * path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size))
+    {
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        fprintf(stderr, "Error: could not open %s\n", path);
+        return false;
+    }
+    _file = file;
+    _size = size.QuadPart;
+    if (_size >= sizeof(CheckpointHeader))
+    {
+        _mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (_mapping)
+            _data = static_cast<char const *>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    int const file = ::open(path, O_RDONLY);
+    struct stat status;
+    if (file < 0 || fstat(file, &status) != 0)
+    {
+        if (file >= 0)
+            ::close(file);
+        fprintf(stderr, "Error: could not open %s\n", path);
+        return false;
+    }
+    _size = status.st_size;
+    if (_size >= sizeof(CheckpointHeader))
+    {
+        void * data = mmap(NULL, _size, PROT_READ, MAP_SHARED, file, 0);
+        if (data != MAP_FAILED)
+            _data = static_cast<char const *>(data);
+    }
+    ::close(file);  // the mapping keeps the file
+#endif
+
+    if (!_data)
+    {
+        fprintf(stderr, "Error: could not map %s\n", path);
+        close();
+        return false;
+    }
+
+    CheckpointHeader const & h = header();
+    bool valid = memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic)) == 0;
+    if (valid && (h.version != CHECKPOINT_VERSION || h.byte_order != CHECKPOINT_BYTE_ORDER))
+    {
+        fprintf(stderr, "Error: %s is version %u in %s byte order, expected version %u\n", path, h.version,
+                h.byte_order == CHECKPOINT_BYTE_ORDER ? "this" : "another", CHECKPOINT_VERSION);
+        close();
+        return false;
+    }
+    valid = valid && (h.scalar_size == 4 || h.scalar_size == 8)
+                  && sizeof(h) + (uint64_t) h.sections * sizeof(CheckpointSection) <= _size;
+
+    // every section must lie within the file
+    CheckpointSection const * sections = reinterpret_cast<CheckpointSection const *>(_data + sizeof(h));
+    for (uint32_t i = 0; valid && i < h.sections; ++i)
+    {
+        uint64_t const bytes = sections[i].element_size * sections[i].count;
+        valid = sections[i].offset % SECTION_ALIGNMENT == 0 && sections[i].offset <= _size
+             && (sections[i].element_size == 0 || sections[i].count <= _size / sections[i].element_size)
+             && bytes <= _size - sections[i].offset;
+    }
+    valid = valid && is_valid_matrix(*this);
+    if (!valid)
+    {
+        fprintf(stderr, "Error: %s is not a valid checkpoint\n", path);
+        close();
+        return false;
+    }
+    return true;
+}
+
+void Checkpoint::close()
+{
+#ifdef _WIN32
+    if (_data)
+        UnmapViewOfFile(_data);
+    if (_mapping)
+        CloseHandle(_mapping);
+    if (_file)
+        CloseHandle(_file);
+    _mapping = NULL;
+    _file = NULL;
+#else
+    if (_data)
+        munmap(const_cast<char *>(_data), _size);
+#endif
+    _data = NULL;
+    _size = 0;
+}
+
+CheckpointSection const * Checkpoint::find(uint32_t id) const
+{
+    if (!is_open())
+        return NULL;
+    CheckpointSection const * sections = reinterpret_cast<CheckpointSection const *>(_data + sizeof(CheckpointHeader));
+    for (uint32_t i = 0; i < header().sections; ++i)
+        if (sections[i].id == id)
+            return &sections[i];
+    return NULL;
+}
+
+void const * Checkpoint::section(uint32_t id, uint32_t element_size, uint64_t & count) const
+{
+    CheckpointSection const * section = find(id);
+    if (!section || section->element_size != element_size || section->count == 0)
+    {
+        count = 0;
+        return NULL;
+    }
+    count = section->count;
+    return _data + section->offset;
+}
+
+std::string Checkpoint::metadata(char const * key) const
+{
+    uint64_t size = 0;
+    char const * text = static_cast<char const *>(section(SECTION_METADATA, 1, size));
+    size_t const length = strlen(key);
+    for (char const * line = text, * end = text + size; line < end;)
+    {
+        char const * next = static_cast<char const *>(memchr(line, '\n', end - line));
+        if (!next)
+            next = end;
+        if ((size_t) (next - line) > length && memcmp(line, key, length) == 0 && line[length] == '=')
+            return std::string(line + length + 1, next);
+        line = next + 1;
+    }
+    return std::string();
+}
+
+}  // namespace Fem
@@ -0,0 +1,347 @@
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include <cassert>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "fem.h"
+#include "fem2d.h"
+
+namespace Fem
+{
+
+/*
+ * Binary checkpoint of a solved problem: a 64 byte header, a table of
+ * sections, and the sections themselves, each starting on a 64 byte
+ * boundary so that they can be used in place once the file is mapped.
+ * Values are in the byte order of the writer, which the header records.
+ *
+ * Sections are found by id, readers skip ids they don't know, so later
+ * versions can add sections without breaking older readers; the
+ * version only changes for incompatible layouts.
+ *
+ * A is stored compressed by column, as Eigen keeps it, which for the
+ * symmetric stiffness matrices here is also its compressed row form.
+ * Metadata is text, one key=value per line.
+ */
+static char const CHECKPOINT_MAGIC[8] = { 'A', 'R', 'C', 'C', 'K', 'P', 'T', '\0' };
+static uint32_t const CHECKPOINT_VERSION = 1;
+static uint32_t const CHECKPOINT_BYTE_ORDER = 0x01020304;
+
+enum CheckpointSectionId
+{
+    SECTION_X = 1,      // node coordinates
+    SECTION_Y,
+    SECTION_U,          // state vector
+    SECTION_T0,         // triangle corners
+    SECTION_T1,
+    SECTION_T2,
+    SECTION_E0,         // boundary edges
+    SECTION_E1,
+    SECTION_MARKER,
+    SECTION_A_OUTER,    // stiffness matrix, column starts
+    SECTION_A_INNER,    // row of every value
+    SECTION_A_VALUES,
+    SECTION_METADATA
+};
+
+struct CheckpointHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;   // CHECKPOINT_BYTE_ORDER as written
+    uint32_t scalar_size;  // bytes per value of x, y, u and A, 4 or 8
+    uint32_t dimension;    // of the mesh, 1 or 2
+    uint32_t sections;     // entries in the table following the header
+    uint32_t reserved0;
+    uint64_t step;         // of a transient run
+    double time;
+    uint64_t reserved[2];
+};
+
+struct CheckpointSection
+{
+    uint32_t id;
+    uint32_t element_size;
+    uint64_t offset;       // from the start of the file
+    uint64_t count;        // of elements
+    uint64_t reserved;
+};
+
+/*
+ * Collects sections and writes them with one sequential write (writev
+ * on POSIX), to a temporary file that is flushed to disk and then
+ * replaces path, so that a crash or power loss while writing leaves the
+ * previous checkpoint intact. The data of added sections is not copied
+ * and must stay alive until write.
+ */
+class CheckpointWriter
+{
+public:
+    CheckpointWriter(int scalar_size, int dimension);
+    void set_time(double time, uint64_t step);
+    void add(uint32_t id, void const * data, uint32_t element_size, uint64_t count);
+    template <typename T>
+    void add(uint32_t id, T const * data, size_t count)
+    {
+        add(id, data, sizeof(T), count);
+    }
+    void add_metadata(std::string const & key, std::string const & value);
+    bool write(char const * path);
+
+private:
+    struct Block
+    {
+        void const * data;
+        uint64_t size;
+    };
+
+    CheckpointHeader _header;
+    std::vector<CheckpointSection> _sections;
+    std::vector<Block> _blocks;
+    std::string _metadata;
+};
+
+/*
+ * Checkpoint file mapped read only. The views it hands out point into
+ * the mapping, nothing is read until it is touched, so opening is
+ * instant whatever the size, and pages are loaded (and dropped again
+ * under memory pressure) by the OS. Views are valid until close.
+ */
+class Checkpoint
+{
+public:
+    template <typename T>
+    struct View
+    {
+        typedef Eigen::Map< Eigen::Matrix<T, Eigen::Dynamic, 1> const, Eigen::Aligned16 > Type;
+    };
+
+    Checkpoint();
+    ~Checkpoint();
+    bool open(char const * path);
+    void close();
+    bool is_open() const { return _data != NULL; }
+    CheckpointHeader const & header() const
+    {
+        assert(is_open());
+        return *reinterpret_cast<CheckpointHeader const *>(_data);
+    }
+    bool has(uint32_t id) const { return find(id) != NULL; }
+
+    // start of a section, NULL with count 0 if missing or of another element size
+    void const * section(uint32_t id, uint32_t element_size, uint64_t & count) const;
+
+    template <typename T>
+    typename View<T>::Type vector(uint32_t id) const
+    {
+        uint64_t count = 0;
+        T const * data = static_cast<T const *>(section(id, sizeof(T), count));
+        return typename View<T>::Type(data, (Eigen::Index) count);
+    }
+
+    // stiffness matrix, n x n, with no values if not stored; open checks its structure
+    template <typename precision>
+    Eigen::Map< Eigen::SparseMatrix<precision> const > matrix() const
+    {
+        uint64_t outer = 0, inner = 0, values = 0;
+        int const * starts = static_cast<int const *>(section(SECTION_A_OUTER, sizeof(int), outer));
+        int const * rows = static_cast<int const *>(section(SECTION_A_INNER, sizeof(int), inner));
+        precision const * data = static_cast<precision const *>(section(SECTION_A_VALUES, sizeof(precision), values));
+        if (outer == 0 || inner != values)
+            return Eigen::Map< Eigen::SparseMatrix<precision> const >(0, 0, 0, &_no_columns, NULL, NULL);
+        return Eigen::Map< Eigen::SparseMatrix<precision> const >((Eigen::Index) outer - 1, (Eigen::Index) outer - 1,
+                                                                  (Eigen::Index) values, starts, rows, data);
+    }
+
+    // value of a metadata key, empty if missing
+    std::string metadata(char const * key) const;
+
+private:
+    Checkpoint(Checkpoint const &);
+    Checkpoint & operator=(Checkpoint const &);
+
+    CheckpointSection const * find(uint32_t id) const;
+
+    char const * _data;
+    uint64_t _size;
+#ifdef _WIN32
+    void * _file;
+    void * _mapping;
+#endif
+    static int const _no_columns;
+};
+
+/*
+ * Saves the bar, with A if with_matrix (converted to sparse, as fem.h
+ * keeps it dense).
+ */
+template <typename precision, int nodes>
+bool save_checkpoint(char const * path, Problem<precision, nodes> const & p, bool with_matrix = false,
+                     double time = 0.0, uint64_t step = 0)
+{
+    CheckpointWriter writer(sizeof(precision), 1);
+    writer.set_time(time, step);
+    writer.add(SECTION_X, p.x.data(), nodes);
+    writer.add(SECTION_U, p.u.data(), nodes);
+
+    Eigen::SparseMatrix<precision> A;
+    if (with_matrix)
+    {
+        A = p.A.sparseView();
+        A.makeCompressed();
+        writer.add(SECTION_A_OUTER, A.outerIndexPtr(), nodes + 1);
+        writer.add(SECTION_A_INNER, A.innerIndexPtr(), A.nonZeros());
+        writer.add(SECTION_A_VALUES, A.valuePtr(), A.nonZeros());
+    }
+    writer.add_metadata("problem", "bar");
+    return writer.write(path);
+}
+
+/*
+ * Saves the mesh and solution of the 2D problem, with A if with_matrix
+ * and it has been assembled.
+ */
+template <typename precision>
+bool save_checkpoint(char const * path, Problem2D<precision> const & p, bool with_matrix = false,
+                     double time = 0.0, uint64_t step = 0)
+{
+    Mesh2D<precision> const & mesh = p.mesh;
+    CheckpointWriter writer(sizeof(precision), 2);
+    writer.set_time(time, step);
+    writer.add(SECTION_X, mesh.x.data(), mesh.x.size());
+    writer.add(SECTION_Y, mesh.y.data(), mesh.y.size());
+    writer.add(SECTION_U, p.u.data(), p.u.size());
+    writer.add(SECTION_T0, mesh.t0.data(), mesh.t0.size());
+    writer.add(SECTION_T1, mesh.t1.data(), mesh.t1.size());
+    writer.add(SECTION_T2, mesh.t2.data(), mesh.t2.size());
+    writer.add(SECTION_E0, mesh.e0.data(), mesh.e0.size());
+    writer.add(SECTION_E1, mesh.e1.data(), mesh.e1.size());
+    writer.add(SECTION_MARKER, mesh.marker.data(), mesh.marker.size());
+    if (with_matrix && p.A.rows() == mesh.nodes() && p.A.isCompressed())
+    {
+        writer.add(SECTION_A_OUTER, p.A.outerIndexPtr(), mesh.nodes() + 1);
+        writer.add(SECTION_A_INNER, p.A.innerIndexPtr(), p.A.nonZeros());
+        writer.add(SECTION_A_VALUES, p.A.valuePtr(), p.A.nonZeros());
+    }
+    writer.add_metadata("problem", "plate");
+    return writer.write(path);
+}
+
+/*
+ * Restores x and u of the bar, e.g. to continue a transient run, with
+ * the time and step it was saved at. Values are converted if the file
+ * has another precision. Returns false if the file is of another
+ * problem or size.
+ */
+template <typename precision, int nodes>
+bool load_checkpoint(Checkpoint const & checkpoint, Problem<precision, nodes> & p,
+                     double * time = NULL, uint64_t * step = NULL)
+{
+    if (!checkpoint.is_open() || checkpoint.header().dimension != 1)
+        return false;
+
+    if (checkpoint.header().scalar_size == sizeof(double))
+    {
+        typename Checkpoint::View<double>::Type x = checkpoint.vector<double>(SECTION_X);
+        typename Checkpoint::View<double>::Type u = checkpoint.vector<double>(SECTION_U);
+        if (x.size() != nodes || u.size() != nodes)
+            return false;
+        p.x = x.cast<precision>();
+        p.u = u.cast<precision>();
+    }
+    else
+    {
+        typename Checkpoint::View<float>::Type x = checkpoint.vector<float>(SECTION_X);
+        typename Checkpoint::View<float>::Type u = checkpoint.vector<float>(SECTION_U);
+        if (x.size() != nodes || u.size() != nodes)
+            return false;
+        p.x = x.cast<precision>();
+        p.u = u.cast<precision>();
+    }
+    p.mesh_changed();
+    if (time)
+        *time = checkpoint.header().time;
+    if (step)
+        *step = checkpoint.header().step;
+    return true;
+}
+
+// whether every index of a mesh section refers to one of nodes nodes
+inline bool indices_in_range(Checkpoint::View<int>::Type const & indices, int nodes)
+{
+    return indices.size() == 0 || (indices.minCoeff() >= 0 && indices.maxCoeff() < nodes);
+}
+
+/*
+ * Restores the mesh and solution of the 2D problem, converted to its
+ * precision. Boundary conditions and coefficients are not part of the
+ * file and stay as they are; the cached pattern is invalidated. The
+ * file is checked to hold a consistent mesh first, p is left as it is
+ * if it doesn't.
+ */
+template <typename precision>
+bool load_checkpoint(Checkpoint const & checkpoint, Problem2D<precision> & p,
+                     double * time = NULL, uint64_t * step = NULL)
+{
+    typedef Eigen::Matrix<precision, Eigen::Dynamic, 1> Vector;
+
+    if (!checkpoint.is_open() || checkpoint.header().dimension != 2)
+        return false;
+
+    Vector x, y, u;
+    if (checkpoint.header().scalar_size == sizeof(double))
+    {
+        x = checkpoint.vector<double>(SECTION_X).cast<precision>();
+        y = checkpoint.vector<double>(SECTION_Y).cast<precision>();
+        u = checkpoint.vector<double>(SECTION_U).cast<precision>();
+    }
+    else
+    {
+        x = checkpoint.vector<float>(SECTION_X).cast<precision>();
+        y = checkpoint.vector<float>(SECTION_Y).cast<precision>();
+        u = checkpoint.vector<float>(SECTION_U).cast<precision>();
+    }
+    if (x.size() != y.size() || x.size() != u.size())
+        return false;
+
+    int const nodes = (int) x.size();
+    Checkpoint::View<int>::Type const t0 = checkpoint.vector<int>(SECTION_T0);
+    Checkpoint::View<int>::Type const t1 = checkpoint.vector<int>(SECTION_T1);
+    Checkpoint::View<int>::Type const t2 = checkpoint.vector<int>(SECTION_T2);
+    Checkpoint::View<int>::Type const e0 = checkpoint.vector<int>(SECTION_E0);
+    Checkpoint::View<int>::Type const e1 = checkpoint.vector<int>(SECTION_E1);
+    Checkpoint::View<int>::Type const marker = checkpoint.vector<int>(SECTION_MARKER);
+    if (t1.size() != t0.size() || t2.size() != t0.size() || e1.size() != e0.size() || marker.size() != e0.size())
+        return false;
+    if (!indices_in_range(t0, nodes) || !indices_in_range(t1, nodes) || !indices_in_range(t2, nodes)
+        || !indices_in_range(e0, nodes) || !indices_in_range(e1, nodes))
+        return false;
+
+    Mesh2D<precision> & mesh = p.mesh;
+    mesh.x.assign(x.data(), x.data() + x.size());
+    mesh.y.assign(y.data(), y.data() + y.size());
+    mesh.t0.assign(t0.data(), t0.data() + t0.size());
+    mesh.t1.assign(t1.data(), t1.data() + t1.size());
+    mesh.t2.assign(t2.data(), t2.data() + t2.size());
+    mesh.e0.assign(e0.data(), e0.data() + e0.size());
+    mesh.e1.assign(e1.data(), e1.data() + e1.size());
+    mesh.marker.assign(marker.data(), marker.data() + marker.size());
+    p.u = u;
+    p.invalidate_pattern();
+
+    if (time)
+        *time = checkpoint.header().time;
+    if (step)
+        *step = checkpoint.header().step;
+    return true;
+}
+
+}  // namespace Fem
+
+#endif  // __CHECKPOINT_H
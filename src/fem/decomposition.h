@@ -0,0 +1,618 @@
+#ifndef __DECOMPOSITION_H
+#define __DECOMPOSITION_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "fem.h"
+#include "fem2d.h"
+#include "renumber.h"
+#include "arena.h"
+#include "stats.h"
+#include "tasks.h"
+
+namespace Fem
+{
+
+/*
+ * AUTOMATIC forms and factors S while that is cheap: forming it takes a
+ * solve per interface node a part touches, and factoring it is dense.
+ * Past either limit, a 2D mesh in a few parts already, S is left to
+ * conjugate gradients.
+ */
+static int const DIRECT_INTERFACE_LIMIT = 1000;
+static int const DIRECT_BOUNDARY_LIMIT = 64;
+
+/*
+ * Non-overlapping domain decomposition of a symmetric positive definite
+ * system A u = b. The nodes are split into parts; nodes coupled to a
+ * node of a later part form the interface, the rest the interiors,
+ * which are then only coupled through the interface. Ordering the
+ * interiors first,
+ *
+ *   [ A_1              B_1 ] [ u_1 ]   [ b_1 ]
+ *   [      ...         ... ] [ ... ] = [ ... ]
+ *   [           A_P    B_P ] [ u_P ]   [ b_P ]
+ *   [ B_1' ... B_P'    A_G ] [ u_G ]   [ b_G ]
+ *
+ * so the interior blocks A_p are factored independently, in parallel,
+ * and the interface solves the Schur complement
+ *
+ *   S u_G = b_G - sum B_p' A_p^-1 b_p,    S = A_G - sum B_p' A_p^-1 B_p
+ *
+ * after which the interiors follow, again independently. S is formed
+ * and factored when the interface is small (a bar cut into P parts has
+ * P - 1 interface nodes), otherwise applied without forming it within
+ * conjugate gradients, every product costing a pair of triangular
+ * solves per part.
+ *
+ * The split of A into blocks, their symbolic factorizations and where
+ * every entry of A goes are cached by analyze, so factorize and solve
+ * can be repeated for new values on the same pattern.
+ */
+template <typename precision>
+class DomainDecomposition
+{
+public:
+    typedef Eigen::SparseMatrix<precision> SparseMatrix;
+    typedef Eigen::Matrix<precision, Eigen::Dynamic, 1> Vector;
+    typedef Eigen::Matrix<precision, Eigen::Dynamic, Eigen::Dynamic> DenseMatrix;
+    typedef Eigen::Map<Vector, Eigen::AlignedMax> Workspace;
+
+    DomainDecomposition()
+    : parts(std::max(1, (int) std::thread::hardware_concurrency()))
+    , interface_solver(AUTOMATIC)
+    , tolerance(1.0e-10)
+    , iterations(0)
+    , workspace(NULL)
+    , _rows(-1)
+    , _nonzeros(-1)
+    , _direct(false)
+    , _b(NULL)
+    , _u(NULL)
+    , _v(NULL)
+    {}
+    ~DomainDecomposition()
+    {
+        clear();
+    }
+    int interface_size() const { return (int) _interface.size(); }
+    int subdomains() const { return (int) _subdomains.size(); }
+    bool is_analyzed(SparseMatrix const & A) const
+    {
+        return _rows == A.rows() && _nonzeros == A.nonZeros();
+    }
+    void invalidate()
+    {
+        _rows = -1;
+    }
+
+    /*
+     * Splits A, compressed and with a symmetric pattern, by part[node]
+     * (0 to parts - 1), and analyzes the interior blocks.
+     */
+    void analyze(SparseMatrix const & A, std::vector<int> const & part)
+    {
+        assert(A.rows() == A.cols() && (int) part.size() == A.rows());
+        assert(A.isCompressed());
+
+        clear();
+        int const n = (int) A.rows();
+        int const * outer = A.outerIndexPtr();
+        int const * inner = A.innerIndexPtr();
+        int const count = n > 0 ? *std::max_element(part.begin(), part.end()) + 1 : 0;
+
+        std::vector<char> on_interface(n, 0);
+        for (int j = 0; j < n; ++j)
+        {
+            for (int k = outer[j]; k < outer[j + 1]; ++k)
+            {
+                int const i = inner[k];
+                if (part[i] > part[j])
+                    on_interface[j] = 1;
+                else if (part[j] > part[i])
+                    on_interface[i] = 1;
+            }
+        }
+
+        _subdomains.resize(count);
+        for (int p = 0; p < count; ++p)
+            _subdomains[p] = new Subdomain();
+        _local.resize(n);
+        for (int i = 0; i < n; ++i)
+        {
+            assert(part[i] >= 0);
+            if (on_interface[i])
+            {
+                _local[i] = (int) _interface.size();
+                _interface.push_back(i);
+            }
+            else
+            {
+                Subdomain * s = _subdomains[part[i]];
+                _local[i] = (int) s->interior.size();
+                s->interior.push_back(i);
+            }
+        }
+
+        // interface nodes coupled to the interior of every part
+        for (int j = 0; j < n; ++j)
+            for (int k = outer[j]; k < outer[j + 1]; ++k)
+                if (!on_interface[inner[k]] && on_interface[j])
+                    _subdomains[part[inner[k]]]->boundary.push_back(_local[j]);
+        for (int p = 0; p < count; ++p)
+        {
+            std::vector<int> & boundary = _subdomains[p]->boundary;
+            std::sort(boundary.begin(), boundary.end());
+            boundary.erase(std::unique(boundary.begin(), boundary.end()), boundary.end());
+        }
+
+        // the pattern of every block, and where every entry of A goes
+        // (the B_p' part of A is left out, it mirrors B_p)
+        std::vector< std::vector< Eigen::Triplet<precision> > > interior(count), coupling(count);
+        std::vector< Eigen::Triplet<precision> > interface;
+        for (int j = 0; j < n; ++j)
+        {
+            for (int k = outer[j]; k < outer[j + 1]; ++k)
+            {
+                int const i = inner[k];
+                if (on_interface[i] && on_interface[j])
+                    interface.push_back(Eigen::Triplet<precision>(_local[i], _local[j], 0));
+                else if (!on_interface[i] && !on_interface[j])
+                    interior[part[i]].push_back(Eigen::Triplet<precision>(_local[i], _local[j], 0));
+                else if (!on_interface[i])
+                    coupling[part[i]].push_back(Eigen::Triplet<precision>(_local[i], boundary_column(part[i], _local[j]), 0));
+            }
+        }
+        for (int p = 0; p < count; ++p)
+        {
+            Subdomain & s = *_subdomains[p];
+            s.A = SparseMatrix((int) s.interior.size(), (int) s.interior.size());
+            s.A.setFromTriplets(interior[p].begin(), interior[p].end());
+            s.A.makeCompressed();
+            s.B = SparseMatrix((int) s.interior.size(), (int) s.boundary.size());
+            s.B.setFromTriplets(coupling[p].begin(), coupling[p].end());
+            s.B.makeCompressed();
+        }
+        _A = SparseMatrix((int) _interface.size(), (int) _interface.size());
+        _A.setFromTriplets(interface.begin(), interface.end());
+        _A.makeCompressed();
+
+        _destination.resize(A.nonZeros());
+        for (int j = 0; j < n; ++j)
+        {
+            for (int k = outer[j]; k < outer[j + 1]; ++k)
+            {
+                int const i = inner[k];
+                Destination & d = _destination[k];
+                int column = _local[j];
+                if (on_interface[i] && on_interface[j])
+                {
+                    d.values = &_A;
+                }
+                else if (!on_interface[i] && !on_interface[j])
+                {
+                    d.values = &_subdomains[part[i]]->A;
+                }
+                else if (!on_interface[i])
+                {
+                    d.values = &_subdomains[part[i]]->B;
+                    column = boundary_column(part[i], _local[j]);
+                }
+                else
+                {
+                    d.values = NULL;
+                    continue;
+                }
+                int const * rows = d.values->innerIndexPtr();
+                int const * begin = rows + d.values->outerIndexPtr()[column];
+                int const * end = rows + d.values->outerIndexPtr()[column + 1];
+                d.index = (int) (std::lower_bound(begin, end, _local[i]) - rows);
+            }
+        }
+
+        run(&DomainDecomposition::analyze_part);
+        _rows = n;
+        _nonzeros = A.nonZeros();
+    }
+
+    /*
+     * Factors the interior blocks in parallel, and S if it is solved
+     * directly. A must have the pattern given to analyze. Returns false
+     * if a block or S is not positive definite.
+     */
+    bool factorize(SparseMatrix const & A)
+    {
+        assert(is_analyzed(A));
+
+        precision const * values = A.valuePtr();
+        for (int k = 0; k < (int) _destination.size(); ++k)
+            if (_destination[k].values)
+                _destination[k].values->valuePtr()[_destination[k].index] = values[k];
+
+        int const m = interface_size();
+        int boundary = 0;
+        for (int p = 0; p < subdomains(); ++p)
+            boundary = std::max(boundary, (int) _subdomains[p]->boundary.size());
+        _direct = interface_solver == DIRECT
+               || (interface_solver == AUTOMATIC && m <= DIRECT_INTERFACE_LIMIT && boundary <= DIRECT_BOUNDARY_LIMIT);
+        run(&DomainDecomposition::factorize_part);
+        for (int p = 0; p < subdomains(); ++p)
+            if (!_subdomains[p]->ok)
+                return false;
+
+        if (_direct)
+        {
+            DenseMatrix S = DenseMatrix(_A);
+            for (int p = 0; p < subdomains(); ++p)
+            {
+                Subdomain const & s = *_subdomains[p];
+                for (int b = 0; b < (int) s.boundary.size(); ++b)
+                    for (int a = 0; a < (int) s.boundary.size(); ++a)
+                        S(s.boundary[a], s.boundary[b]) -= s.schur(a, b);
+            }
+            _interface_solver.compute(S);
+            return m == 0 || (_interface_solver.info() == Eigen::Success && _interface_solver.isPositive());
+        }
+        _diagonal = Vector(_A.diagonal());
+        return true;
+    }
+
+    /*
+     * Solves for the factored A, returns false if the interface did not
+     * converge within tolerance (relative residual of S).
+     */
+    bool solve(Vector const & b, Vector & u)
+    {
+        assert(b.size() == _rows);
+        int const m = interface_size();
+        u.resize(_rows);
+        _b = &b;
+        _u = &u;
+
+        // interface vectors live until the end of the solve
+        Arena & arena = workspace ? *workspace : _workspace;
+        ArenaScope scope(&arena);
+
+        // condense the interiors onto the interface
+        run(&DomainDecomposition::condense_part);
+        Workspace g(arena.allocate_array<precision>(m), m);
+        for (int i = 0; i < m; ++i)
+            g[i] = b[_interface[i]];
+        for (int p = 0; p < subdomains(); ++p)
+        {
+            Subdomain const & s = *_subdomains[p];
+            for (int a = 0; a < (int) s.boundary.size(); ++a)
+                g[s.boundary[a]] -= s.y[a];
+        }
+
+        Workspace x(arena.allocate_array<precision>(m), m);
+        bool ok = true;
+        iterations = 0;
+        if (m > 0 && _direct)
+            x = _interface_solver.solve(g);
+        else if (m > 0)
+            ok = interface_cg(arena, g, x);
+
+        for (int i = 0; i < m; ++i)
+            u[_interface[i]] = x[i];
+        _v = x.data();
+        run(&DomainDecomposition::expand_part);
+
+        _b = NULL;
+        _u = NULL;
+        _v = NULL;
+        return ok;
+    }
+
+    int parts;                       // requested by solve_decomposed, at most the number of nodes
+    LinearSolver interface_solver;   // ITERATIVE for conjugate gradients on S
+    precision tolerance;             // relative residual of the interface iterations
+    int iterations;                  // taken by the last solve
+    Arena * workspace;               // scratch of solve, an own arena if NULL
+
+private:
+    DomainDecomposition(DomainDecomposition const &);
+    DomainDecomposition & operator=(DomainDecomposition const &);
+
+    struct Subdomain
+    {
+        std::vector<int> interior;   // node of every row of A
+        std::vector<int> boundary;   // interface index of every column of B
+        SparseMatrix A;              // interior block A_p
+        SparseMatrix B;              // coupling B_p to the interface
+        Eigen::SimplicialLDLT<SparseMatrix> solver;
+        DenseMatrix schur;           // B_p' A_p^-1 B_p, for the direct interface solver
+        Vector x, y, z;              // scratch by interior, boundary and boundary
+        bool ok;
+    };
+
+    struct Destination
+    {
+        SparseMatrix * values;  // block, NULL if the entry is left out
+        int index;              // in the values of the block
+    };
+
+    typedef void (DomainDecomposition::*Step)(int part);
+
+    int boundary_column(int part, int interface_index) const
+    {
+        std::vector<int> const & boundary = _subdomains[part]->boundary;
+        return (int) (std::lower_bound(boundary.begin(), boundary.end(), interface_index) - boundary.begin());
+    }
+
+    void clear()
+    {
+        for (size_t p = 0; p < _subdomains.size(); ++p)
+            delete _subdomains[p];
+        _subdomains.clear();
+        _interface.clear();
+        _local.clear();
+        _destination.clear();
+        _rows = -1;
+        _nonzeros = -1;
+    }
+
+    /*
+     * Runs step for every part on the task pool.
+     */
+    class StepRange : public RangeTask
+    {
+    public:
+        StepRange(DomainDecomposition & owner_, Step step_)
+        : owner(owner_)
+        , step(step_)
+        {}
+        virtual void run(int begin, int end)
+        {
+            for (int p = begin; p < end; ++p)
+                (owner.*step)(p);
+        }
+
+        DomainDecomposition & owner;
+        Step step;
+    };
+
+    void run(Step step)
+    {
+        StepRange range(*this, step);
+        parallel_for(0, subdomains(), 1, range);
+    }
+
+    void analyze_part(int part)
+    {
+        Subdomain & s = *_subdomains[part];
+        if (!s.interior.empty())
+            s.solver.analyzePattern(s.A);
+    }
+
+    void factorize_part(int part)
+    {
+        Subdomain & s = *_subdomains[part];
+        s.ok = true;
+        if (s.interior.empty())
+            return;
+        s.solver.factorize(s.A);
+        s.ok = s.solver.info() == Eigen::Success;
+        if (s.ok && _direct)
+        {
+            DenseMatrix const X = s.solver.solve(DenseMatrix(s.B));
+            s.schur.noalias() = s.B.transpose() * X;
+        }
+    }
+
+    // y = B_p' A_p^-1 b_p
+    void condense_part(int part)
+    {
+        Subdomain & s = *_subdomains[part];
+        s.y.setZero(s.boundary.size());
+        if (s.interior.empty())
+            return;
+        s.x.resize(s.interior.size());
+        for (int i = 0; i < (int) s.interior.size(); ++i)
+            s.x[i] = (*_b)[s.interior[i]];
+        s.x = s.solver.solve(s.x);
+        s.y.noalias() = s.B.transpose() * s.x;
+    }
+
+    // u_p = A_p^-1 (b_p - B_p u_G)
+    void expand_part(int part)
+    {
+        Subdomain & s = *_subdomains[part];
+        if (s.interior.empty())
+            return;
+        s.z.resize(s.boundary.size());
+        for (int a = 0; a < (int) s.boundary.size(); ++a)
+            s.z[a] = _v[s.boundary[a]];
+        s.x.resize(s.interior.size());
+        for (int i = 0; i < (int) s.interior.size(); ++i)
+            s.x[i] = (*_b)[s.interior[i]];
+        s.x.noalias() -= s.B * s.z;
+        s.x = s.solver.solve(s.x);
+        for (int i = 0; i < (int) s.interior.size(); ++i)
+            (*_u)[s.interior[i]] = s.x[i];
+    }
+
+    // y = B_p' A_p^-1 B_p v
+    void schur_part(int part)
+    {
+        Subdomain & s = *_subdomains[part];
+        s.y.setZero(s.boundary.size());
+        if (s.interior.empty())
+            return;
+        s.z.resize(s.boundary.size());
+        for (int a = 0; a < (int) s.boundary.size(); ++a)
+            s.z[a] = _v[s.boundary[a]];
+        s.x.noalias() = s.B * s.z;
+        s.x = s.solver.solve(s.x);
+        s.y.noalias() = s.B.transpose() * s.x;
+    }
+
+    void apply_schur(Workspace const & v, Workspace & result)
+    {
+        _v = v.data();
+        run(&DomainDecomposition::schur_part);
+        result.noalias() = _A * v;
+        for (int p = 0; p < subdomains(); ++p)
+        {
+            Subdomain const & s = *_subdomains[p];
+            for (int a = 0; a < (int) s.boundary.size(); ++a)
+                result[s.boundary[a]] -= s.y[a];
+        }
+    }
+
+    /*
+     * Conjugate gradients on S x = g, preconditioned by the diagonal of
+     * A_G, starting from zero, with its vectors taken from arena.
+     */
+    bool interface_cg(Arena & arena, Workspace const & g, Workspace & x)
+    {
+        int const m = (int) g.size();
+        precision const target = tolerance * g.norm();
+        x.setZero();
+        Workspace r(arena.allocate_array<precision>(m), m);
+        Workspace z(arena.allocate_array<precision>(m), m);
+        Workspace d(arena.allocate_array<precision>(m), m);
+        Workspace q(arena.allocate_array<precision>(m), m);
+        r = g;
+        z = r.cwiseQuotient(_diagonal);
+        d = z;
+        precision rz = r.dot(z);
+        for (iterations = 0; iterations < 2 * m && r.norm() > target; ++iterations)
+        {
+            apply_schur(d, q);
+            precision const alpha = rz / d.dot(q);
+            x += alpha * d;
+            r -= alpha * q;
+            z = r.cwiseQuotient(_diagonal);
+            precision const next = r.dot(z);
+            d = z + (next / rz) * d;
+            rz = next;
+        }
+        return r.norm() <= target;
+    }
+
+    std::vector<Subdomain *> _subdomains;
+    std::vector<int> _interface;          // node of every interface index
+    std::vector<int> _local;              // interior or interface index of every node
+    std::vector<Destination> _destination;  // of every entry of A
+    SparseMatrix _A;                      // interface block A_G
+    Vector _diagonal;                     // of A_G
+    Eigen::LDLT<DenseMatrix> _interface_solver;
+    int _rows;
+    long _nonzeros;
+    bool _direct;
+    Vector const * _b;                    // arguments of the parallel steps
+    Vector * _u;
+    precision const * _v;
+    Arena _workspace;
+};
+
+/*
+ * Splits the nodes into parts of equal size that are compact in space,
+ * consecutive runs along a Hilbert curve, which keeps the interfaces
+ * short.
+ */
+template <typename precision>
+void partition_nodes(Mesh2D<precision> const & mesh, int parts, std::vector<int> & part)
+{
+    int const nodes = mesh.nodes();
+    parts = std::max(1, std::min(parts, nodes));
+    Renumbering order;
+    curve_ordering(mesh, HILBERT, order);
+    part.resize(nodes);
+    for (int k = 0; k < nodes; ++k)
+        part[order.old_index[k]] = (int) ((long long) k * parts / nodes);
+}
+
+/*
+ * Like solve in fem.h, with the bar cut into decomposition.parts runs
+ * of nodes, so the interface is one node between every two runs and
+ * is solved directly.
+ */
+template <typename precision, int nodes>
+bool solve_decomposed(Problem<precision, nodes> & p, DomainDecomposition<precision> & decomposition)
+{
+    typedef typename DomainDecomposition<precision>::SparseMatrix SparseMatrix;
+    typedef typename DomainDecomposition<precision>::Vector Vector;
+    assert(p.is_valid());
+
+    SolveTiming timing;
+    double time = stats_now();
+    assemble_stiffness_matrix(p);
+    assemble_load_vector(p);
+    SparseMatrix A = p.A.sparseView();
+    A.makeCompressed();
+    timing.assembly = stats_now() - time;
+    timing.unknowns = nodes;
+
+    // the pattern of a dense A says nothing, so it is split every time
+    time = stats_now();
+    int const parts = std::max(1, std::min(decomposition.parts, nodes));
+    std::vector<int> part(nodes);
+    for (int i = 0; i < nodes; ++i)
+        part[i] = (int) ((long long) i * parts / nodes);
+    decomposition.analyze(A, part);
+    bool ok = decomposition.factorize(A);
+    timing.factor = stats_now() - time;
+    if (!ok)
+        return false;
+
+    time = stats_now();
+    Vector u;
+    ok = decomposition.solve(Vector(p.b), u);
+    p.u = u;
+    timing.solve = stats_now() - time;
+
+    Stats::instance().publish_solve(timing);
+    return ok;
+}
+
+/*
+ * Like solve in fem2d.h, with the mesh split by partition_nodes into
+ * decomposition.parts parts. The split and the symbolic factorizations
+ * are kept for the next solve on the same mesh; call
+ * decomposition.invalidate() along with p.invalidate_pattern().
+ */
+template <typename precision>
+bool solve_decomposed(Problem2D<precision> & p, DomainDecomposition<precision> & decomposition)
+{
+    assert(p.is_valid());
+
+    SolveTiming timing;
+    double time = stats_now();
+    assemble_stiffness_matrix(p);
+    assemble_load_vector(p);
+    timing.assembly = stats_now() - time;
+    timing.unknowns = p.mesh.nodes();
+
+    time = stats_now();
+    if (!decomposition.is_analyzed(p.A))
+    {
+        std::vector<int> part;
+        partition_nodes(p.mesh, decomposition.parts, part);
+        decomposition.analyze(p.A, part);
+    }
+    bool ok = decomposition.factorize(p.A);
+    timing.factor = stats_now() - time;
+    if (!ok)
+        return false;
+
+    time = stats_now();
+    ok = decomposition.solve(p.b, p.u);
+    p.iterations = decomposition.iterations;
+    timing.solve = stats_now() - time;
+
+    Stats::instance().publish_solve(timing);
+    return ok;
+}
+
+}  // namespace Fem
+
+#endif  // __DECOMPOSITION_H
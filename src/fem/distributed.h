@@ -0,0 +1,278 @@
+#ifndef __DISTRIBUTED_H
+#define __DISTRIBUTED_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "fem2d.h"
+#include "decomposition.h"
+#include "stats.h"
+#include "transport.h"
+
+namespace Fem
+{
+
+/*
+ * The part of a 2D problem one rank of a distributed solve works on:
+ * its own nodes first, then the ghosts, the nodes of other ranks that
+ * share a triangle with its own. Only its own rows of A are kept, whole
+ * since every triangle touching an own node is assembled here too.
+ */
+template <typename precision>
+class DistributedPart
+{
+public:
+    typedef Eigen::SparseMatrix<precision> SparseMatrix;
+    typedef Eigen::Matrix<precision, Eigen::Dynamic, 1> Vector;
+
+    int owned() const { return (int) global.size() - ghosts; }
+
+    std::vector<int> global;                // node in the whole mesh of every local node
+    int ghosts;
+    SparseMatrix A;                         // columns are own rows, A being symmetric
+    Vector b;                               // own rows
+    std::vector<int> neighbours;            // ranks sharing ghosts, ascending
+    std::vector< std::vector<int> > send;   // own local nodes every neighbour needs
+    std::vector< std::vector<int> > receive;  // local ghost nodes every neighbour owns
+};
+
+/*
+ * Sends the values of own nodes that neighbours need and receives the
+ * ghosts, in order of rank so the exchanges can't deadlock.
+ */
+template <typename precision>
+bool exchange_halo(Transport & transport, DistributedPart<precision> const & part,
+                   typename DistributedPart<precision>::Vector & x)
+{
+    std::vector<precision> out, in;
+    bool ok = true;
+    for (size_t n = 0; ok && n < part.neighbours.size(); ++n)
+    {
+        std::vector<int> const & send = part.send[n];
+        std::vector<int> const & receive = part.receive[n];
+        out.resize(send.size());
+        in.resize(receive.size());
+        for (size_t i = 0; i < send.size(); ++i)
+            out[i] = x[send[i]];
+        ok = transport.exchange(part.neighbours[n], out.data(), out.size() * sizeof(precision),
+                                in.data(), in.size() * sizeof(precision));
+        for (size_t i = 0; ok && i < receive.size(); ++i)
+            x[receive[i]] = in[i];
+    }
+    return ok;
+}
+
+/*
+ * Builds this rank's part of p, split over the ranks by partition_nodes,
+ * and assembles it. Every rank passes the whole problem.
+ */
+template <typename precision>
+bool build_distributed_part(Problem2D<precision> & p, Transport & transport, DistributedPart<precision> & part)
+{
+    Mesh2D<precision> const & mesh = p.mesh;
+    int const rank = transport.rank();
+    std::vector<int> owner;
+    partition_nodes(mesh, transport.size(), owner);
+
+    // triangles and boundary edges touching an own node
+    Problem2D<precision> local;
+    local.fun_a = p.fun_a;
+    local.fun_f = p.fun_f;
+    local.boundary = p.boundary;
+    std::vector<int> local_index(mesh.nodes(), -1);
+    part.global.clear();
+    for (int n = 0; n < mesh.nodes(); ++n)
+    {
+        if (owner[n] == rank)
+        {
+            local_index[n] = (int) part.global.size();
+            part.global.push_back(n);
+        }
+    }
+    int const owned = (int) part.global.size();
+    for (int t = 0; t < mesh.triangles(); ++t)
+    {
+        int const c[3] = { mesh.t0[t], mesh.t1[t], mesh.t2[t] };
+        if (owner[c[0]] != rank && owner[c[1]] != rank && owner[c[2]] != rank)
+            continue;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (local_index[c[i]] < 0)
+            {
+                local_index[c[i]] = (int) part.global.size();
+                part.global.push_back(c[i]);
+            }
+        }
+        local.mesh.t0.push_back(local_index[c[0]]);
+        local.mesh.t1.push_back(local_index[c[1]]);
+        local.mesh.t2.push_back(local_index[c[2]]);
+    }
+    for (int e = 0; e < mesh.boundary_edges(); ++e)
+    {
+        if (owner[mesh.e0[e]] != rank && owner[mesh.e1[e]] != rank)
+            continue;
+        local.mesh.e0.push_back(local_index[mesh.e0[e]]);
+        local.mesh.e1.push_back(local_index[mesh.e1[e]]);
+        local.mesh.marker.push_back(mesh.marker[e]);
+    }
+    part.ghosts = (int) part.global.size() - owned;
+    for (size_t n = 0; n < part.global.size(); ++n)
+    {
+        local.mesh.x.push_back(mesh.x[part.global[n]]);
+        local.mesh.y.push_back(mesh.y[part.global[n]]);
+    }
+
+    assemble_stiffness_matrix(local);
+    assemble_load_vector(local);
+    part.A = local.A.leftCols(owned);
+    part.b = local.b.head(owned);
+
+    // ghosts by owner; every neighbour is told which of its nodes are
+    // needed here, and tells which of ours it needs
+    part.neighbours.clear();
+    part.send.clear();
+    part.receive.clear();
+    std::vector< std::vector<int> > ghosts(transport.size());
+    for (int n = owned; n < (int) part.global.size(); ++n)
+        ghosts[owner[part.global[n]]].push_back(n);
+    // a bad request is not a reason to leave the other neighbours waiting
+    bool ok = true;
+    bool valid = true;
+    for (int r = 0; ok && r < transport.size(); ++r)
+    {
+        if (ghosts[r].empty())
+            continue;
+        // sharing a triangle works both ways, so r has ghosts here too
+        std::vector<int> wanted(ghosts[r].size());
+        for (size_t i = 0; i < wanted.size(); ++i)
+            wanted[i] = part.global[ghosts[r][i]];
+        int count = (int) wanted.size();
+        int requested = 0;
+        ok = transport.exchange(r, &count, sizeof(count), &requested, sizeof(requested));
+        std::vector<int> request(requested);
+        ok = ok && transport.exchange(r, wanted.data(), wanted.size() * sizeof(int),
+                                      request.data(), request.size() * sizeof(int));
+        for (size_t i = 0; ok && valid && i < request.size(); ++i)
+        {
+            int const n = request[i];
+            valid = n >= 0 && n < mesh.nodes() && local_index[n] >= 0 && local_index[n] < owned;
+            request[i] = valid ? local_index[n] : -1;
+        }
+        part.neighbours.push_back(r);
+        part.send.push_back(request);
+        part.receive.push_back(ghosts[r]);
+    }
+    return ok && valid;
+}
+
+/*
+ * Conjugate gradients with a diagonal preconditioner on A u = b spread
+ * over the ranks of transport, for problems too large for one machine.
+ * Every rank passes the whole problem (the mesh, functions and boundary
+ * conditions), keeps and assembles only its part, and exchanges the
+ * values at the edges of its part before every product with A. Dot
+ * products are summed over the ranks, so all take the same steps.
+ *
+ * On return p.u holds the whole solution on rank 0 and this rank's own
+ * nodes elsewhere; p.iterations is set on every rank. Returns false if
+ * the solve did not converge to p.tolerance or a message failed.
+ */
+template <typename precision>
+bool solve_distributed(Problem2D<precision> & p, Transport & transport)
+{
+    typedef typename DistributedPart<precision>::Vector Vector;
+    assert(p.is_valid());
+
+    SolveTiming timing;
+    double time = stats_now();
+    DistributedPart<precision> part;
+    bool ok = build_distributed_part(p, transport, part);
+    // all ranks leave together if any part failed, none waits on it
+    double failed = ok ? 0.0 : 1.0;
+    if (!transport.sum(&failed, 1) || failed != 0.0)
+    {
+        p.iterations = 0;
+        return false;
+    }
+    int const owned = part.owned();
+    timing.assembly = stats_now() - time;
+    timing.unknowns = p.mesh.nodes();
+
+    time = stats_now();
+    Vector const diagonal = part.A.diagonal();
+    Vector x = Vector::Zero(part.global.size());
+    Vector r = part.b;
+    Vector z = r.cwiseQuotient(diagonal);
+    Vector d = Vector::Zero(part.global.size());
+    d.head(owned) = z;
+    Vector q(owned);
+
+    double sums[2] = { (double) r.dot(z), (double) part.b.squaredNorm() };
+    ok = transport.sum(sums, 2);
+    double rz = sums[0];
+    double const target = p.tolerance * p.tolerance * sums[1];
+    double residual = sums[1];
+    int const max_iterations = 2 * p.mesh.nodes();
+    p.iterations = 0;
+    while (ok && residual > target && p.iterations < max_iterations)
+    {
+        ok = exchange_halo(transport, part, d);
+        q.noalias() = part.A.transpose() * d;
+
+        double dq = d.head(owned).dot(q);
+        ok = ok && transport.sum(&dq, 1);
+        precision const alpha = (precision) (rz / dq);
+        x.head(owned) += alpha * d.head(owned);
+        r -= alpha * q;
+        z = r.cwiseQuotient(diagonal);
+
+        sums[0] = r.dot(z);
+        sums[1] = r.squaredNorm();
+        ok = ok && transport.sum(sums, 2);
+        d.head(owned) = z + (precision) (sums[0] / rz) * d.head(owned);
+        rz = sums[0];
+        residual = sums[1];
+        ++p.iterations;
+    }
+    ok = ok && residual <= target;
+    timing.solve = stats_now() - time;
+
+    // own values to rank 0
+    p.u.setZero(p.mesh.nodes());
+    for (int n = 0; n < owned; ++n)
+        p.u[part.global[n]] = x[n];
+    if (transport.rank() != 0)
+    {
+        ok = transport.send(0, &owned, sizeof(owned))
+          && transport.send(0, part.global.data(), owned * sizeof(int))
+          && transport.send(0, x.data(), owned * sizeof(precision)) && ok;
+    }
+    else
+    {
+        std::vector<int> nodes;
+        std::vector<precision> values;
+        for (int rank = 1; rank < transport.size(); ++rank)
+        {
+            int count = 0;
+            bool const received = transport.receive(rank, &count, sizeof(count));
+            nodes.resize(received ? count : 0);
+            values.resize(nodes.size());
+            ok = received && transport.receive(rank, nodes.data(), nodes.size() * sizeof(int))
+              && transport.receive(rank, values.data(), values.size() * sizeof(precision)) && ok;
+            for (size_t i = 0; ok && i < nodes.size(); ++i)
+                p.u[nodes[i]] = values[i];
+        }
+    }
+
+    Stats::instance().publish_solve(timing);
+    return ok;
+}
+
+}  // namespace Fem
+
+#endif  // __DISTRIBUTED_H
@@ -2,6 +2,7 @@
 #define __FEM_H
 
 #include <cassert>
+#include <cmath>
 #include <iostream>
 
 #include <Eigen/Dense>
@@ -19,6 +20,45 @@ public:
     virtual precision operator()(precision) = 0;
 };
 
+/*
+ * Per element data of the bar, in structure of arrays form so that
+ * assembly streams through contiguous arrays instead of calling fun_a
+ * and fun_f for every element: the length and midpoint of every
+ * element, its two Gauss points, and a and f at those. Built by
+ * update_element_table, once per mesh and coefficient version of the
+ * problem.
+ */
+template <typename precision>
+class ElementTable
+{
+public:
+    typedef Eigen::Array<precision, Eigen::Dynamic, 1> Array;
+
+    ElementTable()
+    : mesh_version(-1)
+    , coefficient_version(-1)
+    , fun_a(NULL)
+    , fun_f(NULL)
+    {}
+    int elements() const
+    {
+        return (int) h.size();
+    }
+
+    Array h;         // element length
+    Array midpoint;
+    Array q0, q1;    // Gauss points, left one first
+    Array a_mid;     // a at the midpoint
+    Array a0, a1;    // a at the Gauss points
+    Array f0, f1;    // f at the Gauss points
+
+    // what the table was built from
+    int mesh_version;
+    int coefficient_version;
+    RealFunction<precision> * fun_a;
+    RealFunction<precision> * fun_f;
+};
+
 /* 
  * Table of interpretations of the state vector and conjugate vector by
  * application problem:
@@ -41,6 +81,8 @@ public:
     Problem()
     : fun_a(NULL)
     , fun_f(NULL)
+    , mesh_version(0)
+    , coefficient_version(0)
     {
         u.fill(0.0);
         x.fill(0.0);
@@ -65,6 +107,16 @@ public:
         assert(is_valid());
         return (*fun_f)(x);
     }
+    // call after moving nodes, or changing what fun_a or fun_f compute
+    // without pointing them elsewhere, so the element table is rebuilt
+    void mesh_changed()
+    {
+        ++mesh_version;
+    }
+    void coefficients_changed()
+    {
+        ++coefficient_version;
+    }
 
     Matrix<precision, nodes, 1> u;      // state vector
     Matrix<precision, nodes, 1> x;      // node coordinates
@@ -74,12 +126,63 @@ public:
     RealFunction<precision> * fun_f;    // forcing function
     precision k[2];                     // robin bc: pseudo dirichlet to neumann ratio 
     precision g[2];                     // robin bc: pseudo dirichlet or neumann bc
+    int mesh_version;                   // see mesh_changed
+    int coefficient_version;            // see coefficients_changed
+    ElementTable<precision> elements;   // see update_element_table
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW  // required for fixed sized Eigen member,
                                      // see Eigen docs for details
 };
 
 
+/*
+ * Brings p.elements up to date: the geometry when the mesh version
+ * changed, a and f when the geometry, the coefficient version or the
+ * functions changed. Nothing is done between assemblies that only
+ * change k or g.
+ */
+template <typename precision, int nodes>
+ElementTable<precision> const & update_element_table(Problem<precision, nodes> & p)
+{
+    typedef Eigen::Map< Eigen::Array<precision, nodes - 1, 1> const > Nodes;
+    assert(p.is_valid());
+
+    ElementTable<precision> & t = p.elements;
+    int const elements = nodes - 1;
+    bool const moved = t.mesh_version != p.mesh_version;
+    if (moved)
+    {
+        Nodes const left(p.x.data()), right(p.x.data() + 1);
+        precision const gauss = precision(0.5 - 0.5 / std::sqrt(3.0));
+        t.h = right - left;
+        t.midpoint = (left + right) / 2;
+        t.q0 = left + gauss * t.h;
+        t.q1 = left + (1 - gauss) * t.h;
+        t.mesh_version = p.mesh_version;
+    }
+
+    if (moved || t.coefficient_version != p.coefficient_version || t.fun_a != p.fun_a || t.fun_f != p.fun_f)
+    {
+        t.a_mid.resize(elements);
+        t.a0.resize(elements);
+        t.a1.resize(elements);
+        t.f0.resize(elements);
+        t.f1.resize(elements);
+        for (int e = 0; e < elements; ++e)
+        {
+            t.a_mid[e] = p.a(t.midpoint[e]);
+            t.a0[e] = p.a(t.q0[e]);
+            t.a1[e] = p.a(t.q1[e]);
+            t.f0[e] = p.f(t.q0[e]);
+            t.f1[e] = p.f(t.q1[e]);
+        }
+        t.coefficient_version = p.coefficient_version;
+        t.fun_a = p.fun_a;
+        t.fun_f = p.fun_f;
+    }
+    return t;
+}
+
 template <typename precision, int nodes>
 void assemble_stiffness_matrix(Problem<precision, nodes> & p)
 {
@@ -118,6 +221,12 @@ void solve(Problem<precision, nodes> & p)
      * - remember we are given the number of nodes
      *   rather than number of elements, so watch
      *   out for off-by-one errors
+     * - update_element_table(p) has the element
+     *   lengths, and a and f at the quadrature
+     *   points, as arrays to compute with, and
+     *   element_kernels in kernels.h turns those
+     *   into the local stiffness and load of every
+     *   element
      * - we are using Eigen for linear algebra; don't
      *   forget that Eigen has multiple solvers and
      *   that their usage depends on the problem
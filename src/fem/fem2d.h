@@ -0,0 +1,454 @@
+#ifndef __FEM2D_H
+#define __FEM2D_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/IterativeLinearSolvers>
+
+#include "arena.h"
+#include "stats.h"
+
+namespace Fem
+{
+
+template <typename precision>
+class RealFunction2D
+{
+public:
+    virtual ~RealFunction2D() {}
+    virtual precision operator()(precision x, precision y) = 0;
+};
+
+/*
+ * Unstructured mesh of linear (P1) triangles, stored as structure of
+ * arrays: node coordinates in x and y, the three corners of triangle t
+ * in t0[t], t1[t], t2[t] (counter clockwise), and the boundary as edges
+ * e0[e] -> e1[e] with a marker per edge that selects its boundary
+ * condition.
+ */
+template <typename precision>
+class Mesh2D
+{
+public:
+    int nodes() const { return (int) x.size(); }
+    int triangles() const { return (int) t0.size(); }
+    int boundary_edges() const { return (int) e0.size(); }
+
+    void clear()
+    {
+        x.clear();
+        y.clear();
+        t0.clear();
+        t1.clear();
+        t2.clear();
+        e0.clear();
+        e1.clear();
+        marker.clear();
+    }
+
+    std::vector<precision> x, y;
+    std::vector<int> t0, t1, t2;
+    std::vector<int> e0, e1;
+    std::vector<int> marker;
+};
+
+/*
+ * Boundary markers of make_rectangle_mesh.
+ */
+enum RectangleSide { BOTTOM = 0, RIGHT = 1, TOP = 2, LEFT = 3 };
+
+/*
+ * Structured triangulation of [x0, x1] x [y0, y1] with nx by ny cells,
+ * each split into two triangles along its diagonal. Nodes are numbered
+ * row by row from the bottom left corner.
+ */
+template <typename precision>
+void make_rectangle_mesh(Mesh2D<precision> & mesh,
+                         precision x0, precision x1, precision y0, precision y1,
+                         int nx, int ny)
+{
+    assert(nx > 0 && ny > 0);
+
+    mesh.clear();
+    int const columns = nx + 1;
+    mesh.x.reserve(columns * (ny + 1));
+    mesh.y.reserve(columns * (ny + 1));
+    for (int j = 0; j <= ny; ++j)
+    {
+        for (int i = 0; i <= nx; ++i)
+        {
+            mesh.x.push_back(x0 + (x1 - x0) * i / nx);
+            mesh.y.push_back(y0 + (y1 - y0) * j / ny);
+        }
+    }
+
+    mesh.t0.reserve(2 * nx * ny);
+    mesh.t1.reserve(2 * nx * ny);
+    mesh.t2.reserve(2 * nx * ny);
+    for (int j = 0; j < ny; ++j)
+    {
+        for (int i = 0; i < nx; ++i)
+        {
+            int const n = j * columns + i;
+            mesh.t0.push_back(n);
+            mesh.t1.push_back(n + 1);
+            mesh.t2.push_back(n + columns + 1);
+            mesh.t0.push_back(n);
+            mesh.t1.push_back(n + columns + 1);
+            mesh.t2.push_back(n + columns);
+        }
+    }
+
+    // counter clockwise around the boundary
+    for (int i = 0; i < nx; ++i)
+    {
+        mesh.e0.push_back(i);
+        mesh.e1.push_back(i + 1);
+        mesh.marker.push_back(BOTTOM);
+    }
+    for (int j = 0; j < ny; ++j)
+    {
+        mesh.e0.push_back(j * columns + nx);
+        mesh.e1.push_back((j + 1) * columns + nx);
+        mesh.marker.push_back(RIGHT);
+    }
+    for (int i = nx; i > 0; --i)
+    {
+        mesh.e0.push_back(ny * columns + i);
+        mesh.e1.push_back(ny * columns + i - 1);
+        mesh.marker.push_back(TOP);
+    }
+    for (int j = ny; j > 0; --j)
+    {
+        mesh.e0.push_back(j * columns);
+        mesh.e1.push_back((j - 1) * columns);
+        mesh.marker.push_back(LEFT);
+    }
+}
+
+/*
+ * Robin condition n . (a grad u) = kappa (g_d - u) + g_n on the edges
+ * with one marker. A large kappa approximates the Dirichlet condition
+ * u = g_d, kappa = 0 gives the Neumann condition with flux g_n.
+ */
+template <typename precision>
+struct BoundaryCondition2D
+{
+    BoundaryCondition2D(precision kappa_ = 0, precision g_d_ = 0, precision g_n_ = 0)
+    : kappa(kappa_), g_d(g_d_), g_n(g_n_)
+    {}
+    precision kappa;
+    precision g_d;
+    precision g_n;
+};
+
+/*
+ * Linear solvers for Problem2D. The sparse LDLT factorization is exact
+ * but its fill grows quickly with the mesh, so past DIRECT_SOLVER_LIMIT
+ * unknowns AUTOMATIC switches to conjugate gradients with a diagonal
+ * preconditioner, which also copes with the large kappa of pseudo
+ * Dirichlet boundaries, and starts from the previous solution.
+ */
+enum LinearSolver { AUTOMATIC, DIRECT, ITERATIVE };
+static int const DIRECT_SOLVER_LIMIT = 100000;
+
+/*
+ * -div(a grad u) = f on a triangle mesh with Robin boundary conditions.
+ *
+ * The sparsity pattern of A, the position of every element's entries in
+ * it and the symbolic factorization are cached, so solving again on the
+ * same mesh (new coefficients, boundary values or sources) only redoes
+ * the numeric work. Call invalidate_pattern after changing the mesh
+ * connectivity without changing its size.
+ */
+template <typename precision>
+class Problem2D
+{
+public:
+    typedef Eigen::SparseMatrix<precision> SparseMatrix;
+    typedef Eigen::Matrix<precision, Eigen::Dynamic, 1> Vector;
+
+    Problem2D()
+    : fun_a(NULL)
+    , fun_f(NULL)
+    , linear_solver(AUTOMATIC)
+    , tolerance(1.0e-8)
+    , iterations(0)
+    , workspace(NULL)
+    , pattern_nodes(-1)
+    , pattern_triangles(-1)
+    , pattern_edges(-1)
+    , analyzed(false)
+    {}
+    inline bool is_valid()
+    {
+        return (fun_a != NULL) && (fun_f != NULL);
+    }
+    inline precision a(precision x, precision y)
+    {
+        assert(is_valid());
+        return (*fun_a)(x, y);
+    }
+    inline precision f(precision x, precision y)
+    {
+        assert(is_valid());
+        return (*fun_f)(x, y);
+    }
+    void set_boundary(int marker, BoundaryCondition2D<precision> const & condition)
+    {
+        assert(marker >= 0);
+        if ((int) boundary.size() <= marker)
+            boundary.resize(marker + 1);
+        boundary[marker] = condition;
+    }
+    void invalidate_pattern()
+    {
+        pattern_nodes = -1;
+        analyzed = false;
+    }
+
+    Mesh2D<precision> mesh;
+    Vector u;                                              // state vector
+    SparseMatrix A;                                        // stiffness matrix
+    Vector b;                                              // load vector
+    RealFunction2D<precision> * fun_a;                     // constitutive relation
+    RealFunction2D<precision> * fun_f;                     // forcing function
+    std::vector< BoundaryCondition2D<precision> > boundary;  // by edge marker, zero flux if missing
+    LinearSolver linear_solver;
+    precision tolerance;                                   // relative residual of the iterative solver
+    int iterations;                                        // taken by the last iterative solve
+    Arena * workspace;                                     // scratch of assembly, the heap if NULL
+
+    // cached between solves on the same mesh
+    std::vector<int> scatter;  // value index in A of every element and edge entry
+    int pattern_nodes, pattern_triangles, pattern_edges;
+    Eigen::SimplicialLDLT<SparseMatrix> solver;
+    Eigen::ConjugateGradient<SparseMatrix, Eigen::Lower | Eigen::Upper> iterative_solver;
+    bool analyzed;
+
+private:
+    Problem2D(Problem2D const &);
+    Problem2D & operator=(Problem2D const &);
+};
+
+template <typename precision>
+BoundaryCondition2D<precision> boundary_condition(Problem2D<precision> const & p, int edge)
+{
+    int const marker = p.mesh.marker[edge];
+    if (marker < 0 || marker >= (int) p.boundary.size())
+        return BoundaryCondition2D<precision>();
+    return p.boundary[marker];
+}
+
+/*
+ * Builds the sparsity pattern of A from the mesh, and for every element
+ * (9 entries) and boundary edge (4 entries) the index of each entry in
+ * A's value array, so that assembly can add straight into the values.
+ */
+template <typename precision>
+void build_sparsity_pattern(Problem2D<precision> & p)
+{
+    typedef typename Problem2D<precision>::SparseMatrix SparseMatrix;
+
+    Mesh2D<precision> const & mesh = p.mesh;
+    int const nodes = mesh.nodes();
+    int const triangles = mesh.triangles();
+    int const edges = mesh.boundary_edges();
+
+    // the entries are only needed until the pattern is built
+    typedef Eigen::Triplet<precision> Triplet;
+    ArenaScope scope(p.workspace);
+    std::vector< Triplet, ArenaAllocator<Triplet> > entries((ArenaAllocator<Triplet>(p.workspace)));
+    entries.reserve(9 * triangles + 4 * edges);
+    for (int t = 0; t < triangles; ++t)
+    {
+        int const n[3] = { mesh.t0[t], mesh.t1[t], mesh.t2[t] };
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+                entries.push_back(Triplet(n[i], n[j], 0));
+    }
+    for (int e = 0; e < edges; ++e)
+    {
+        int const n[2] = { mesh.e0[e], mesh.e1[e] };
+        for (int i = 0; i < 2; ++i)
+            for (int j = 0; j < 2; ++j)
+                entries.push_back(Triplet(n[i], n[j], 0));
+    }
+
+    p.A = SparseMatrix(nodes, nodes);
+    p.A.setFromTriplets(entries.begin(), entries.end());
+    p.A.makeCompressed();
+
+    int const * outer = p.A.outerIndexPtr();
+    int const * inner = p.A.innerIndexPtr();
+    p.scatter.resize(entries.size());
+    for (size_t k = 0; k < entries.size(); ++k)
+    {
+        int const column = entries[k].col();
+        int const * begin = inner + outer[column];
+        int const * end = inner + outer[column + 1];
+        p.scatter[k] = (int) (std::lower_bound(begin, end, entries[k].row()) - inner);
+    }
+
+    p.pattern_nodes = nodes;
+    p.pattern_triangles = triangles;
+    p.pattern_edges = edges;
+    p.analyzed = false;
+}
+
+template <typename precision>
+void assemble_stiffness_matrix(Problem2D<precision> & p)
+{
+    assert(p.is_valid());
+
+    Mesh2D<precision> const & mesh = p.mesh;
+    if (p.pattern_nodes != mesh.nodes() || p.pattern_triangles != mesh.triangles()
+        || p.pattern_edges != mesh.boundary_edges())
+    {
+        build_sparsity_pattern(p);
+    }
+
+    precision * values = p.A.valuePtr();
+    std::fill(values, values + p.A.nonZeros(), precision(0));
+    int const * scatter = p.scatter.data();
+
+    // gradients of the hat functions are constant per triangle,
+    // a is taken at the centroid
+    int const triangles = mesh.triangles();
+    for (int t = 0; t < triangles; ++t, scatter += 9)
+    {
+        int const n0 = mesh.t0[t], n1 = mesh.t1[t], n2 = mesh.t2[t];
+        precision const x0 = mesh.x[n0], x1 = mesh.x[n1], x2 = mesh.x[n2];
+        precision const y0 = mesh.y[n0], y1 = mesh.y[n1], y2 = mesh.y[n2];
+        precision const det = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+        precision const area = std::abs(det) / 2;
+        precision const bx[3] = { (y1 - y2) / det, (y2 - y0) / det, (y0 - y1) / det };
+        precision const by[3] = { (x2 - x1) / det, (x0 - x2) / det, (x1 - x0) / det };
+        precision const scale = p.a((x0 + x1 + x2) / 3, (y0 + y1 + y2) / 3) * area;
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+                values[scatter[3 * i + j]] += scale * (bx[i] * bx[j] + by[i] * by[j]);
+    }
+
+    // robin terms, kappa times the edge mass matrix
+    int const edges = mesh.boundary_edges();
+    for (int e = 0; e < edges; ++e, scatter += 4)
+    {
+        precision const kappa = boundary_condition(p, e).kappa;
+        if (kappa == 0)
+            continue;
+        int const n0 = mesh.e0[e], n1 = mesh.e1[e];
+        precision const length = std::sqrt((mesh.x[n1] - mesh.x[n0]) * (mesh.x[n1] - mesh.x[n0])
+                                         + (mesh.y[n1] - mesh.y[n0]) * (mesh.y[n1] - mesh.y[n0]));
+        precision const diagonal = kappa * length / 3;
+        precision const off_diagonal = kappa * length / 6;
+        values[scatter[0]] += diagonal;
+        values[scatter[1]] += off_diagonal;
+        values[scatter[2]] += off_diagonal;
+        values[scatter[3]] += diagonal;
+    }
+}
+
+template <typename precision>
+void assemble_load_vector(Problem2D<precision> & p)
+{
+    assert(p.is_valid());
+
+    Mesh2D<precision> const & mesh = p.mesh;
+    p.b.setZero(mesh.nodes());
+
+    // corner quadrature, f at the nodes of every triangle
+    int const triangles = mesh.triangles();
+    for (int t = 0; t < triangles; ++t)
+    {
+        int const n[3] = { mesh.t0[t], mesh.t1[t], mesh.t2[t] };
+        precision const det = (mesh.x[n[1]] - mesh.x[n[0]]) * (mesh.y[n[2]] - mesh.y[n[0]])
+                            - (mesh.x[n[2]] - mesh.x[n[0]]) * (mesh.y[n[1]] - mesh.y[n[0]]);
+        precision const third = std::abs(det) / 6;
+        for (int i = 0; i < 3; ++i)
+            p.b[n[i]] += third * p.f(mesh.x[n[i]], mesh.y[n[i]]);
+    }
+
+    int const edges = mesh.boundary_edges();
+    for (int e = 0; e < edges; ++e)
+    {
+        BoundaryCondition2D<precision> const condition = boundary_condition(p, e);
+        precision const flux = condition.kappa * condition.g_d + condition.g_n;
+        if (flux == 0)
+            continue;
+        int const n0 = mesh.e0[e], n1 = mesh.e1[e];
+        precision const length = std::sqrt((mesh.x[n1] - mesh.x[n0]) * (mesh.x[n1] - mesh.x[n0])
+                                         + (mesh.y[n1] - mesh.y[n0]) * (mesh.y[n1] - mesh.y[n0]));
+        p.b[n0] += flux * length / 2;
+        p.b[n1] += flux * length / 2;
+    }
+}
+
+/*
+ * Assembles and solves, see LinearSolver. The symbolic analysis of the
+ * direct solver (fill reducing ordering and elimination tree) is only
+ * redone when the sparsity pattern changed. Returns false if A is
+ * singular, e.g. when no boundary edge has a positive kappa, or the
+ * iterative solver did not converge.
+ */
+template <typename precision>
+bool solve(Problem2D<precision> & p)
+{
+    assert(p.is_valid());
+
+    SolveTiming timing;
+    double time = stats_now();
+    assemble_stiffness_matrix(p);
+    assemble_load_vector(p);
+    timing.assembly = stats_now() - time;
+    timing.unknowns = p.mesh.nodes();
+
+    bool const iterative = p.linear_solver == ITERATIVE
+                        || (p.linear_solver == AUTOMATIC && p.mesh.nodes() > DIRECT_SOLVER_LIMIT);
+    if (iterative)
+    {
+        // diagonal preconditioner, so there is nothing to factor
+        time = stats_now();
+        p.iterative_solver.setTolerance(p.tolerance);
+        p.iterative_solver.compute(p.A);
+        timing.factor = stats_now() - time;
+
+        time = stats_now();
+        if (p.u.size() != p.mesh.nodes())
+            p.u.setZero(p.mesh.nodes());
+        p.u = p.iterative_solver.solveWithGuess(p.b, p.u);
+        p.iterations = (int) p.iterative_solver.iterations();
+        timing.solve = stats_now() - time;
+
+        Stats::instance().publish_solve(timing);
+        return p.iterative_solver.info() == Eigen::Success;
+    }
+
+    time = stats_now();
+    if (!p.analyzed)
+    {
+        p.solver.analyzePattern(p.A);
+        p.analyzed = true;
+    }
+    p.solver.factorize(p.A);
+    timing.factor = stats_now() - time;
+    if (p.solver.info() != Eigen::Success)
+        return false;
+
+    time = stats_now();
+    p.u = p.solver.solve(p.b);
+    timing.solve = stats_now() - time;
+
+    Stats::instance().publish_solve(timing);
+
+    return p.solver.info() == Eigen::Success;
+}
+
+}  // namespace Fem
+
+#endif  // __FEM2D_H
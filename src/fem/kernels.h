@@ -0,0 +1,266 @@
+#ifndef __KERNELS_H
+#define __KERNELS_H
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include <Eigen/Dense>
+
+#include "fem.h"
+
+/*
+ * Vector code is written with the vector extensions of GCC and Clang,
+ * one function per instruction set, each compiled for its own target so
+ * the binary runs anywhere and picks the widest set the cpu has. Other
+ * compilers get the scalar kernels only.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ARC_SIMD_X86
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define ARC_SIMD_NEON
+#endif
+
+namespace Fem
+{
+
+enum SimdIsa { SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512, SIMD_NEON, SIMD_ISAS };
+
+inline char const * simd_isa_name(SimdIsa isa)
+{
+    static char const * const names[SIMD_ISAS] = { "scalar", "avx2", "avx512", "neon" };
+    assert(isa >= 0 && isa < SIMD_ISAS);
+    return names[isa];
+}
+
+// whether this build and cpu can run kernels of isa
+inline bool simd_isa_supported(SimdIsa isa)
+{
+    switch (isa)
+    {
+    case SIMD_SCALAR:
+        return true;
+#ifdef ARC_SIMD_X86
+    case SIMD_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case SIMD_AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+#ifdef ARC_SIMD_NEON
+    case SIMD_NEON:
+        return true;  // part of every aarch64 cpu
+#endif
+    default:
+        return false;
+    }
+}
+
+inline SimdIsa best_simd_isa()
+{
+    static SimdIsa const best = simd_isa_supported(SIMD_AVX512) ? SIMD_AVX512
+                              : simd_isa_supported(SIMD_AVX2)   ? SIMD_AVX2
+                              : simd_isa_supported(SIMD_NEON)   ? SIMD_NEON
+                                                                : SIMD_SCALAR;
+    return best;
+}
+
+/*
+ * The local systems of the linear elements of the bar. The stiffness
+ * matrix of element e is k[e] [1 -1; -1 1], with a taken at the
+ * midpoint; its load vector is [b0[e], b1[e]], f integrated against the
+ * two hat functions with the 2 point Gauss rule.
+ */
+template <typename precision>
+class ElementSystems
+{
+public:
+    typedef Eigen::Array<precision, Eigen::Dynamic, 1> Array;
+
+    int elements() const
+    {
+        return (int) k.size();
+    }
+
+    Array k;
+    Array b0, b1;
+};
+
+// weight of the Gauss point nearer to a node in its hat function
+template <typename precision>
+inline precision gauss_near_weight()
+{
+    return precision(0.5 + 0.5 / std::sqrt(3.0));
+}
+
+/*
+ * The reference kernels, one element at a time, for checking the vector
+ * ones and for the elements left over after the last full vector.
+ */
+template <typename precision>
+void element_kernels_scalar(precision const * a, precision const * h, precision const * f0,
+                            precision const * f1, precision * k, precision * b0, precision * b1,
+                            int count)
+{
+    precision const near = gauss_near_weight<precision>();
+    precision const far = 1 - near;
+    for (int e = 0; e < count; ++e)
+    {
+        precision const half = h[e] / 2;
+        k[e] = a[e] / h[e];
+        b0[e] = half * (near * f0[e] + far * f1[e]);
+        b1[e] = half * (far * f0[e] + near * f1[e]);
+    }
+}
+
+#if defined(ARC_SIMD_X86) || defined(ARC_SIMD_NEON)
+
+/*
+ * The same arithmetic on whole vectors of elements, in the order of the
+ * scalar kernel. Always inlined, so it is compiled for the instruction
+ * set of the kernel calling it.
+ */
+template <typename Packet, typename precision>
+inline __attribute__((always_inline)) void element_packets(precision const * a, precision const * h,
+                                                            precision const * f0, precision const * f1,
+                                                            precision * k, precision * b0, precision * b1,
+                                                            int count)
+{
+    int const width = sizeof(Packet) / sizeof(precision);
+    precision const near = gauss_near_weight<precision>();
+    precision const far = 1 - near;
+    int e = 0;
+    for (; e + width <= count; e += width)
+    {
+        Packet va, vh, vf0, vf1;
+        memcpy(&va, a + e, sizeof(Packet));
+        memcpy(&vh, h + e, sizeof(Packet));
+        memcpy(&vf0, f0 + e, sizeof(Packet));
+        memcpy(&vf1, f1 + e, sizeof(Packet));
+        Packet const half = vh / 2;
+        Packet const vk = va / vh;
+        Packet const vb0 = half * (near * vf0 + far * vf1);
+        Packet const vb1 = half * (far * vf0 + near * vf1);
+        memcpy(k + e, &vk, sizeof(Packet));
+        memcpy(b0 + e, &vb0, sizeof(Packet));
+        memcpy(b1 + e, &vb1, sizeof(Packet));
+    }
+    element_kernels_scalar(a + e, h + e, f0 + e, f1 + e, k + e, b0 + e, b1 + e, count - e);
+}
+
+#endif
+
+#ifdef ARC_SIMD_X86
+
+// 4 doubles or 8 floats at a time
+template <typename precision>
+__attribute__((target("avx2"))) void element_kernels_avx2(precision const * a, precision const * h,
+                                                          precision const * f0, precision const * f1,
+                                                          precision * k, precision * b0, precision * b1,
+                                                          int count)
+{
+    typedef precision Packet __attribute__((vector_size(32)));
+    element_packets<Packet>(a, h, f0, f1, k, b0, b1, count);
+}
+
+// 8 doubles or 16 floats at a time
+template <typename precision>
+__attribute__((target("avx512f"))) void element_kernels_avx512(precision const * a, precision const * h,
+                                                               precision const * f0, precision const * f1,
+                                                               precision * k, precision * b0, precision * b1,
+                                                               int count)
+{
+    typedef precision Packet __attribute__((vector_size(64)));
+    element_packets<Packet>(a, h, f0, f1, k, b0, b1, count);
+}
+
+#endif
+
+#ifdef ARC_SIMD_NEON
+
+// 2 doubles or 4 floats at a time
+template <typename precision>
+void element_kernels_neon(precision const * a, precision const * h, precision const * f0,
+                          precision const * f1, precision * k, precision * b0, precision * b1, int count)
+{
+    typedef precision Packet __attribute__((vector_size(16)));
+    element_packets<Packet>(a, h, f0, f1, k, b0, b1, count);
+}
+
+#endif
+
+template <typename precision>
+bool element_kernels_vector(SimdIsa isa, precision const * a, precision const * h, precision const * f0,
+                            precision const * f1, precision * k, precision * b0, precision * b1, int count)
+{
+    switch (isa)
+    {
+#ifdef ARC_SIMD_X86
+    case SIMD_AVX2:
+        element_kernels_avx2(a, h, f0, f1, k, b0, b1, count);
+        return true;
+    case SIMD_AVX512:
+        element_kernels_avx512(a, h, f0, f1, k, b0, b1, count);
+        return true;
+#endif
+#ifdef ARC_SIMD_NEON
+    case SIMD_NEON:
+        element_kernels_neon(a, h, f0, f1, k, b0, b1, count);
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+/*
+ * Runs the vector kernel of isa on float or double arrays; false for
+ * other precisions or an isa this build has no kernel for.
+ */
+template <typename precision>
+bool element_kernels_simd(SimdIsa, precision const *, precision const *, precision const *, precision const *,
+                          precision *, precision *, precision *, int)
+{
+    return false;
+}
+
+inline bool element_kernels_simd(SimdIsa isa, float const * a, float const * h, float const * f0,
+                                 float const * f1, float * k, float * b0, float * b1, int count)
+{
+    return element_kernels_vector(isa, a, h, f0, f1, k, b0, b1, count);
+}
+
+inline bool element_kernels_simd(SimdIsa isa, double const * a, double const * h, double const * f0,
+                                 double const * f1, double * k, double * b0, double * b1, int count)
+{
+    return element_kernels_vector(isa, a, h, f0, f1, k, b0, b1, count);
+}
+
+/*
+ * The local systems of all elements of table, computed a vector of
+ * elements at a time with the kernel of isa, the widest the cpu has by
+ * default. Results agree with the scalar kernel up to rounding (vector
+ * code may fuse multiplies and adds).
+ */
+template <typename precision>
+void element_kernels(ElementTable<precision> const & table, ElementSystems<precision> & systems,
+                     SimdIsa isa = best_simd_isa())
+{
+    assert(simd_isa_supported(isa));
+    int const elements = table.elements();
+    systems.k.resize(elements);
+    systems.b0.resize(elements);
+    systems.b1.resize(elements);
+    precision const * a = table.a_mid.data();
+    precision const * h = table.h.data();
+    precision const * f0 = table.f0.data();
+    precision const * f1 = table.f1.data();
+    precision * k = systems.k.data();
+    precision * b0 = systems.b0.data();
+    precision * b1 = systems.b1.data();
+    if (isa == SIMD_SCALAR || !element_kernels_simd(isa, a, h, f0, f1, k, b0, b1, elements))
+        element_kernels_scalar(a, h, f0, f1, k, b0, b1, elements);
+}
+
+}  // namespace Fem
+
+#endif  // __KERNELS_H
@@ -0,0 +1,318 @@
+#ifndef __MODAL_H
+#define __MODAL_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "fem.h"
+#include "fem2d.h"
+#include "stats.h"
+
+namespace Fem
+{
+
+/*
+ * Eigenpairs of the generalized problem A u = lambda M u, with A the
+ * stiffness matrix (including the Robin terms) and M the consistent
+ * mass matrix: vibration modes of a bar or membrane, or the decay
+ * modes of heat conduction, whose largest decay rate among the ones
+ * of interest bounds explicit time steps.
+ *
+ * The count eigenvalues nearest to shift are found, which for the
+ * default shift of 0 and a positive definite A are the lowest ones.
+ * Shapes are M-orthonormal, so they come out scaled by the size of the
+ * domain; scale them for display.
+ */
+template <typename precision>
+class Modes
+{
+public:
+    typedef Eigen::Matrix<precision, Eigen::Dynamic, 1> Vector;
+    typedef Eigen::Matrix<precision, Eigen::Dynamic, Eigen::Dynamic> DenseMatrix;
+
+    Modes()
+    : shift(0)
+    , tolerance(std::sqrt(std::numeric_limits<precision>::epsilon()))
+    , max_basis(0)
+    , iterations(0)
+    {}
+    int count() const { return (int) values.size(); }
+
+    precision shift;      // eigenvalues nearest to it are found
+    precision tolerance;  // relative residual of the shift-inverted pairs
+    int max_basis;        // lanczos vectors kept at most, 0 picks from count
+    Vector values;        // ascending
+    DenseMatrix shapes;   // one column per value, M-orthonormal
+    int iterations;       // lanczos steps taken by the last solve
+};
+
+// orders indices by decreasing magnitude of the values they point to
+template <typename Vector>
+struct ByMagnitude
+{
+    explicit ByMagnitude(Vector const & values_) : values(values_) {}
+    bool operator()(int a, int b) const { return std::abs(values[a]) > std::abs(values[b]); }
+    Vector const & values;
+};
+
+/*
+ * Shift-invert Lanczos: the largest eigenvalues theta of
+ * (A - shift M)^-1 M, self-adjoint in the M inner product, are
+ * 1 / (lambda - shift) for the lambda nearest to shift, and come out
+ * first and fast. solver holds the factorization of A - shift M, so
+ * every step costs one pair of triangular solves.
+ *
+ * All Lanczos vectors are kept and reorthogonalized against (twice,
+ * which is enough in floating point), n * max_basis values, which for
+ * count much smaller than n stays far below the factorization. Returns
+ * true if all pairs converged; modes then holds count of them.
+ */
+template <typename precision, typename Solver>
+bool lanczos(Solver const & solver, Eigen::SparseMatrix<precision> const & M, int count,
+             Modes<precision> & modes)
+{
+    typedef typename Modes<precision>::Vector Vector;
+    typedef typename Modes<precision>::DenseMatrix DenseMatrix;
+
+    int const n = (int) M.rows();
+    count = std::min(count, n);
+    int const max_basis = std::min(n, std::max(count + 1, modes.max_basis > 0 ? modes.max_basis
+                                                                             : std::max(2 * count + 20, 4 * count)));
+    modes.iterations = 0;
+    modes.values.resize(0);
+    modes.shapes.resize(n, 0);
+    if (count <= 0)
+        return true;
+
+    // pseudo random start, so that no mode is left out
+    Vector w(n);
+    unsigned int seed = 1;
+    for (int i = 0; i < n; ++i)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        w[i] = precision(seed >> 8) / precision(1 << 24) - precision(0.5);
+    }
+    Vector Mw = M * w;
+    precision norm = std::sqrt(w.dot(Mw));
+
+    DenseMatrix V(n, max_basis);
+    Vector alpha(max_basis), beta(max_basis);
+    Vector Mv;
+    Eigen::SelfAdjointEigenSolver<DenseMatrix> tridiagonal;
+    std::vector<int> wanted;
+    int converged = 0;
+    int steps = 0;
+
+    while (steps < max_basis)
+    {
+        int const j = steps++;
+        V.col(j) = w / norm;
+        Mv = Mw / norm;
+
+        w = solver.solve(Mv);
+        if (solver.info() != Eigen::Success)
+            return false;
+        alpha[j] = Mv.dot(w);
+
+        // against all vectors so far, which includes the three term recurrence
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            Mw.noalias() = M * w;
+            w.noalias() -= V.leftCols(steps) * (V.leftCols(steps).transpose() * Mw);
+        }
+        Mw.noalias() = M * w;
+        beta[j] = std::sqrt(std::max(w.dot(Mw), precision(0)));
+        norm = beta[j];
+
+        if (steps < count)
+        {
+            if (norm > 0)
+                continue;
+            break;  // invariant subspace smaller than count
+        }
+
+        // ritz values of the tridiagonal projection, the residual of
+        // pair i being beta times the last component of its vector
+        tridiagonal.computeFromTridiagonal(alpha.head(steps), beta.head(steps - 1), Eigen::ComputeEigenvectors);
+        Vector const & theta = tridiagonal.eigenvalues();
+        wanted.resize(steps);
+        for (int i = 0; i < steps; ++i)
+            wanted[i] = i;
+        std::sort(wanted.begin(), wanted.end(), ByMagnitude<Vector>(theta));
+        wanted.resize(count);
+
+        converged = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            precision const residual = norm * std::abs(tridiagonal.eigenvectors()(steps - 1, wanted[i]));
+            if (residual <= modes.tolerance * std::abs(theta[wanted[i]]))
+                ++converged;
+        }
+        if (converged == count || !(norm > 0))
+            break;
+    }
+    modes.iterations = steps;
+    if (steps < count)
+        return false;
+
+    // back to lambda, ascending
+    std::vector< std::pair<precision, int> > order(count);
+    for (int i = 0; i < count; ++i)
+        order[i] = std::make_pair(modes.shift + 1 / tridiagonal.eigenvalues()[wanted[i]], wanted[i]);
+    std::sort(order.begin(), order.end());
+
+    modes.values.resize(count);
+    DenseMatrix S(steps, count);
+    for (int i = 0; i < count; ++i)
+    {
+        modes.values[i] = order[i].first;
+        S.col(i) = tridiagonal.eigenvectors().col(order[i].second);
+    }
+    modes.shapes.noalias() = V.leftCols(steps) * S;
+
+    return converged == count;
+}
+
+/*
+ * Consistent mass matrix of the bar, tridiagonal, from the node
+ * coordinates of p.
+ */
+template <typename precision, int nodes>
+void assemble_mass_matrix(Problem<precision, nodes> const & p, Eigen::SparseMatrix<precision> & M)
+{
+    std::vector< Eigen::Triplet<precision> > entries;
+    entries.reserve(4 * (nodes - 1));
+    for (int i = 0; i + 1 < nodes; ++i)
+    {
+        precision const h = p.x(i + 1) - p.x(i);
+        entries.push_back(Eigen::Triplet<precision>(i, i, h / 3));
+        entries.push_back(Eigen::Triplet<precision>(i, i + 1, h / 6));
+        entries.push_back(Eigen::Triplet<precision>(i + 1, i, h / 6));
+        entries.push_back(Eigen::Triplet<precision>(i + 1, i + 1, h / 3));
+    }
+    M = Eigen::SparseMatrix<precision>(nodes, nodes);
+    M.setFromTriplets(entries.begin(), entries.end());
+}
+
+/*
+ * Consistent mass matrix of the triangles, on the sparsity pattern of
+ * p.A, which must be current (assemble_stiffness_matrix builds it).
+ * Sharing the pattern lets A - shift M reuse the cached symbolic
+ * factorization of A.
+ */
+template <typename precision>
+void assemble_mass_matrix(Problem2D<precision> const & p, Eigen::SparseMatrix<precision> & M)
+{
+    Mesh2D<precision> const & mesh = p.mesh;
+    assert(p.pattern_nodes == mesh.nodes() && p.pattern_triangles == mesh.triangles());
+
+    M = p.A;
+    precision * values = M.valuePtr();
+    std::fill(values, values + M.nonZeros(), precision(0));
+    int const * scatter = p.scatter.data();
+
+    int const triangles = mesh.triangles();
+    for (int t = 0; t < triangles; ++t, scatter += 9)
+    {
+        int const n0 = mesh.t0[t], n1 = mesh.t1[t], n2 = mesh.t2[t];
+        precision const det = (mesh.x[n1] - mesh.x[n0]) * (mesh.y[n2] - mesh.y[n0])
+                            - (mesh.x[n2] - mesh.x[n0]) * (mesh.y[n1] - mesh.y[n0]);
+        precision const off_diagonal = std::abs(det) / 24;  // area / 12
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+                values[scatter[3 * i + j]] += i == j ? 2 * off_diagonal : off_diagonal;
+    }
+}
+
+/*
+ * Lowest (nearest to modes.shift) count modes of the bar, with the
+ * stiffness matrix from assemble_stiffness_matrix in fem.h.
+ */
+template <typename precision, int nodes>
+bool solve_modes(Problem<precision, nodes> & p, int count, Modes<precision> & modes)
+{
+    typedef Eigen::SparseMatrix<precision> SparseMatrix;
+    assert(p.is_valid());
+
+    SolveTiming timing;
+    double time = stats_now();
+    assemble_stiffness_matrix(p);
+    SparseMatrix M;
+    assemble_mass_matrix(p, M);
+    SparseMatrix const K = p.A.sparseView() - modes.shift * M;
+    timing.assembly = stats_now() - time;
+    timing.unknowns = nodes;
+
+    time = stats_now();
+    Eigen::SimplicialLDLT<SparseMatrix> solver(K);
+    timing.factor = stats_now() - time;
+    if (solver.info() != Eigen::Success)
+        return false;
+
+    time = stats_now();
+    bool const ok = lanczos(solver, M, count, modes);
+    timing.solve = stats_now() - time;
+
+    Stats::instance().publish_solve(timing);
+    return ok;
+}
+
+/*
+ * Lowest (nearest to modes.shift) count modes of the 2D problem. The
+ * sparsity pattern and symbolic factorization cached in p are reused,
+ * and the numeric factorization left in p.solver is simply redone by
+ * the next solve. Always factors directly, whatever p.linear_solver
+ * says, as shift-invert needs exact inner solves; renumbering does not
+ * matter for it, the factorization orders the unknowns itself.
+ */
+template <typename precision>
+bool solve_modes(Problem2D<precision> & p, int count, Modes<precision> & modes)
+{
+    typedef typename Problem2D<precision>::SparseMatrix SparseMatrix;
+    assert(p.is_valid());
+
+    SolveTiming timing;
+    double time = stats_now();
+    assemble_stiffness_matrix(p);
+    SparseMatrix M;
+    assemble_mass_matrix(p, M);
+    SparseMatrix K;
+    if (modes.shift != 0)
+    {
+        // same pattern, so the values line up
+        K = p.A;
+        Eigen::Map<typename Problem2D<precision>::Vector>(K.valuePtr(), K.nonZeros())
+            -= modes.shift * Eigen::Map<typename Problem2D<precision>::Vector>(M.valuePtr(), M.nonZeros());
+    }
+    SparseMatrix const & shifted = modes.shift != 0 ? K : p.A;
+    timing.assembly = stats_now() - time;
+    timing.unknowns = p.mesh.nodes();
+
+    time = stats_now();
+    if (!p.analyzed)
+    {
+        p.solver.analyzePattern(p.A);
+        p.analyzed = true;
+    }
+    p.solver.factorize(shifted);
+    timing.factor = stats_now() - time;
+    if (p.solver.info() != Eigen::Success)
+        return false;
+
+    time = stats_now();
+    bool const ok = lanczos(p.solver, M, count, modes);
+    timing.solve = stats_now() - time;
+
+    Stats::instance().publish_solve(timing);
+    return ok;
+}
+
+}  // namespace Fem
+
+#endif  // __MODAL_H
@@ -0,0 +1,321 @@
+#ifndef __POSTPROCESS_H
+#define __POSTPROCESS_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include "fem.h"
+#include "fem2d.h"
+#include "tasks.h"
+
+namespace Fem
+{
+
+/*
+ * Exact (or reference, e.g. much finer) solution to measure errors
+ * against, with its gradient for the H1 error.
+ */
+template <typename precision>
+class ExactSolution
+{
+public:
+    virtual ~ExactSolution() {}
+    virtual precision value(precision x) = 0;
+    virtual precision derivative(precision x) = 0;
+};
+
+template <typename precision>
+class ExactSolution2D
+{
+public:
+    virtual ~ExactSolution2D() {}
+    virtual precision value(precision x, precision y) = 0;
+    virtual void gradient(precision x, precision y, precision & dx, precision & dy) = 0;
+};
+
+/*
+ * Quantities derived from a solution, per element of the mesh: the
+ * gradient of u, the flux -a grad u (the conjugate quantity of the
+ * table in fem.h: heat flux, stress, electric displacement, ...) and
+ * the energy 1/2 int a |grad u|^2, plus the energy norm of u and, if an
+ * exact solution is given, the L2 and H1 seminorm errors. The y parts
+ * are empty in 1D; errors are -1 when no exact solution was given.
+ *
+ * a is taken where assembly takes it, at the element midpoint or
+ * centroid, so the energy norm squared equals u' A u without the Robin
+ * terms.
+ */
+template <typename precision>
+class DerivedQuantities
+{
+public:
+    typedef Eigen::Array<precision, Eigen::Dynamic, 1> Array;
+
+    DerivedQuantities()
+    : energy_norm(0)
+    , l2_error(-1)
+    , h1_error(-1)
+    {}
+    int elements() const { return (int) energy.size(); }
+
+    Array gradient_x, gradient_y;
+    Array flux_x, flux_y;
+    Array energy;
+    precision energy_norm;  // sqrt(int a |grad u|^2)
+    precision l2_error;     // sqrt(int (u - exact)^2)
+    precision h1_error;     // sqrt(int |grad u - grad exact|^2)
+};
+
+/*
+ * The kernels below make one pass over the elements, in blocks of
+ * POSTPROCESS_BLOCK: a scalar loop gathers the corners and evaluates
+ * the (virtual) coefficient and exact solution into columns of a small
+ * scratch table that stays in cache, then every derived quantity of the
+ * block is computed from it by Eigen array expressions, which
+ * vectorize, and the norms are summed per block. Blocks run on the task
+ * pool, so a and the exact solution are called from several threads;
+ * the sums of the blocks are added in order, giving the same norms on
+ * any number of threads.
+ */
+static int const POSTPROCESS_BLOCK = 256;
+
+// sums of every block
+enum PostProcessSum { ENERGY_SUM, L2_SUM, H1_SUM, POSTPROCESS_SUMS };
+
+template <typename precision>
+void finish_post_process(DerivedQuantities<precision> & d, bool exact,
+                         Eigen::Array<precision, Eigen::Dynamic, POSTPROCESS_SUMS> const & sums)
+{
+    d.energy_norm = std::sqrt(sums.col(ENERGY_SUM).sum());
+    d.l2_error = exact ? std::sqrt(sums.col(L2_SUM).sum()) : -1;
+    d.h1_error = exact ? std::sqrt(sums.col(H1_SUM).sum()) : -1;
+}
+
+/*
+ * The blocks of elements of the bar from begin to end.
+ */
+template <typename precision, int nodes>
+class BarPostProcess : public RangeTask
+{
+public:
+    typedef Eigen::Array<precision, Eigen::Dynamic, 1> Array;
+    typedef Eigen::Map<Array const> Segment;
+
+    BarPostProcess(Problem<precision, nodes> & p_, DerivedQuantities<precision> & d_,
+                   ExactSolution<precision> * exact_, int blocks)
+    : p(p_)
+    , table(p_.elements)
+    , d(d_)
+    , exact(exact_)
+    , sums(blocks, (int) POSTPROCESS_SUMS)
+    {}
+
+    virtual void run(int begin, int end)
+    {
+        int const elements = nodes - 1;
+
+        // scratch columns: exact values and derivatives at the two Gauss
+        // points
+        enum { V0, V1, D0, D1, COLUMNS };
+        Eigen::Array<precision, Eigen::Dynamic, Eigen::Dynamic> scratch(exact ? POSTPROCESS_BLOCK : 0, COLUMNS);
+        precision const q0 = precision(0.5 - 0.5 / std::sqrt(3.0));
+        precision const q1 = 1 - q0;
+
+        for (int block = begin; block < end; ++block)
+        {
+            int const first = block * POSTPROCESS_BLOCK;
+            int const n = std::min(POSTPROCESS_BLOCK, elements - first);
+            Segment const u0(p.u.data() + first, n), u1(p.u.data() + first + 1, n);
+            Segment const h(table.h.data() + first, n);
+            Segment const a(table.a_mid.data() + first, n);
+
+            for (int e = 0; exact && e < n; ++e)
+            {
+                precision const g0 = table.q0[first + e], g1 = table.q1[first + e];
+                scratch(e, V0) = exact->value(g0);
+                scratch(e, V1) = exact->value(g1);
+                scratch(e, D0) = exact->derivative(g0);
+                scratch(e, D1) = exact->derivative(g1);
+            }
+
+            Array const du = u1 - u0;
+            Array const g = du / h;
+            Array const density = a * g.square() * h;
+            d.gradient_x.segment(first, n) = g;
+            d.flux_x.segment(first, n) = -a * g;
+            d.energy.segment(first, n) = density / 2;
+            sums(block, ENERGY_SUM) = density.sum();
+
+            if (exact)
+            {
+                Segment const v0(&scratch(0, V0), n), v1(&scratch(0, V1), n);
+                Segment const d0(&scratch(0, D0), n), d1(&scratch(0, D1), n);
+                sums(block, L2_SUM) = (((u0 + q0 * du - v0).square() + (u0 + q1 * du - v1).square()) * h / 2).sum();
+                sums(block, H1_SUM) = (((g - d0).square() + (g - d1).square()) * h / 2).sum();
+            }
+        }
+    }
+
+    Problem<precision, nodes> & p;
+    ElementTable<precision> const & table;
+    DerivedQuantities<precision> & d;
+    ExactSolution<precision> * exact;
+    Eigen::Array<precision, Eigen::Dynamic, POSTPROCESS_SUMS> sums;
+};
+
+/*
+ * Derived quantities of the bar. Errors use the 2 point Gauss rule on
+ * every element, exact for the piecewise polynomials of u.
+ */
+template <typename precision, int nodes>
+void post_process(Problem<precision, nodes> & p, DerivedQuantities<precision> & d,
+                  ExactSolution<precision> * exact = NULL)
+{
+    assert(p.is_valid());
+
+    int const elements = nodes - 1;
+    d.gradient_x.resize(elements);
+    d.gradient_y.resize(0);
+    d.flux_x.resize(elements);
+    d.flux_y.resize(0);
+    d.energy.resize(elements);
+
+    // before the blocks start, which all read the table
+    update_element_table(p);
+    int const blocks = (elements + POSTPROCESS_BLOCK - 1) / POSTPROCESS_BLOCK;
+    BarPostProcess<precision, nodes> kernel(p, d, exact, blocks);
+    kernel.sums.setZero();
+    parallel_for(0, blocks, 1, kernel);
+    finish_post_process(d, exact != NULL, kernel.sums);
+}
+
+/*
+ * The blocks of triangles of the 2D problem from begin to end.
+ */
+template <typename precision>
+class TrianglePostProcess : public RangeTask
+{
+public:
+    typedef Eigen::Array<precision, Eigen::Dynamic, 1> Array;
+    typedef Eigen::Map<Array const> Segment;
+
+    TrianglePostProcess(Problem2D<precision> & p_, DerivedQuantities<precision> & d_,
+                        ExactSolution2D<precision> * exact_, int blocks)
+    : p(p_)
+    , d(d_)
+    , exact(exact_)
+    , sums(blocks, (int) POSTPROCESS_SUMS)
+    {}
+
+    virtual void run(int begin, int end)
+    {
+        Mesh2D<precision> const & mesh = p.mesh;
+        int const triangles = mesh.triangles();
+
+        // scratch columns: corners, a at the centroid, exact values and
+        // gradients at the three quadrature points
+        enum { X0, X1, X2, Y0, Y1, Y2, U0, U1, U2, A, V0, V1, V2, DX0, DX1, DX2, DY0, DY1, DY2, COLUMNS };
+        Eigen::Array<precision, Eigen::Dynamic, Eigen::Dynamic> scratch(POSTPROCESS_BLOCK, exact ? COLUMNS : A + 1);
+
+        for (int block = begin; block < end; ++block)
+        {
+            int const first = block * POSTPROCESS_BLOCK;
+            int const n = std::min(POSTPROCESS_BLOCK, triangles - first);
+            for (int e = 0; e < n; ++e)
+            {
+                int const t = first + e;
+                int const c[3] = { mesh.t0[t], mesh.t1[t], mesh.t2[t] };
+                precision x[3], y[3];
+                for (int i = 0; i < 3; ++i)
+                {
+                    x[i] = mesh.x[c[i]];
+                    y[i] = mesh.y[c[i]];
+                    scratch(e, X0 + i) = x[i];
+                    scratch(e, Y0 + i) = y[i];
+                    scratch(e, U0 + i) = p.u[c[i]];
+                }
+                scratch(e, A) = p.a((x[0] + x[1] + x[2]) / 3, (y[0] + y[1] + y[2]) / 3);
+                if (exact)
+                {
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        // 2/3 of corner i, 1/6 of each other
+                        precision const qx = (x[0] + x[1] + x[2]) / 6 + x[i] / 2;
+                        precision const qy = (y[0] + y[1] + y[2]) / 6 + y[i] / 2;
+                        scratch(e, V0 + i) = exact->value(qx, qy);
+                        exact->gradient(qx, qy, scratch(e, DX0 + i), scratch(e, DY0 + i));
+                    }
+                }
+            }
+
+            // columns of the block, contiguous as the table is column major
+            Segment const x0(&scratch(0, X0), n), x1(&scratch(0, X1), n), x2(&scratch(0, X2), n);
+            Segment const y0(&scratch(0, Y0), n), y1(&scratch(0, Y1), n), y2(&scratch(0, Y2), n);
+            Segment const u0(&scratch(0, U0), n), u1(&scratch(0, U1), n), u2(&scratch(0, U2), n);
+            Segment const a(&scratch(0, A), n);
+
+            Array const det = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+            Array const area = det.abs() / 2;
+            Array const gx = ((y1 - y2) * u0 + (y2 - y0) * u1 + (y0 - y1) * u2) / det;
+            Array const gy = ((x2 - x1) * u0 + (x0 - x2) * u1 + (x1 - x0) * u2) / det;
+            Array const density = a * (gx.square() + gy.square()) * area;
+            d.gradient_x.segment(first, n) = gx;
+            d.gradient_y.segment(first, n) = gy;
+            d.flux_x.segment(first, n) = -a * gx;
+            d.flux_y.segment(first, n) = -a * gy;
+            d.energy.segment(first, n) = density / 2;
+            sums(block, ENERGY_SUM) = density.sum();
+
+            if (exact)
+            {
+                Segment const v0(&scratch(0, V0), n), v1(&scratch(0, V1), n), v2(&scratch(0, V2), n);
+                Segment const dx0(&scratch(0, DX0), n), dx1(&scratch(0, DX1), n), dx2(&scratch(0, DX2), n);
+                Segment const dy0(&scratch(0, DY0), n), dy1(&scratch(0, DY1), n), dy2(&scratch(0, DY2), n);
+                Array const mean = (u0 + u1 + u2) / 6;
+                sums(block, L2_SUM) = (((mean + u0 / 2 - v0).square() + (mean + u1 / 2 - v1).square()
+                                      + (mean + u2 / 2 - v2).square()) * area / 3).sum();
+                sums(block, H1_SUM) = (((gx - dx0).square() + (gy - dy0).square() + (gx - dx1).square() + (gy - dy1).square()
+                                      + (gx - dx2).square() + (gy - dy2).square()) * area / 3).sum();
+            }
+        }
+    }
+
+    Problem2D<precision> & p;
+    DerivedQuantities<precision> & d;
+    ExactSolution2D<precision> * exact;
+    Eigen::Array<precision, Eigen::Dynamic, POSTPROCESS_SUMS> sums;
+};
+
+/*
+ * Derived quantities of the 2D problem, per triangle. Errors use the 3
+ * point rule at barycentric (2/3, 1/6, 1/6) and permutations, exact for
+ * quadratics.
+ */
+template <typename precision>
+void post_process(Problem2D<precision> & p, DerivedQuantities<precision> & d,
+                  ExactSolution2D<precision> * exact = NULL)
+{
+    assert(p.is_valid());
+
+    Mesh2D<precision> const & mesh = p.mesh;
+    assert(p.u.size() == mesh.nodes());
+    int const triangles = mesh.triangles();
+    d.gradient_x.resize(triangles);
+    d.gradient_y.resize(triangles);
+    d.flux_x.resize(triangles);
+    d.flux_y.resize(triangles);
+    d.energy.resize(triangles);
+
+    int const blocks = (triangles + POSTPROCESS_BLOCK - 1) / POSTPROCESS_BLOCK;
+    TrianglePostProcess<precision> kernel(p, d, exact, blocks);
+    kernel.sums.setZero();
+    parallel_for(0, blocks, 1, kernel);
+    finish_post_process(d, exact != NULL, kernel.sums);
+}
+
+}  // namespace Fem
+
+#endif  // __POSTPROCESS_H
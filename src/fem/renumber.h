@@ -0,0 +1,397 @@
+#ifndef __RENUMBER_H
+#define __RENUMBER_H
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <vector>
+
+#include "fem2d.h"
+
+namespace Fem
+{
+
+/*
+ * Node renumbering of a mesh, new_index[old] and old_index[new].
+ *
+ * Node order decides the bandwidth of A, and with it the fill of direct
+ * factorizations, as well as how scattered the memory accesses of
+ * assembly and matrix vector products are. Meshes that are generated or
+ * imported tend to come in an arbitrary order, so they are renumbered
+ * before assembly and the solution mapped back to the original
+ * numbering afterwards.
+ */
+class Renumbering
+{
+public:
+    int size() const { return (int) new_index.size(); }
+
+    void set_identity(int nodes)
+    {
+        new_index.resize(nodes);
+        old_index.resize(nodes);
+        for (int i = 0; i < nodes; ++i)
+            new_index[i] = old_index[i] = i;
+    }
+
+    /*
+     * Builds new_index from old_index, which the orderings fill in.
+     */
+    void invert_old_index()
+    {
+        new_index.resize(old_index.size());
+        for (int i = 0; i < (int) old_index.size(); ++i)
+            new_index[old_index[i]] = i;
+    }
+
+    /*
+     * Values per renumbered node back in the original order.
+     */
+    template <typename Vector>
+    void unpermute(Vector const & renumbered, Vector & original) const
+    {
+        assert((int) renumbered.size() == size());
+        original.resize(renumbered.size());
+        for (int i = 0; i < size(); ++i)
+            original[i] = renumbered[new_index[i]];
+    }
+
+    /*
+     * Values per original node in the renumbered order.
+     */
+    template <typename Vector>
+    void permute(Vector const & original, Vector & renumbered) const
+    {
+        assert((int) original.size() == size());
+        renumbered.resize(original.size());
+        for (int i = 0; i < size(); ++i)
+            renumbered[new_index[i]] = original[i];
+    }
+
+    std::vector<int> new_index;
+    std::vector<int> old_index;
+};
+
+/*
+ * Node adjacency through the triangles, in compressed rows:
+ * the neighbours of node n are index[offset[n]] to index[offset[n + 1] - 1].
+ */
+template <typename precision>
+void node_adjacency(Mesh2D<precision> const & mesh, std::vector<int> & offset, std::vector<int> & index)
+{
+    int const nodes = mesh.nodes();
+    int const triangles = mesh.triangles();
+
+    // every triangle adds two neighbours per corner, duplicates are removed after
+    offset.assign(nodes + 1, 0);
+    for (int t = 0; t < triangles; ++t)
+    {
+        offset[mesh.t0[t] + 1] += 2;
+        offset[mesh.t1[t] + 1] += 2;
+        offset[mesh.t2[t] + 1] += 2;
+    }
+    for (int n = 0; n < nodes; ++n)
+        offset[n + 1] += offset[n];
+
+    index.resize(offset[nodes]);
+    std::vector<int> fill(offset.begin(), offset.end() - 1);
+    for (int t = 0; t < triangles; ++t)
+    {
+        int const c[3] = { mesh.t0[t], mesh.t1[t], mesh.t2[t] };
+        for (int i = 0; i < 3; ++i)
+        {
+            index[fill[c[i]]++] = c[(i + 1) % 3];
+            index[fill[c[i]]++] = c[(i + 2) % 3];
+        }
+    }
+
+    // sort and compact every row in place
+    int write = 0;
+    for (int n = 0; n < nodes; ++n)
+    {
+        int const begin = offset[n];
+        int const end = offset[n + 1];
+        std::sort(index.begin() + begin, index.begin() + end);
+        offset[n] = write;
+        for (int k = begin; k < end; ++k)
+        {
+            if (k == begin || index[k] != index[k - 1])
+                index[write++] = index[k];
+        }
+    }
+    offset[nodes] = write;
+    index.resize(write);
+}
+
+/*
+ * Breadth first search from root over the unvisited nodes, appending them
+ * to order with the neighbours of each node taken by increasing degree
+ * (Cuthill-McKee). Returns the first node of the last level, and the
+ * number of levels through levels when given.
+ */
+inline int cuthill_mckee_visit(std::vector<int> const & offset, std::vector<int> const & index,
+                               int root, std::vector<char> & visited, std::vector<int> & order,
+                               int * levels)
+{
+    size_t head = order.size();
+    order.push_back(root);
+    visited[root] = 1;
+
+    int depth = 0;
+    int last_level_start = (int) head;
+    std::vector<int> neighbours;
+    while (head < order.size())
+    {
+        size_t const level_end = order.size();
+        last_level_start = (int) head;
+        for (; head < level_end; ++head)
+        {
+            int const n = order[head];
+            neighbours.clear();
+            for (int k = offset[n]; k < offset[n + 1]; ++k)
+            {
+                if (!visited[index[k]])
+                {
+                    visited[index[k]] = 1;
+                    neighbours.push_back(index[k]);
+                }
+            }
+            for (size_t i = 1; i < neighbours.size(); ++i)
+            {
+                // insertion sort by degree, rows are short
+                int const m = neighbours[i];
+                int const degree = offset[m + 1] - offset[m];
+                size_t j = i;
+                for (; j > 0 && offset[neighbours[j - 1] + 1] - offset[neighbours[j - 1]] > degree; --j)
+                    neighbours[j] = neighbours[j - 1];
+                neighbours[j] = m;
+            }
+            order.insert(order.end(), neighbours.begin(), neighbours.end());
+        }
+        ++depth;
+    }
+
+    if (levels)
+        *levels = depth;
+    return order[last_level_start];
+}
+
+/*
+ * Reverse Cuthill-McKee, for small bandwidth and profile. Every connected
+ * component starts from a pseudo peripheral node, found by searching
+ * again from the far end of the previous search while that gets deeper.
+ */
+template <typename precision>
+void rcm_ordering(Mesh2D<precision> const & mesh, Renumbering & renumbering)
+{
+    int const nodes = mesh.nodes();
+    std::vector<int> offset, index;
+    node_adjacency(mesh, offset, index);
+
+    std::vector<int> & order = renumbering.old_index;
+    order.clear();
+    order.reserve(nodes);
+    std::vector<char> visited(nodes, 0);
+    std::vector<char> probe(nodes, 0);
+    std::vector<int> probe_order;
+
+    for (int start = 0; start < nodes; ++start)
+    {
+        if (visited[start])
+            continue;
+
+        // at most a few searches, the depth settles quickly
+        int root = start;
+        int depth = 0;
+        for (int attempt = 0; attempt < 8; ++attempt)
+        {
+            probe_order.clear();
+            int levels = 0;
+            int far = cuthill_mckee_visit(offset, index, root, probe, probe_order, &levels);
+            for (size_t i = 0; i < probe_order.size(); ++i)
+                probe[probe_order[i]] = 0;
+            if (levels <= depth)
+                break;
+            depth = levels;
+            root = far;
+        }
+
+        cuthill_mckee_visit(offset, index, root, visited, order, NULL);
+    }
+
+    std::reverse(order.begin(), order.end());
+    renumbering.invert_old_index();
+}
+
+/*
+ * Position along a Hilbert curve of order 16 of the point (x, y),
+ * both in [0, 65535].
+ */
+inline unsigned long hilbert_key(unsigned x, unsigned y)
+{
+    unsigned long d = 0;
+    for (unsigned s = 1u << 15; s > 0; s >>= 1)
+    {
+        unsigned const rx = (x & s) ? 1 : 0;
+        unsigned const ry = (y & s) ? 1 : 0;
+        d += (unsigned long) s * s * ((3 * rx) ^ ry);
+        // rotate the quadrant, so the curve stays continuous
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            unsigned const t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
+/*
+ * Position along the Morton (Z order) curve, the bits of x and y interleaved.
+ */
+inline unsigned long morton_key(unsigned x, unsigned y)
+{
+    unsigned long d = 0;
+    for (int bit = 15; bit >= 0; --bit)
+        d = (d << 2) | (((y >> bit) & 1) << 1) | ((x >> bit) & 1);
+    return d;
+}
+
+enum SpaceFillingCurve { HILBERT, MORTON };
+
+/*
+ * Orders nodes along a space filling curve through the bounding box of
+ * the mesh, so that nodes close in space end up close in memory. The
+ * bandwidth is larger than with RCM, but the locality holds at every
+ * scale, which is what assembly and cache blocked kernels care about.
+ */
+template <typename precision>
+void curve_ordering(Mesh2D<precision> const & mesh, SpaceFillingCurve curve, Renumbering & renumbering)
+{
+    int const nodes = mesh.nodes();
+    renumbering.set_identity(nodes);
+    if (nodes == 0)
+        return;
+
+    precision const xmin = *std::min_element(mesh.x.begin(), mesh.x.end());
+    precision const xmax = *std::max_element(mesh.x.begin(), mesh.x.end());
+    precision const ymin = *std::min_element(mesh.y.begin(), mesh.y.end());
+    precision const ymax = *std::max_element(mesh.y.begin(), mesh.y.end());
+    // same scale on both axes, so the curve isn't stretched
+    precision const extent = std::max(std::max(xmax - xmin, ymax - ymin), std::numeric_limits<precision>::min());
+    precision const scale = 65535 / extent;
+
+    std::vector< std::pair<unsigned long, int> > keys(nodes);
+    for (int n = 0; n < nodes; ++n)
+    {
+        unsigned const x = (unsigned) ((mesh.x[n] - xmin) * scale);
+        unsigned const y = (unsigned) ((mesh.y[n] - ymin) * scale);
+        keys[n].first = curve == HILBERT ? hilbert_key(x, y) : morton_key(x, y);
+        keys[n].second = n;
+    }
+    std::sort(keys.begin(), keys.end());
+
+    for (int n = 0; n < nodes; ++n)
+        renumbering.old_index[n] = keys[n].second;
+    renumbering.invert_old_index();
+}
+
+/*
+ * Applies a node renumbering to the mesh, then sorts the triangles and
+ * boundary edges by their smallest new node, so that assembly walks
+ * through the nodes (and the rows of A) roughly in order as well.
+ */
+template <typename precision>
+void renumber(Mesh2D<precision> & mesh, Renumbering const & renumbering)
+{
+    int const nodes = mesh.nodes();
+    assert(renumbering.size() == nodes);
+
+    std::vector<precision> x(nodes), y(nodes);
+    for (int n = 0; n < nodes; ++n)
+    {
+        x[n] = mesh.x[renumbering.old_index[n]];
+        y[n] = mesh.y[renumbering.old_index[n]];
+    }
+    mesh.x.swap(x);
+    mesh.y.swap(y);
+
+    std::vector<int> const & to = renumbering.new_index;
+    int const triangles = mesh.triangles();
+    std::vector< std::pair<int, int> > keys(triangles);
+    for (int t = 0; t < triangles; ++t)
+    {
+        mesh.t0[t] = to[mesh.t0[t]];
+        mesh.t1[t] = to[mesh.t1[t]];
+        mesh.t2[t] = to[mesh.t2[t]];
+        keys[t] = std::make_pair(std::min(mesh.t0[t], std::min(mesh.t1[t], mesh.t2[t])), t);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<int> t0(triangles), t1(triangles), t2(triangles);
+    for (int t = 0; t < triangles; ++t)
+    {
+        t0[t] = mesh.t0[keys[t].second];
+        t1[t] = mesh.t1[keys[t].second];
+        t2[t] = mesh.t2[keys[t].second];
+    }
+    mesh.t0.swap(t0);
+    mesh.t1.swap(t1);
+    mesh.t2.swap(t2);
+
+    int const edges = mesh.boundary_edges();
+    keys.resize(edges);
+    for (int e = 0; e < edges; ++e)
+    {
+        mesh.e0[e] = to[mesh.e0[e]];
+        mesh.e1[e] = to[mesh.e1[e]];
+        keys[e] = std::make_pair(std::min(mesh.e0[e], mesh.e1[e]), e);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<int> e0(edges), e1(edges), marker(edges);
+    for (int e = 0; e < edges; ++e)
+    {
+        e0[e] = mesh.e0[keys[e].second];
+        e1[e] = mesh.e1[keys[e].second];
+        marker[e] = mesh.marker[keys[e].second];
+    }
+    mesh.e0.swap(e0);
+    mesh.e1.swap(e1);
+    mesh.marker.swap(marker);
+}
+
+/*
+ * Renumbers the mesh of a problem, dropping its cached sparsity pattern
+ * and solution, which belong to the old numbering.
+ */
+template <typename precision>
+void renumber(Problem2D<precision> & p, Renumbering const & renumbering)
+{
+    renumber(p.mesh, renumbering);
+    p.invalidate_pattern();
+    p.u.resize(0);
+}
+
+/*
+ * Largest |i - j| over the node pairs sharing a triangle.
+ */
+template <typename precision>
+int bandwidth(Mesh2D<precision> const & mesh)
+{
+    int res = 0;
+    for (int t = 0; t < mesh.triangles(); ++t)
+    {
+        int const lo = std::min(mesh.t0[t], std::min(mesh.t1[t], mesh.t2[t]));
+        int const hi = std::max(mesh.t0[t], std::max(mesh.t1[t], mesh.t2[t]));
+        res = std::max(res, hi - lo);
+    }
+    return res;
+}
+
+}  // namespace Fem
+
+#endif  // __RENUMBER_H
@@ -0,0 +1,213 @@
+#ifndef __SMALL_H
+#define __SMALL_H
+
+#include <cassert>
+
+#include "fem.h"
+
+namespace Fem
+{
+
+/*
+ * Solves for bars small enough to unroll completely. The node count is
+ * a template argument of Problem already, so assembly and the
+ * tridiagonal (Thomas) solve are generated row by row through template
+ * recursion: no loops, no heap, only a few arrays on the stack, which
+ * is what running millions of tiny problems needs. Larger bars make the
+ * compiler recurse too deep and take long, hence the limit.
+ *
+ * Elements are linear, with a at the midpoint and f integrated with the
+ * 2 point Gauss rule, and the Robin conditions of Problem at the ends.
+ */
+static int const SMALL_PROBLEM_NODES = 128;
+
+// weight of the Gauss point nearer to a node in its hat function,
+// 1/2 + 1/(2 sqrt 3), spelled out so constant expressions can use it
+static constexpr double SMALL_GAUSS_NEAR = 0.78867513459481288225;
+
+template <typename precision, int nodes>
+struct SmallSystem
+{
+    precision diagonal[nodes];  // pivots after elimination
+    precision off[nodes - 1];   // A(i, i + 1) = A(i + 1, i)
+    precision rhs[nodes];       // reduced by elimination
+};
+
+/*
+ * Adds the local systems of the last remaining elements of p.
+ */
+template <typename precision, int nodes, int remaining>
+struct SmallAssembly
+{
+    static inline void run(Problem<precision, nodes> & p, SmallSystem<precision, nodes> & s)
+    {
+        int const e = nodes - 1 - remaining;
+        precision const near = precision(SMALL_GAUSS_NEAR);
+        precision const far = 1 - near;
+        precision const left = p.x(e), right = p.x(e + 1);
+        precision const h = right - left;
+        precision const half = h / 2;
+        precision const k = p.a((left + right) / 2) / h;
+        precision const f0 = p.f(left + far * h), f1 = p.f(left + near * h);
+        s.diagonal[e] += k;
+        s.diagonal[e + 1] += k;
+        s.off[e] = -k;
+        s.rhs[e] += half * (near * f0 + far * f1);
+        s.rhs[e + 1] += half * (far * f0 + near * f1);
+        SmallAssembly<precision, nodes, remaining - 1>::run(p, s);
+    }
+};
+
+template <typename precision, int nodes>
+struct SmallAssembly<precision, nodes, 0>
+{
+    static inline void run(Problem<precision, nodes> &, SmallSystem<precision, nodes> &) {}
+};
+
+/*
+ * Forward elimination of the last remaining rows, each by the one above.
+ */
+template <typename precision, int nodes, int remaining>
+struct SmallElimination
+{
+    static inline void run(SmallSystem<precision, nodes> & s)
+    {
+        int const i = nodes - remaining;
+        precision const m = s.off[i - 1] / s.diagonal[i - 1];
+        s.diagonal[i] -= m * s.off[i - 1];
+        s.rhs[i] -= m * s.rhs[i - 1];
+        SmallElimination<precision, nodes, remaining - 1>::run(s);
+    }
+};
+
+template <typename precision, int nodes>
+struct SmallElimination<precision, nodes, 0>
+{
+    static inline void run(SmallSystem<precision, nodes> &) {}
+};
+
+/*
+ * Back substitution of row i and the ones above it; the last row is
+ * done by solve_small.
+ */
+template <typename precision, int nodes, int i>
+struct SmallSubstitution
+{
+    static inline void run(SmallSystem<precision, nodes> const & s, Matrix<precision, nodes, 1> & u)
+    {
+        u(i) = (s.rhs[i] - s.off[i] * u(i + 1)) / s.diagonal[i];
+        SmallSubstitution<precision, nodes, i - 1>::run(s, u);
+    }
+};
+
+template <typename precision, int nodes>
+struct SmallSubstitution<precision, nodes, -1>
+{
+    static inline void run(SmallSystem<precision, nodes> const &, Matrix<precision, nodes, 1> &) {}
+};
+
+/*
+ * Assembles p.b and solves for p.u, unrolled for the node count; p.A is
+ * left alone, the tridiagonal stiffness matrix only lives on the stack.
+ * Without pivoting, which the positive definite A does not need.
+ */
+template <typename precision, int nodes>
+void solve_small(Problem<precision, nodes> & p)
+{
+    static_assert(nodes >= 2 && nodes <= SMALL_PROBLEM_NODES, "too many nodes to unroll, use solve");
+    assert(p.is_valid());
+
+    SmallSystem<precision, nodes> s = SmallSystem<precision, nodes>();
+    SmallAssembly<precision, nodes, nodes - 1>::run(p, s);
+    s.diagonal[0] += p.k[0];
+    s.diagonal[nodes - 1] += p.k[1];
+    s.rhs[0] += p.k[0] * p.g[0];
+    s.rhs[nodes - 1] += p.k[1] * p.g[1];
+    p.b = Eigen::Map< Matrix<precision, nodes, 1> const >(s.rhs);
+
+    SmallElimination<precision, nodes, nodes - 1>::run(s);
+    p.u(nodes - 1) = s.rhs[nodes - 1] / s.diagonal[nodes - 1];
+    SmallSubstitution<precision, nodes, nodes - 2>::run(s, p.u);
+}
+
+/*
+ * A bar of equally spaced nodes with constant a and f, solved entirely
+ * in constant expressions:
+ *
+ *   constexpr ConstantBar<double> bar(9, 2.0, 8.0, 0.5, 1.0, 1.0e6, -1.0, 0.0, 0.0);
+ *   static_assert(bar.u(8) > 0, "");
+ *
+ * Every value is a recursive function of the ones it depends on, in the
+ * same arithmetic as solve_small, so the two agree to the last bit for
+ * the same bar unless the compiler fuses multiplies and adds. Deep
+ * recursion limits it to a few hundred nodes.
+ */
+template <typename precision>
+class ConstantBar
+{
+public:
+    constexpr ConstantBar(int nodes_, precision start_, precision end_, precision a_, precision f_,
+                          precision k0, precision g0, precision k1, precision g1)
+    : nodes(nodes_)
+    , start(start_)
+    , spacing((end_ - start_) / (nodes_ - 1))
+    , a(a_)
+    , f(f_)
+    , k_left(k0)
+    , g_left(g0)
+    , k_right(k1)
+    , g_right(g1)
+    {}
+
+    constexpr precision x(int i) const
+    {
+        return start + i * spacing;
+    }
+    constexpr precision stiffness(int e) const
+    {
+        return a / (x(e + 1) - x(e));
+    }
+    // both load entries of element e, f being constant
+    constexpr precision load(int e) const
+    {
+        return (x(e + 1) - x(e)) / 2 * (precision(SMALL_GAUSS_NEAR) * f + (1 - precision(SMALL_GAUSS_NEAR)) * f);
+    }
+    constexpr precision diagonal(int i) const
+    {
+        return i == 0           ? stiffness(0) + k_left
+             : i == nodes - 1   ? stiffness(nodes - 2) + k_right
+                                : stiffness(i - 1) + stiffness(i);
+    }
+    constexpr precision off(int i) const
+    {
+        return -stiffness(i);
+    }
+    constexpr precision b(int i) const
+    {
+        return i == 0           ? load(0) + k_left * g_left
+             : i == nodes - 1   ? load(nodes - 2) + k_right * g_right
+                                : load(i - 1) + load(i);
+    }
+    constexpr precision pivot(int i) const
+    {
+        return i == 0 ? diagonal(0) : diagonal(i) - off(i - 1) / pivot(i - 1) * off(i - 1);
+    }
+    constexpr precision reduced(int i) const
+    {
+        return i == 0 ? b(0) : b(i) - off(i - 1) / pivot(i - 1) * reduced(i - 1);
+    }
+    constexpr precision u(int i) const
+    {
+        return i == nodes - 1 ? reduced(i) / pivot(i) : (reduced(i) - off(i) * u(i + 1)) / pivot(i);
+    }
+
+    int nodes;
+    precision start, spacing;
+    precision a, f;
+    precision k_left, g_left;
+    precision k_right, g_right;
+};
+
+}  // namespace Fem
+
+#endif  // __SMALL_H
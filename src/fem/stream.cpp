@@ -0,0 +1,367 @@
+#include "stream.h"
+
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+#ifdef ARC_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace Fem
+{
+
+static uint32_t const STREAM_BYTE_ORDER = 0x01020304;
+
+static bool skip_bytes(FILE * file, uint64_t bytes)
+{
+#ifdef _WIN32
+    return _fseeki64(file, (__int64) bytes, SEEK_CUR) == 0;
+#else
+    return fseeko(file, (off_t) bytes, SEEK_CUR) == 0;
+#endif
+}
+
+static bool seek_to(FILE * file, uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, (__int64) offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+#endif
+}
+
+static uint64_t tell(FILE * file)
+{
+#ifdef _WIN32
+    return (uint64_t) _ftelli64(file);
+#else
+    return (uint64_t) ftello(file);
+#endif
+}
+
+static uint64_t file_size(FILE * file)
+{
+    uint64_t const at = tell(file);
+#ifdef _WIN32
+    _fseeki64(file, 0, SEEK_END);
+    uint64_t const size = tell(file);
+    _fseeki64(file, (__int64) at, SEEK_SET);
+#else
+    fseeko(file, 0, SEEK_END);
+    uint64_t const size = tell(file);
+    fseeko(file, (off_t) at, SEEK_SET);
+#endif
+    return size;
+}
+
+/*
+ * Whether the payload of a chunk starting at offset can be what its
+ * header claims, so that neither a corrupt count nor a cut off file
+ * make data allocate or read more than the file holds.
+ */
+static bool is_plausible(StreamChunkHeader const & header, uint64_t offset, uint64_t file_size)
+{
+    if (offset > file_size || header.stored_size > file_size - offset)
+        return false;
+    if (header.element_size == 0 || header.count > std::numeric_limits<uint64_t>::max() / header.element_size)
+        return false;
+    uint64_t const size = header.element_size * header.count;
+    if (header.encoding == STREAM_RAW)
+        return header.stored_size == size;
+    // deflate packs at most 1032 bytes into one
+    return header.encoding != STREAM_SHUFFLED_DEFLATE || size / 1032 <= header.stored_size;
+}
+
+#ifdef ARC_HAVE_ZLIB
+// byte i of value k goes to i * count + k
+static void shuffle(char const * values, uint32_t element_size, uint64_t count, char * shuffled)
+{
+    for (uint64_t k = 0; k < count; ++k)
+        for (uint32_t i = 0; i < element_size; ++i)
+            shuffled[i * count + k] = values[k * element_size + i];
+}
+
+static void unshuffle(char const * shuffled, uint32_t element_size, uint64_t count, char * values)
+{
+    for (uint32_t i = 0; i < element_size; ++i)
+        for (uint64_t k = 0; k < count; ++k)
+            values[k * element_size + i] = shuffled[i * count + k];
+}
+#endif
+
+StreamWriter::StreamWriter()
+: _file(NULL)
+, _compress(false)
+, _max_buffered(0)
+, _buffered(0)
+, _closing(false)
+, _failed(false)
+{}
+
+StreamWriter::~StreamWriter()
+{
+    close();
+}
+
+bool StreamWriter::open(char const * path, bool compress, size_t max_buffered)
+{
+    close();
+
+    _file = fopen(path, "wb");
+    if (!_file)
+    {
+        fprintf(stderr, "Error: could not open %s for writing\n", path);
+        return false;
+    }
+#ifdef ARC_HAVE_ZLIB
+    _compress = compress;
+#else
+    _compress = false;
+    (void) compress;
+#endif
+    _max_buffered = max_buffered;
+    _buffered = 0;
+    _closing = false;
+    _failed = false;
+
+    StreamHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STREAM_MAGIC, sizeof(header.magic));
+    header.version = STREAM_VERSION;
+    header.byte_order = STREAM_BYTE_ORDER;
+    _failed = fwrite(&header, sizeof(header), 1, _file) != 1;
+
+    _thread = std::thread(&StreamWriter::run, this);
+    return true;
+}
+
+void StreamWriter::write(uint32_t field, uint64_t first, void const * data, uint32_t element_size, uint64_t count,
+                         uint64_t step, double time)
+{
+    assert(is_open());
+    assert(data || count == 0);
+
+    Chunk * chunk = new Chunk();
+    memset(&chunk->header, 0, sizeof(chunk->header));
+    chunk->header.field = field;
+    chunk->header.element_size = element_size;
+    chunk->header.step = step;
+    chunk->header.time = time;
+    chunk->header.first = first;
+    chunk->header.count = count;
+    chunk->header.encoding = STREAM_RAW;
+    chunk->header.stored_size = element_size * count;
+    chunk->data.assign(static_cast<char const *>(data), static_cast<char const *>(data) + element_size * count);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    // a chunk larger than the limit still goes through, alone
+    while (!_queue.empty() && _buffered + chunk->data.size() > _max_buffered)
+        _written.wait(lock);
+    _buffered += chunk->data.size();
+    _queue.push_back(chunk);
+    _queued.notify_one();
+}
+
+bool StreamWriter::close()
+{
+    if (!_file)
+        return true;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closing = true;
+        _queued.notify_one();
+    }
+    _thread.join();
+
+    bool const ok = fclose(_file) == 0 && !_failed;
+    _file = NULL;
+    return ok;
+}
+
+void StreamWriter::run()
+{
+    std::vector<char> shuffled;
+    std::vector<char> compressed;
+
+    for (;;)
+    {
+        Chunk * chunk = NULL;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (_queue.empty() && !_closing)
+                _queued.wait(lock);
+            if (_queue.empty())
+                return;
+            chunk = _queue.front();
+        }
+
+        char const * payload = chunk->data.data();
+#ifdef ARC_HAVE_ZLIB
+        uint64_t const size = chunk->data.size();
+        if (_compress && size > 0 && chunk->header.element_size > 0)
+        {
+            shuffled.resize(size);
+            shuffle(chunk->data.data(), chunk->header.element_size, chunk->header.count, shuffled.data());
+            uLongf stored = compressBound((uLong) size);
+            compressed.resize(stored);
+            // level 1: most of the gain of shuffling is there already
+            if (compress2(reinterpret_cast<Bytef *>(compressed.data()), &stored,
+                          reinterpret_cast<Bytef const *>(shuffled.data()), (uLong) size, 1) == Z_OK
+                && stored < size)
+            {
+                chunk->header.encoding = STREAM_SHUFFLED_DEFLATE;
+                chunk->header.stored_size = stored;
+                payload = compressed.data();
+            }
+        }
+#endif
+
+        bool const ok = fwrite(&chunk->header, sizeof(chunk->header), 1, _file) == 1
+                     && fwrite(payload, 1, chunk->header.stored_size, _file) == chunk->header.stored_size;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _failed = _failed || !ok;
+        _buffered -= chunk->data.size();
+        _queue.pop_front();
+        _written.notify_all();
+        delete chunk;
+    }
+}
+
+StreamReader::StreamReader()
+: _file(NULL)
+, _size(0)
+, _offset(0)
+, _pending(false)
+{
+    memset(&_header, 0, sizeof(_header));
+}
+
+StreamReader::~StreamReader()
+{
+    close();
+}
+
+bool StreamReader::open(char const * path)
+{
+    close();
+
+    _file = fopen(path, "rb");
+    if (!_file)
+    {
+        fprintf(stderr, "Error: could not open %s\n", path);
+        return false;
+    }
+    StreamHeader header;
+    if (fread(&header, sizeof(header), 1, _file) != 1 || memcmp(header.magic, STREAM_MAGIC, sizeof(header.magic)) != 0)
+    {
+        fprintf(stderr, "Error: %s is not a stream\n", path);
+        close();
+        return false;
+    }
+    if (header.version != STREAM_VERSION || header.byte_order != STREAM_BYTE_ORDER)
+    {
+        fprintf(stderr, "Error: %s is version %u in %s byte order, expected version %u\n", path, header.version,
+                header.byte_order == STREAM_BYTE_ORDER ? "this" : "another", STREAM_VERSION);
+        close();
+        return false;
+    }
+    _size = file_size(_file);
+    return true;
+}
+
+void StreamReader::close()
+{
+    if (_file)
+        fclose(_file);
+    _file = NULL;
+    _pending = false;
+}
+
+bool StreamReader::next()
+{
+    if (!_file)
+        return false;
+    if (_pending && !skip_bytes(_file, _header.stored_size))
+        return false;
+    _pending = false;
+    if (fread(&_header, sizeof(_header), 1, _file) != 1)
+        return false;
+    uint64_t const offset = tell(_file);
+    if (!is_plausible(_header, offset, _size))
+    {
+        fprintf(stderr, "Error: stream chunk at byte %llu is corrupt or cut off\n",
+                (unsigned long long) (offset - sizeof(_header)));
+        return false;
+    }
+    _offset = offset - sizeof(_header);
+    _pending = true;
+    return true;
+}
+
+bool StreamReader::seek(uint64_t offset)
+{
+    if (!_file || offset < sizeof(StreamHeader) || offset > _size)
+        return false;
+    _pending = false;
+    return seek_to(_file, offset);
+}
+
+void const * StreamReader::data()
+{
+    if (!_file)
+        return NULL;
+    uint64_t const size = _header.element_size * _header.count;
+    if (!_pending)
+        return _data.size() == size ? _data.data() : NULL;
+    _pending = false;
+
+    if (_header.encoding == STREAM_RAW && _header.stored_size == size)
+    {
+        _data.resize(size);
+        if (fread(_data.data(), 1, size, _file) != size)
+            _data.clear();
+    }
+#ifdef ARC_HAVE_ZLIB
+    else if (_header.encoding == STREAM_SHUFFLED_DEFLATE)
+    {
+        _stored.resize(_header.stored_size);
+        _data.resize(size);
+        uLongf inflated = (uLongf) size;
+        if (fread(_stored.data(), 1, _stored.size(), _file) != _stored.size()
+            || uncompress(reinterpret_cast<Bytef *>(_data.data()), &inflated,
+                          reinterpret_cast<Bytef const *>(_stored.data()), (uLong) _stored.size()) != Z_OK
+            || inflated != size)
+        {
+            _data.clear();
+        }
+        else
+        {
+            _stored.resize(size);
+            unshuffle(_data.data(), _header.element_size, _header.count, _stored.data());
+            _data.swap(_stored);
+        }
+    }
+#endif
+    else
+    {
+        skip_bytes(_file, _header.stored_size);
+        _data.clear();
+    }
+    return _data.size() == size && size > 0 ? _data.data() : NULL;
+}
+
+bool StreamReader::is_stream(char const * path)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file)
+        return false;
+    char magic[sizeof(STREAM_MAGIC)];
+    bool const res = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, STREAM_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+    return res;
+}
+
+}  // namespace Fem
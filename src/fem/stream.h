@@ -0,0 +1,190 @@
+#ifndef __STREAM_H
+#define __STREAM_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "fem.h"
+
+namespace Fem
+{
+
+/*
+ * Streamed solver output: a 32 byte file header followed by chunks,
+ * each a 56 byte header and its payload. A chunk holds count values of
+ * one field, for the nodes (or elements) first to first + count - 1, of
+ * one step of a sweep or time stepping loop. Fields, steps and ranges
+ * may come in any order and be split into chunks of any size, so output
+ * can be written as it is produced, without ever holding all of it.
+ *
+ * Payloads are stored raw, or byte shuffled (all first bytes of the
+ * values, then all second bytes, ...) and deflated, which compresses
+ * smooth floating point fields far better than deflate alone. Values
+ * are in the byte order of the writer, which the header records.
+ */
+static char const STREAM_MAGIC[8] = { 'A', 'R', 'C', 'S', 'T', 'R', 'M', '\0' };
+static uint32_t const STREAM_VERSION = 1;
+
+enum StreamField
+{
+    STREAM_X = 1,  // node coordinates
+    STREAM_U,      // state vector
+    STREAM_FLUX    // per element, e.g. -a du/dx at the element midpoints
+};
+
+enum StreamEncoding
+{
+    STREAM_RAW = 0,
+    STREAM_SHUFFLED_DEFLATE
+};
+
+struct StreamHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t reserved[2];
+};
+
+struct StreamChunkHeader
+{
+    uint32_t field;
+    uint32_t element_size;
+    uint64_t step;
+    double time;
+    uint64_t first;         // index of the first value
+    uint64_t count;         // of values
+    uint32_t encoding;
+    uint32_t reserved;
+    uint64_t stored_size;   // bytes of payload following the header
+};
+
+/*
+ * Writes chunks from a background thread. write copies the values into
+ * a queue and returns, unless more than max_buffered bytes are already
+ * waiting, in which case it blocks until the thread has caught up, so
+ * memory stays bounded when the disk is slower than the solver.
+ * Compression, if asked for and zlib is available, also runs on the
+ * background thread.
+ */
+class StreamWriter
+{
+public:
+    StreamWriter();
+    ~StreamWriter();
+    bool open(char const * path, bool compress = false, size_t max_buffered = 64 << 20);
+    bool is_open() const { return _file != NULL; }
+    void write(uint32_t field, uint64_t first, void const * data, uint32_t element_size, uint64_t count,
+               uint64_t step = 0, double time = 0.0);
+    template <typename T>
+    void write(uint32_t field, uint64_t first, T const * data, uint64_t count,
+               uint64_t step = 0, double time = 0.0)
+    {
+        write(field, first, data, sizeof(T), count, step, time);
+    }
+    // writes what is queued, returns false if anything failed since open
+    bool close();
+
+private:
+    StreamWriter(StreamWriter const &);
+    StreamWriter & operator=(StreamWriter const &);
+
+    struct Chunk
+    {
+        StreamChunkHeader header;
+        std::vector<char> data;
+    };
+
+    void run();
+
+    FILE * _file;
+    bool _compress;
+    size_t _max_buffered;
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _queued;    // signals the thread
+    std::condition_variable _written;   // signals blocked writers
+    std::deque<Chunk *> _queue;
+    size_t _buffered;
+    bool _closing;
+    bool _failed;
+};
+
+/*
+ * Reads a stream chunk by chunk. next moves to the following chunk,
+ * data decodes the current one; chunks whose data is never asked for
+ * are skipped without reading their payload. next stops at a chunk
+ * whose header doesn't fit its payload or the rest of the file.
+ */
+class StreamReader
+{
+public:
+    StreamReader();
+    ~StreamReader();
+    bool open(char const * path);
+    void close();
+    bool is_open() const { return _file != NULL; }
+    bool next();
+    StreamChunkHeader const & header() const { return _header; }
+    // where the current chunk starts, for seek to come back to it
+    uint64_t offset() const { return _offset; }
+    // the following next reads the chunk at offset
+    bool seek(uint64_t offset);
+    // values of the current chunk, NULL if they can't be read
+    void const * data();
+
+    // true if the file starts with the stream magic
+    static bool is_stream(char const * path);
+
+private:
+    StreamReader(StreamReader const &);
+    StreamReader & operator=(StreamReader const &);
+
+    FILE * _file;
+    uint64_t _size;  // of the file
+    uint64_t _offset;
+    StreamChunkHeader _header;
+    bool _pending;  // payload of the current chunk not read yet
+    std::vector<char> _stored;
+    std::vector<char> _data;
+};
+
+/*
+ * Streams x, u and the element fluxes -a du/dx of the bar in chunks of
+ * chunk_nodes nodes, as a step of a sweep or time stepping loop; x only
+ * on step 0, as the mesh does not move.
+ */
+template <typename precision, int nodes>
+void write_step(StreamWriter & writer, Problem<precision, nodes> & p, uint64_t step, double time,
+                int chunk_nodes = 1 << 16)
+{
+    ElementTable<precision> const & table = update_element_table(p);
+    std::vector<precision> flux;
+    for (int first = 0; first < nodes; first += chunk_nodes)
+    {
+        int const count = std::min(chunk_nodes, nodes - first);
+        if (step == 0)
+            writer.write(STREAM_X, first, p.x.data() + first, count, step, time);
+        writer.write(STREAM_U, first, p.u.data() + first, count, step, time);
+
+        int const elements = std::min(count, nodes - 1 - first);
+        flux.resize(elements);
+        for (int e = 0; e < elements; ++e)
+        {
+            int const i = first + e;
+            flux[e] = -table.a_mid[i] * (p.u(i + 1) - p.u(i)) / table.h[i];
+        }
+        if (elements > 0)
+            writer.write(STREAM_FLUX, first, flux.data(), elements, step, time);
+    }
+}
+
+}  // namespace Fem
+
+#endif  // __STREAM_H
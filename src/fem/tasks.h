@@ -0,0 +1,448 @@
+#ifndef __TASKS_H
+#define __TASKS_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Fem
+{
+
+/*
+ * A piece of work for the task pool. The pool does not own tasks; they
+ * must live until the group they were spawned in has been waited for.
+ */
+class Task
+{
+public:
+    virtual ~Task() {}
+    virtual void run() = 0;
+};
+
+/*
+ * Tasks spawned together and waited for together (fork/join).
+ */
+class TaskGroup
+{
+public:
+    TaskGroup()
+    : pending(0)
+    {}
+
+    std::atomic<int> pending;
+
+private:
+    TaskGroup(TaskGroup const &);
+    TaskGroup & operator=(TaskGroup const &);
+};
+
+/*
+ * The one pool of worker threads that everything parallel in arc runs
+ * on, so that parallel work started from within parallel work (sweeps
+ * of decomposed solves, post-processing of every member of a study)
+ * shares the same threads instead of multiplying them.
+ *
+ * Every worker has a deque of tasks; it works on the newest of its own
+ * and, when out of work, steals the oldest of another worker, trying
+ * those on its own NUMA node first. Threads outside the pool queue
+ * their tasks on a shared deque. A thread waiting for a group works on
+ * tasks meanwhile, so waiting inside a task never idles a worker and
+ * can't deadlock the pool.
+ *
+ * The pool starts with one thread per core on first use; configure
+ * changes that, and with pin set ties the workers to cores one NUMA
+ * node after the other (Linux only). Processes should be forked before
+ * the first use, as the children don't get the workers.
+ */
+class TaskPool
+{
+public:
+    static TaskPool & instance()
+    {
+        static TaskPool pool;
+        return pool;
+    }
+    ~TaskPool()
+    {
+        stop();
+    }
+
+    /*
+     * Sets the number of threads working on tasks, the waiting one
+     * included, 0 for one per core. Must not be called while tasks run.
+     */
+    void configure(int threads, bool pin = false)
+    {
+        std::lock_guard<std::mutex> lock(_configure_mutex);
+        stop();
+        _threads = threads > 0 ? threads : std::max(1, (int) std::thread::hardware_concurrency());
+        _pin = pin;
+        start();
+    }
+
+    int threads()
+    {
+        started();
+        return _threads;
+    }
+
+    void spawn(Task & task, TaskGroup & group)
+    {
+        started();
+        group.pending.fetch_add(1);
+        int const worker = current_worker();
+        Queue & queue = *_queues[worker >= 0 ? worker : _workers.size()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.entries.push_back(Entry(&task, &group));
+        }
+        _queued.fetch_add(1);
+        if (_sleeping.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(_sleep_mutex);
+            _wake.notify_one();
+        }
+    }
+
+    /*
+     * Returns once every task of group has run, working on tasks of any
+     * group meanwhile.
+     */
+    void wait(TaskGroup & group)
+    {
+        int const worker = current_worker();
+        while (group.pending.load() > 0)
+        {
+            Entry entry;
+            if (take(worker, entry))
+                execute(entry);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    struct Entry
+    {
+        Entry(Task * task_ = NULL, TaskGroup * group_ = NULL)
+        : task(task_)
+        , group(group_)
+        {}
+
+        Task * task;
+        TaskGroup * group;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Entry> entries;
+        std::vector<int> victims;  // queues to steal from, nearest first
+    };
+
+    TaskPool()
+    : _threads(0)
+    , _pin(false)
+    , _running(false)
+    , _stopping(false)
+    , _queued(0)
+    , _sleeping(0)
+    {}
+    TaskPool(TaskPool const &);
+    TaskPool & operator=(TaskPool const &);
+
+    // index of the worker running on this thread, -1 outside the pool
+    static int & current_worker()
+    {
+        static thread_local int worker = -1;
+        return worker;
+    }
+
+    void started()
+    {
+        if (_running.load(std::memory_order_acquire))
+            return;
+        std::lock_guard<std::mutex> lock(_configure_mutex);
+        if (!_running.load())
+        {
+            _threads = std::max(1, (int) std::thread::hardware_concurrency());
+            start();
+        }
+    }
+
+    void start()
+    {
+        int const workers = _threads - 1;
+        std::vector<int> cpus, nodes;
+        if (_pin)
+            cpu_order(cpus, nodes);
+
+        // worker w runs on cpus[w] if pinned; the shared queue, last,
+        // counts as node 0
+        std::vector<int> node(workers + 1, 0);
+        for (int w = 0; _pin && w < workers && !cpus.empty(); ++w)
+            node[w] = nodes[w % cpus.size()];
+        _queues.clear();
+        for (int q = 0; q <= workers; ++q)
+        {
+            Queue * queue = new Queue();
+            for (int v = 1; v <= workers; ++v)
+                if (node[(q + v) % (workers + 1)] == node[q])
+                    queue->victims.push_back((q + v) % (workers + 1));
+            for (int v = 1; v <= workers; ++v)
+                if (node[(q + v) % (workers + 1)] != node[q])
+                    queue->victims.push_back((q + v) % (workers + 1));
+            _queues.push_back(queue);
+        }
+
+        _stopping = false;
+        for (int w = 0; w < workers; ++w)
+        {
+            _workers.push_back(std::thread(&TaskPool::work, this, w));
+#ifdef __linux__
+            if (!cpus.empty())
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpus[w % cpus.size()], &set);
+                if (pthread_setaffinity_np(_workers.back().native_handle(), sizeof(set), &set) != 0)
+                    fprintf(stderr, "Warning: could not pin worker %d to cpu %d\n", w, cpus[w % cpus.size()]);
+            }
+#endif
+        }
+        _running.store(true, std::memory_order_release);
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_sleep_mutex);
+            _stopping = true;
+            _wake.notify_all();
+        }
+        for (size_t w = 0; w < _workers.size(); ++w)
+            _workers[w].join();
+        _workers.clear();
+        for (size_t q = 0; q < _queues.size(); ++q)
+            delete _queues[q];
+        _queues.clear();
+        _running = false;
+    }
+
+    /*
+     * The cpus this process may run on, grouped by NUMA node as far as
+     * the system tells, with the node of each.
+     */
+    static void cpu_order(std::vector<int> & cpus, std::vector<int> & nodes)
+    {
+        cpus.clear();
+        nodes.clear();
+#ifdef __linux__
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            return;
+        std::vector<char> listed(CPU_SETSIZE, 0);
+        for (int node = 0;; ++node)
+        {
+            char path[64];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+            FILE * file = fopen(path, "r");
+            if (!file)
+                break;
+            // ranges like 0-3,8-11
+            int first = 0, last = 0;
+            while (fscanf(file, "%d", &first) == 1)
+            {
+                last = first;
+                int const next = fgetc(file);
+                if (next == '-' && fscanf(file, "%d", &last) == 1)
+                    fgetc(file);
+                for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+                {
+                    if (CPU_ISSET(cpu, &allowed) && !listed[cpu])
+                    {
+                        cpus.push_back(cpu);
+                        nodes.push_back(node);
+                        listed[cpu] = 1;
+                    }
+                }
+            }
+            fclose(file);
+        }
+        // without NUMA information, or cpus it left out
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &allowed) && !listed[cpu])
+            {
+                cpus.push_back(cpu);
+                nodes.push_back(0);
+            }
+        }
+#endif
+    }
+
+    /*
+     * The newest task of the queue of worker (the shared one outside
+     * the pool), else the oldest of another.
+     */
+    bool take(int worker, Entry & entry)
+    {
+        if (_queued.load() == 0)
+            return false;
+        int const own = worker >= 0 ? worker : (int) _workers.size();
+        Queue & queue = *_queues[own];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.entries.empty())
+            {
+                entry = queue.entries.back();
+                queue.entries.pop_back();
+                _queued.fetch_sub(1);
+                return true;
+            }
+        }
+        for (size_t v = 0; v < queue.victims.size(); ++v)
+        {
+            Queue & victim = *_queues[queue.victims[v]];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.entries.empty())
+            {
+                entry = victim.entries.front();
+                victim.entries.pop_front();
+                _queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(Entry const & entry)
+    {
+        entry.task->run();
+        entry.group->pending.fetch_sub(1);
+    }
+
+    void work(int worker)
+    {
+        current_worker() = worker;
+        for (;;)
+        {
+            Entry entry;
+            if (take(worker, entry))
+            {
+                execute(entry);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_sleep_mutex);
+            _sleeping.fetch_add(1);
+            while (_queued.load() == 0 && !_stopping)
+                _wake.wait(lock);
+            _sleeping.fetch_sub(1);
+            if (_stopping)
+                return;
+        }
+    }
+
+    int _threads;
+    bool _pin;
+    std::atomic<bool> _running;
+    bool _stopping;
+    std::vector<std::thread> _workers;
+    std::vector<Queue *> _queues;  // one per worker, then the shared one
+    std::atomic<int> _queued;      // tasks in all queues
+    std::atomic<int> _sleeping;    // workers waiting for tasks
+    std::mutex _sleep_mutex;
+    std::condition_variable _wake;
+    std::mutex _configure_mutex;
+};
+
+/*
+ * Body of a parallel loop, run on disjoint ranges of the indices.
+ */
+class RangeTask
+{
+public:
+    virtual ~RangeTask() {}
+    virtual void run(int begin, int end) = 0;
+};
+
+class RangeChunk : public Task
+{
+public:
+    RangeChunk()
+    : body(NULL)
+    , begin(0)
+    , end(0)
+    {}
+    virtual void run()
+    {
+        body->run(begin, end);
+    }
+
+    RangeTask * body;
+    int begin, end;
+};
+
+/*
+ * Number of chunks parallel_for splits [begin, end) into, and where
+ * chunk starts, for bodies that keep a result per chunk.
+ */
+inline int chunk_count(int begin, int end, int grain)
+{
+    int const count = end - begin;
+    if (count <= 0)
+        return 0;
+    grain = std::max(1, grain);
+    // a few chunks per thread balance uneven work without much overhead
+    int const wanted = 4 * TaskPool::instance().threads();
+    return std::max(1, std::min(wanted, count / grain));
+}
+
+inline int chunk_begin(int begin, int end, int chunks, int chunk)
+{
+    return begin + (int) ((long long) (end - begin) * chunk / chunks);
+}
+
+/*
+ * Runs body over [begin, end) in chunks of at least grain indices on
+ * the task pool, the calling thread included, and returns once all
+ * have run.
+ */
+inline void parallel_for(int begin, int end, int grain, RangeTask & body)
+{
+    int const chunks = chunk_count(begin, end, grain);
+    if (chunks <= 1)
+    {
+        if (chunks == 1)
+            body.run(begin, end);
+        return;
+    }
+    std::vector<RangeChunk> tasks(chunks);
+    TaskGroup group;
+    TaskPool & pool = TaskPool::instance();
+    for (int c = chunks - 1; c >= 0; --c)
+    {
+        tasks[c].body = &body;
+        tasks[c].begin = chunk_begin(begin, end, chunks, c);
+        tasks[c].end = chunk_begin(begin, end, chunks, c + 1);
+        // the first chunk is run right here
+        if (c > 0)
+            pool.spawn(tasks[c], group);
+    }
+    tasks[0].run();
+    pool.wait(group);
+}
+
+}  // namespace Fem
+
+#endif  // __TASKS_H
@@ -0,0 +1,413 @@
+#include "transport.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifdef ARC_HAVE_MPI
+#include <mpi.h>
+#endif
+
+namespace Fem
+{
+
+bool Transport::exchange(int peer, void const * out, size_t out_bytes, void * in, size_t in_bytes)
+{
+    if (rank() < peer)
+        return send(peer, out, out_bytes) && receive(peer, in, in_bytes);
+    return receive(peer, in, in_bytes) && send(peer, out, out_bytes);
+}
+
+bool Transport::sum(double * values, int count)
+{
+    if (size() == 1)
+        return true;
+    if (rank() != 0)
+        return send(0, values, count * sizeof(double)) && receive(0, values, count * sizeof(double));
+
+    // in order of rank, so every run adds up the same way
+    bool ok = true;
+    std::vector<double> part(count);
+    for (int r = 1; r < size(); ++r)
+    {
+        ok = ok && receive(r, part.data(), count * sizeof(double));
+        for (int i = 0; ok && i < count; ++i)
+            values[i] += part[i];
+    }
+    for (int r = 1; r < size(); ++r)
+        ok = send(r, values, count * sizeof(double)) && ok;
+    return ok;
+}
+
+#ifndef _WIN32
+
+SocketTransport::SocketTransport()
+: _rank(0)
+{}
+
+SocketTransport::~SocketTransport()
+{
+    close_sockets();
+}
+
+SocketTransport * SocketTransport::start(int processes)
+{
+    assert(processes >= 1);
+    SocketTransport * transport = new SocketTransport();
+    transport->_sockets.assign(processes, -1);
+
+    // a pair for every two ranks, made before forking so all inherit them
+    std::vector<int> pairs(processes * processes, -1);
+    bool ok = true;
+    for (int i = 0; ok && i < processes; ++i)
+    {
+        for (int j = i + 1; ok && j < processes; ++j)
+        {
+            int fds[2];
+            ok = socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0;
+            if (ok)
+            {
+                pairs[i * processes + j] = fds[0];
+                pairs[j * processes + i] = fds[1];
+#ifdef SO_NOSIGPIPE
+                int const on = 1;
+                setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+                setsockopt(fds[1], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+            }
+        }
+    }
+
+    // the other ranks inherit unflushed output otherwise
+    fflush(NULL);
+    int rank = 0;
+    for (int r = 1; ok && r < processes; ++r)
+    {
+        pid_t const pid = fork();
+        if (pid == 0)
+        {
+            rank = r;
+            transport->_children.clear();
+            break;
+        }
+        if (pid < 0)
+        {
+            fprintf(stderr, "Error: could not start process %d\n", r);
+            ok = false;
+        }
+        else
+        {
+            transport->_children.push_back(pid);
+        }
+    }
+
+    transport->_rank = rank;
+    for (int i = 0; i < processes; ++i)
+    {
+        for (int j = 0; j < processes; ++j)
+        {
+            int const fd = pairs[i * processes + j];
+            if (fd < 0)
+                continue;
+            if (i == rank)
+                transport->_sockets[j] = fd;
+            else
+                close(fd);
+        }
+    }
+
+    if (!ok)
+    {
+        // the started processes see their sockets close and fail
+        transport->finish(false);
+        delete transport;
+        return NULL;
+    }
+    return transport;
+}
+
+void SocketTransport::close_sockets()
+{
+    for (size_t i = 0; i < _sockets.size(); ++i)
+    {
+        if (_sockets[i] >= 0)
+            close(_sockets[i]);
+        _sockets[i] = -1;
+    }
+}
+
+bool SocketTransport::send(int to, void const * data, size_t bytes)
+{
+    assert(to >= 0 && to < size() && to != _rank);
+#ifdef MSG_NOSIGNAL
+    int const flags = MSG_NOSIGNAL;
+#else
+    int const flags = 0;
+#endif
+    char const * next = static_cast<char const *>(data);
+    while (bytes > 0)
+    {
+        ssize_t const done = ::send(_sockets[to], next, bytes, flags);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+        {
+            fprintf(stderr, "Error: rank %d could not send to rank %d\n", _rank, to);
+            return false;
+        }
+        next += done;
+        bytes -= done;
+    }
+    return true;
+}
+
+bool SocketTransport::receive(int from, void * data, size_t bytes)
+{
+    assert(from >= 0 && from < size() && from != _rank);
+    char * next = static_cast<char *>(data);
+    while (bytes > 0)
+    {
+        ssize_t const done = ::recv(_sockets[from], next, bytes, 0);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+        {
+            fprintf(stderr, "Error: rank %d could not receive from rank %d\n", _rank, from);
+            return false;
+        }
+        next += done;
+        bytes -= done;
+    }
+    return true;
+}
+
+int SocketTransport::receive_any(void * data, size_t bytes)
+{
+    std::vector<struct pollfd> fds;
+    std::vector<int> ranks;
+    for (;;)
+    {
+        fds.clear();
+        ranks.clear();
+        for (int r = 0; r < size(); ++r)
+        {
+            if (_sockets[r] < 0)
+                continue;
+            struct pollfd fd;
+            fd.fd = _sockets[r];
+            fd.events = POLLIN;
+            fd.revents = 0;
+            fds.push_back(fd);
+            ranks.push_back(r);
+        }
+        if (fds.empty())
+            return -1;
+
+        int const ready = poll(fds.data(), fds.size(), -1);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready <= 0)
+            return -1;
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            if (!fds[i].revents)
+                continue;
+            char first;
+            ssize_t const peeked = ::recv(fds[i].fd, &first, 1, MSG_PEEK);
+            if (peeked > 0)
+                return receive(ranks[i], data, bytes) ? ranks[i] : -1;
+            if (peeked < 0 && errno == EINTR)
+                continue;
+            // the peer is gone, e.g. done with its work, nothing more comes from it
+            close(fds[i].fd);
+            _sockets[ranks[i]] = -1;
+        }
+    }
+}
+
+bool SocketTransport::finish(bool success)
+{
+    fflush(NULL);
+    close_sockets();
+    if (_rank != 0)
+        _exit(success ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    for (size_t i = 0; i < _children.size(); ++i)
+    {
+        int status = 0;
+        waitpid(_children[i], &status, 0);
+        success = success && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    }
+    _children.clear();
+    return success;
+}
+
+#endif  // _WIN32
+
+#ifdef ARC_HAVE_MPI
+
+// MPI counts are ints, larger messages go in parts
+static size_t const MPI_PART = 1 << 30;
+
+MpiTransport::MpiTransport()
+: _rank(0)
+, _size(1)
+{}
+
+MpiTransport::~MpiTransport()
+{
+    MPI_Finalize();
+}
+
+MpiTransport * MpiTransport::start(int * argc, char *** argv)
+{
+    // the work queue serves from a thread, one at a time
+    int provided = MPI_THREAD_SINGLE;
+    if (MPI_Init_thread(argc, argv, MPI_THREAD_SERIALIZED, &provided) != MPI_SUCCESS)
+    {
+        fprintf(stderr, "Error: could not initialize MPI\n");
+        return NULL;
+    }
+    if (provided < MPI_THREAD_SERIALIZED)
+    {
+        fprintf(stderr, "Error: MPI does not support threads\n");
+        MPI_Finalize();
+        return NULL;
+    }
+    MpiTransport * transport = new MpiTransport();
+    MPI_Comm_rank(MPI_COMM_WORLD, &transport->_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &transport->_size);
+    return transport;
+}
+
+bool MpiTransport::send(int to, void const * data, size_t bytes)
+{
+    char const * next = static_cast<char const *>(data);
+    do
+    {
+        int const part = (int) (bytes < MPI_PART ? bytes : MPI_PART);
+        if (MPI_Send(const_cast<char *>(next), part, MPI_BYTE, to, 0, MPI_COMM_WORLD) != MPI_SUCCESS)
+            return false;
+        next += part;
+        bytes -= part;
+    } while (bytes > 0);
+    return true;
+}
+
+bool MpiTransport::receive(int from, void * data, size_t bytes)
+{
+    char * next = static_cast<char *>(data);
+    do
+    {
+        int const part = (int) (bytes < MPI_PART ? bytes : MPI_PART);
+        if (MPI_Recv(next, part, MPI_BYTE, from, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+            return false;
+        next += part;
+        bytes -= part;
+    } while (bytes > 0);
+    return true;
+}
+
+int MpiTransport::receive_any(void * data, size_t bytes)
+{
+    // the first part tells the sender, the rest comes from it
+    size_t const first = bytes < MPI_PART ? bytes : MPI_PART;
+    MPI_Status status;
+    if (MPI_Recv(data, (int) first, MPI_BYTE, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+        return -1;
+    if (bytes > first && !receive(status.MPI_SOURCE, static_cast<char *>(data) + first, bytes - first))
+        return -1;
+    return status.MPI_SOURCE;
+}
+
+bool MpiTransport::sum(double * values, int count)
+{
+    return MPI_Allreduce(MPI_IN_PLACE, values, count, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD) == MPI_SUCCESS;
+}
+
+#endif  // ARC_HAVE_MPI
+
+WorkQueue::WorkQueue(Transport & transport, int count)
+: _transport(transport)
+, _count(count)
+, _next(0)
+, _done(false)
+{
+    if (_transport.rank() == 0 && _transport.size() > 1)
+        _server = std::thread(&WorkQueue::serve, this);
+}
+
+WorkQueue::~WorkQueue()
+{
+    // a rank leaving early tells the server; all wait until it has
+    // stopped, or what they send next could reach it
+    if (_transport.rank() != 0)
+    {
+        int const leaving = 0;
+        int stopped = 0;
+        if (_done || _transport.send(0, &leaving, sizeof(leaving)))
+            _transport.receive(0, &stopped, sizeof(stopped));
+    }
+    if (_server.joinable())
+        _server.join();
+}
+
+int WorkQueue::next()
+{
+    if (_done)
+        return -1;
+    int index = -1;
+    if (_transport.rank() == 0)
+    {
+        index = _next.fetch_add(1);
+    }
+    else
+    {
+        int const asking = 1;
+        if (!_transport.send(0, &asking, sizeof(asking)) || !_transport.receive(0, &index, sizeof(index)))
+            index = -1;
+    }
+    if (index < 0 || index >= _count)
+    {
+        _done = true;
+        return -1;
+    }
+    return index;
+}
+
+void WorkQueue::serve()
+{
+    for (int waiting = _transport.size() - 1; waiting > 0;)
+    {
+        int asking = 0;
+        int const from = _transport.receive_any(&asking, sizeof(asking));
+        if (from < 0)
+            return;  // a rank died, the others fail on their own
+        if (!asking)
+        {
+            --waiting;
+            continue;
+        }
+        int index = _next.fetch_add(1);
+        if (index >= _count)
+        {
+            index = -1;
+            --waiting;
+        }
+        _transport.send(from, &index, sizeof(index));
+    }
+    int const stopped = 1;
+    for (int r = 1; r < _transport.size(); ++r)
+        _transport.send(r, &stopped, sizeof(stopped));
+}
+
+}  // namespace Fem
@@ -0,0 +1,153 @@
+#ifndef __TRANSPORT_H
+#define __TRANSPORT_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+namespace Fem
+{
+
+/*
+ * Message passing between the processes of a distributed run, ranked 0
+ * to size - 1, all running the same program (SPMD). Messages carry no
+ * tags or lengths; both sides know what comes next and how big it is.
+ * Messages from one rank to another arrive in the order they were sent.
+ *
+ * send and receive block. Two ranks sending large messages to each
+ * other at the same time may block each other, so swaps go through
+ * exchange, which orders them; swapping with several peers in order of
+ * rank cannot deadlock either.
+ */
+class Transport
+{
+public:
+    virtual ~Transport() {}
+    virtual int rank() const = 0;
+    virtual int size() const = 0;
+    virtual bool send(int to, void const * data, size_t bytes) = 0;
+    virtual bool receive(int from, void * data, size_t bytes) = 0;
+    // receives from whichever rank sends first, returns it, -1 on failure
+    virtual int receive_any(void * data, size_t bytes) = 0;
+
+    // sends to and receives from peer, lower rank sending first
+    virtual bool exchange(int peer, void const * out, size_t out_bytes, void * in, size_t in_bytes);
+    // sums values over all ranks, every rank gets the sums
+    virtual bool sum(double * values, int count);
+};
+
+/*
+ * The only process, for runs that are not distributed.
+ */
+class SingleProcessTransport : public Transport
+{
+public:
+    virtual int rank() const { return 0; }
+    virtual int size() const { return 1; }
+    virtual bool send(int, void const *, size_t) { return false; }
+    virtual bool receive(int, void *, size_t) { return false; }
+    virtual int receive_any(void *, size_t) { return -1; }
+};
+
+#ifndef _WIN32
+/*
+ * Local processes connected pairwise by unix sockets, a stand-in for
+ * MPI on one machine and for testing. start forks the other processes,
+ * which continue from where it returns with their own rank; they end
+ * with finish, rank 0 waiting for them in its finish.
+ */
+class SocketTransport : public Transport
+{
+public:
+    // NULL if the processes could not be started
+    static SocketTransport * start(int processes);
+    virtual ~SocketTransport();
+    virtual int rank() const { return _rank; }
+    virtual int size() const { return (int) _sockets.size(); }
+    virtual bool send(int to, void const * data, size_t bytes);
+    virtual bool receive(int from, void * data, size_t bytes);
+    virtual int receive_any(void * data, size_t bytes);
+
+    /*
+     * Ends the run with success of this rank. The other processes exit
+     * here; rank 0 returns once they have, with whether all succeeded.
+     */
+    bool finish(bool success);
+
+private:
+    SocketTransport();
+    SocketTransport(SocketTransport const &);
+    SocketTransport & operator=(SocketTransport const &);
+    void close_sockets();
+
+    int _rank;
+    std::vector<int> _sockets;  // to every rank, -1 for this one
+    std::vector<pid_t> _children;
+};
+#endif
+
+#ifdef ARC_HAVE_MPI
+/*
+ * The ranks of an MPI job (mpirun), initialized by start and finalized
+ * when deleted.
+ */
+class MpiTransport : public Transport
+{
+public:
+    // NULL if MPI could not be initialized
+    static MpiTransport * start(int * argc, char *** argv);
+    virtual ~MpiTransport();
+    virtual int rank() const { return _rank; }
+    virtual int size() const { return _size; }
+    virtual bool send(int to, void const * data, size_t bytes);
+    virtual bool receive(int from, void * data, size_t bytes);
+    virtual int receive_any(void * data, size_t bytes);
+    virtual bool sum(double * values, int count);
+
+private:
+    MpiTransport();
+    MpiTransport(MpiTransport const &);
+    MpiTransport & operator=(MpiTransport const &);
+
+    int _rank;
+    int _size;
+};
+#endif
+
+/*
+ * Hands out the indices 0 to count - 1 over the ranks as they ask for
+ * them, so that many small tasks of uneven cost (sweep members, image
+ * files) keep every process busy. Rank 0 serves the others from a
+ * thread and works through the same queue; next returns -1 once
+ * everything has been handed out. The transport must not be used for
+ * anything else until the queue is destroyed; a rank may destroy it
+ * before then to stop taking work. Destroying it waits for every rank
+ * to be done with it.
+ */
+class WorkQueue
+{
+public:
+    WorkQueue(Transport & transport, int count);
+    ~WorkQueue();
+    int next();
+
+private:
+    WorkQueue(WorkQueue const &);
+    WorkQueue & operator=(WorkQueue const &);
+    void serve();
+
+    Transport & _transport;
+    int _count;
+    std::atomic<int> _next;  // rank 0 only
+    bool _done;
+    std::thread _server;
+};
+
+}  // namespace Fem
+
+#endif  // __TRANSPORT_H
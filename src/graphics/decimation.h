@@ -0,0 +1,292 @@
+#ifndef __DECIMATION_H
+#define __DECIMATION_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+/*
+ * Min/max decimation pyramid of a 1D solution, for drawing meshes with
+ * far more nodes than there are pixels on screen.
+ *
+ * Level 0 holds the nodes themselves. Every coarser level splits the
+ * previous one into groups of four entries and keeps only the smallest
+ * and largest u of each group, at their own x and in node order. So
+ * the entries of level k (k > 0) each summarize 2^k nodes, and drawing
+ * a level whose bucket of 2^(k+1) nodes is about one pixel column wide
+ * still shows the full envelope of the solution, with a vertex count
+ * proportional to the screen width rather than the mesh size.
+ *
+ * All levels are stored back to back in x and u, so that the whole
+ * pyramid can be uploaded once and each level drawn as a sub range.
+ */
+class DecimationPyramid
+{
+public:
+    enum { GROUP = 4, MIN_LEVEL_SIZE = 64 };
+
+    struct Level
+    {
+        Level(int o = 0, int s = 0, int b = 1) : offset(o), size(s), bucket(b) {}
+        int offset;  // index of the level's first entry in x and u
+        int size;    // number of entries
+        int bucket;  // nodes covered by each min/max pair, 1 on level 0
+    };
+
+    DecimationPyramid()
+    : u_min(0.f)
+    , u_max(0.f)
+    , nodes(0)
+    , x_first(0.f)
+    , x_last(0.f)
+    , _first_level(0)
+    , _kept_from(0)
+    , _size_hint(0)
+    {}
+
+    template <typename precision>
+    void build(precision const * xs, precision const * us, int size)
+    {
+        assert(xs);
+        assert(us);
+
+        begin(0, size);
+        append(xs, us, size);
+        finish();
+    }
+
+    /*
+     * Incremental build from nodes that arrive in chunks, in order:
+     * begin, append as often as needed, then finish. Levels finer than
+     * first_level are not kept (unless there are fewer levels), so a
+     * pyramid of a solution far too large for memory needs only about
+     * size / 2^(first_level - 1) entries; select_level then picks among
+     * the kept levels. size_hint, the expected number of nodes if
+     * known, saves reallocations.
+     */
+    void begin(int first_level = 0, int size_hint = 0)
+    {
+        assert(first_level >= 0);
+        clear();
+        nodes = 0;
+        _first_level = first_level;
+        _kept_from = 0;
+        _size_hint = size_hint;
+        _x.clear();
+        _u.clear();
+        _done.clear();
+        _sizes.clear();
+        add_level(0);
+    }
+
+    template <typename precision>
+    void append(precision const * xs, precision const * us, int count)
+    {
+        assert(count == 0 || (xs && us));
+        if (count == 0)
+            return;
+
+        size_t const offset = _x[0].size();
+        _x[0].insert(_x[0].end(), xs, xs + count);
+        _u[0].insert(_u[0].end(), us, us + count);
+        if (nodes == 0)
+        {
+            u_min = u_max = _u[0][offset];
+            x_first = _x[0][offset];
+        }
+        for (size_t i = offset; i < _u[0].size(); ++i)
+        {
+            u_min = std::min(u_min, _u[0][i]);
+            u_max = std::max(u_max, _u[0][i]);
+        }
+        x_last = _x[0].back();
+        nodes += count;
+        _sizes[0] += count;
+
+        reduce(false);
+    }
+
+    void finish()
+    {
+        // the partial groups at the ends are only reduced now
+        reduce(true);
+
+        // coarser levels are made while the last one has more
+        // than MIN_LEVEL_SIZE entries
+        int last = 0;
+        while (_sizes[last] > MIN_LEVEL_SIZE)
+            ++last;
+
+        // the finest level is the largest, take it over rather than copy it
+        int const first = std::min(_first_level, last);
+        if (nodes > 0)
+        {
+            assert(first >= _kept_from);
+            size_t total = 0;
+            for (int k = first; k <= last; ++k)
+                total += _x[k].size();
+            x.swap(_x[first]);
+            u.swap(_u[first]);
+            x.reserve(total);
+            u.reserve(total);
+            levels.push_back(Level(0, (int) x.size(), first == 0 ? 1 : 2 << first));
+            for (int k = first + 1; k <= last; ++k)
+            {
+                levels.push_back(Level((int) x.size(), (int) _x[k].size(), 2 << k));
+                x.insert(x.end(), _x[k].begin(), _x[k].end());
+                u.insert(u.end(), _u[k].begin(), _u[k].end());
+            }
+        }
+        _x.clear();
+        _u.clear();
+        _done.clear();
+        _sizes.clear();
+    }
+
+    void clear()
+    {
+        levels.clear();
+        x.clear();
+        u.clear();
+    }
+
+    int size() const
+    {
+        return (int) x.size();
+    }
+
+    /*
+     * Coarsest level whose buckets are no wider than the given
+     * number of nodes per pixel column.
+     */
+    int select_level(float nodes_per_pixel) const
+    {
+        int res = 0;
+        for (int i = 1; i < (int) levels.size(); ++i)
+        {
+            if (levels[i].bucket <= nodes_per_pixel)
+                res = i;
+        }
+        return res;
+    }
+
+    /*
+     * Entries of a level that lie in [xmin, xmax], plus one on either
+     * side, so that lines leaving the visible range are still drawn.
+     */
+    void visible_range(int level, float xmin, float xmax, int * first, int * count) const
+    {
+        assert(level >= 0 && level < (int) levels.size());
+        assert(first);
+        assert(count);
+
+        Level const & l = levels[level];
+        std::vector<float>::const_iterator begin = x.begin() + l.offset;
+        std::vector<float>::const_iterator end = begin + l.size;
+        int lo = (int) (std::lower_bound(begin, end, xmin) - begin);
+        int hi = (int) (std::upper_bound(begin, end, xmax) - begin);
+        lo = std::max(lo - 1, 0);
+        hi = std::min(hi + 1, l.size);
+        *first = l.offset + lo;
+        *count = std::max(hi - lo, 0);
+    }
+
+    std::vector<Level> levels;
+    std::vector<float> x;
+    std::vector<float> u;
+    float u_min, u_max;
+    int nodes;              // at level 0, kept or not
+    float x_first, x_last;  // of the nodes
+
+private:
+    void add_level(int level)
+    {
+        while ((int) _x.size() <= level)
+        {
+            _x.push_back(std::vector<float>());
+            _u.push_back(std::vector<float>());
+            _done.push_back(0);
+            _sizes.push_back(0);
+
+            // the coarser levels add up to about as many entries as
+            // level 0, and finish appends them to the first kept one
+            int const k = (int) _x.size() - 1;
+            if (_size_hint > 0 && k >= _first_level)
+            {
+                size_t const size = k == 0 ? (size_t) _size_hint : (_size_hint >> (k - 1)) + GROUP;
+                _x.back().reserve(k == _first_level ? 2 * size : size);
+                _u.back().reserve(k == _first_level ? 2 * size : size);
+            }
+        }
+    }
+
+    /*
+     * Groups the entries of every level that arrived since the last
+     * call into the next level, whole groups only unless final.
+     */
+    void reduce(bool final)
+    {
+        for (int k = 0; k < (int) _x.size(); ++k)
+        {
+            size_t const size = _x[k].size();
+            size_t end = size - (size - _done[k]) % GROUP;
+            if (final && _sizes[k] > MIN_LEVEL_SIZE)
+                end = size;
+            if (end > _done[k])
+            {
+                add_level(k + 1);
+                std::vector<float> const & src_x = _x[k];
+                std::vector<float> const & src_u = _u[k];
+                std::vector<float> & dst_x = _x[k + 1];
+                std::vector<float> & dst_u = _u[k + 1];
+                size_t const before = dst_x.size();
+                for (size_t begin = _done[k]; begin < end; begin += GROUP)
+                {
+                    size_t const group_end = std::min(begin + GROUP, end);
+                    size_t lo = begin;
+                    size_t hi = begin;
+                    for (size_t i = begin + 1; i < group_end; ++i)
+                    {
+                        if (src_u[i] < src_u[lo])
+                            lo = i;
+                        if (src_u[i] > src_u[hi])
+                            hi = i;
+                    }
+
+                    // keep node order, so the level still draws as a line strip
+                    size_t const first = std::min(lo, hi);
+                    size_t const second = std::max(lo, hi);
+                    dst_x.push_back(src_x[first]);
+                    dst_u.push_back(src_u[first]);
+                    if (second != first)
+                    {
+                        dst_x.push_back(src_x[second]);
+                        dst_u.push_back(src_u[second]);
+                    }
+                }
+                _sizes[k + 1] += dst_x.size() - before;
+                _done[k] = end;
+            }
+
+            // once the next level is certain to be made, this one is only
+            // needed at or above first_level, else just its ungrouped tail
+            if (k == _kept_from && k < _first_level && _sizes[k] > MIN_LEVEL_SIZE)
+                ++_kept_from;
+            if (k < _kept_from && _done[k] > 0)
+            {
+                _x[k].erase(_x[k].begin(), _x[k].begin() + _done[k]);
+                _u[k].erase(_u[k].begin(), _u[k].begin() + _done[k]);
+                _done[k] = 0;
+            }
+        }
+    }
+
+    int _first_level;
+    int _kept_from;                             // finest level stored whole
+    int _size_hint;                             // expected nodes, 0 if unknown
+    std::vector< std::vector<float> > _x, _u;  // per level while building
+    std::vector<size_t> _done;                  // entries grouped into the next level
+    std::vector<size_t> _sizes;                 // entries per level, kept or not
+};
+
+#endif  // __DECIMATION_H
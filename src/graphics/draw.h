@@ -1,14 +1,23 @@
 #ifndef __DRAW_H
 #define __DRAW_H
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 #include <Eigen/Dense>
 
+#include "arena.h"
+#include "decimation.h"
+#include "element.h"
+#include "render_queue.h"
 #include "shader.h"
 
 using Eigen::Matrix;
 
 typedef VertexColorShaderProgram::Vertex Vertex;
 typedef VertexColorShaderProgram::GpuAsset GpuAsset;
+typedef VertexColorShaderProgram::FieldAsset FieldAsset;
 
 static inline void draw_triangle(VertexColorShaderProgram * program)
 {
@@ -32,82 +41,464 @@ static inline void draw_triangle(VertexColorShaderProgram * program)
     program->gpu_draw_triangles(ga);
 }
 
-static inline void draw_grid(VertexColorShaderProgram * program)
+/*
+ * Grid lines currently uploaded for draw_grid. The lines cover a region
+ * around the visible one, so that panning and zooming mostly just move
+ * the drawn sub ranges around in the same buffer. Vertical lines come
+ * first, ordered by x, then the horizontal ones, ordered by y.
+ */
+class GridRenderCache
+{
+public:
+    GridRenderCache()
+    : program(NULL)
+    , lines(NULL)
+    , step_x(0.f)
+    , step_y(0.f)
+    , ix0(0), ix1(-1), iy0(0), iy1(-1)
+    {}
+    ~GridRenderCache()
+    {
+        release();
+    }
+    void release()
+    {
+        if (program)
+        {
+            program->gpu_destroy_asset(lines);
+        }
+        program = NULL;
+        lines = NULL;
+    }
+
+    VertexColorShaderProgram * program;
+    GpuAsset * lines;
+    float step_x, step_y;    // spacing between lines
+    int ix0, ix1, iy0, iy1;  // uploaded lines, in multiples of the spacing
+
+private:
+    GridRenderCache(GridRenderCache const &);
+    GridRenderCache & operator=(GridRenderCache const &);
+};
+
+/*
+ * Unit spacing, coarsened by powers of ten when
+ * zoomed out far enough to crowd the screen.
+ */
+static inline float grid_step(float span)
+{
+    float const max_lines = 200.f;
+    float step = 1.f;
+    while (span / step > max_lines)
+        step *= 10.f;
+    return step;
+}
+
+/*
+ * Infinite background grid, generated for the visible part of the plane.
+ * With a queue the lines are queued on the background layer instead of
+ * being drawn right away. The vertices are built in arena when given.
+ */
+static inline void draw_grid(GridRenderCache & cache,
+                             VertexColorShaderProgram * program,
+                             RenderView const & view = RenderView(),
+                             RenderQueue * queue = NULL,
+                             Fem::Arena * arena = NULL)
 {
     assert(program);
 
-    static GpuAsset * ga = NULL;
-    if (!ga)
+    float xmin = -100.f, xmax = 100.f, ymin = -100.f, ymax = 100.f;
+    if (view.is_known())
     {
-        std::vector<Vertex> vertices;
-        for (int i = -100; i <= 100; ++i)
+        xmin = view.xmin;
+        xmax = view.xmax;
+        ymin = view.ymin;
+        ymax = view.ymax;
+    }
+
+    float const step_x = grid_step(xmax - xmin);
+    float const step_y = grid_step(ymax - ymin);
+    int const vx0 = (int) std::floor(xmin / step_x);
+    int const vx1 = (int) std::ceil(xmax / step_x);
+    int const vy0 = (int) std::floor(ymin / step_y);
+    int const vy1 = (int) std::ceil(ymax / step_y);
+
+    bool const stale = cache.program != program
+                    || cache.step_x != step_x || cache.step_y != step_y
+                    || vx0 < cache.ix0 || vx1 > cache.ix1
+                    || vy0 < cache.iy0 || vy1 > cache.iy1;
+    if (stale)
+    {
+        // cover the visible lines plus as many again on every side
+        cache.step_x = step_x;
+        cache.step_y = step_y;
+        cache.ix0 = vx0 - (vx1 - vx0);
+        cache.ix1 = vx1 + (vx1 - vx0);
+        cache.iy0 = vy0 - (vy1 - vy0);
+        cache.iy1 = vy1 + (vy1 - vy0);
+
+        float const x0 = cache.ix0 * step_x, x1 = cache.ix1 * step_x;
+        float const y0 = cache.iy0 * step_y, y1 = cache.iy1 * step_y;
+        Fem::ArenaScope scope(arena);
+        std::vector< Vertex, Fem::ArenaAllocator<Vertex> > vertices((Fem::ArenaAllocator<Vertex>(arena)));
+        vertices.reserve(2 * (cache.ix1 - cache.ix0 + 1) + 2 * (cache.iy1 - cache.iy0 + 1));
+        for (int i = cache.ix0; i <= cache.ix1; ++i)
+        {
+            float c = i == 0 ? 1.f : 0.5f;  // axes are brighter
+            vertices.push_back(Vertex( i * step_x, y0, 0, 1.f, c, c, c, 1.f));
+            vertices.push_back(Vertex( i * step_x, y1, 0, 1.f, c, c, c, 1.f));
+        }
+        for (int i = cache.iy0; i <= cache.iy1; ++i)
         {
-            vertices.push_back(Vertex( -100.f, 1.f*i, 0, 1.f, 0.5f, 0.5f, 0.5f, 1.f));
-            vertices.push_back(Vertex( 100.f, 1.f*i,  0, 1.f, 0.5f, 0.5f, 0.5f, 1.f));
-            vertices.push_back(Vertex( 1.f*i, -100.f, 0, 1.f, 0.5f, 0.5f, 0.5f, 1.f));
-            vertices.push_back(Vertex( 1.f*i, 100.f,  0, 1.f, 0.5f, 0.5f, 0.5f, 1.f));
+            float c = i == 0 ? 1.f : 0.5f;
+            vertices.push_back(Vertex( x0, i * step_y, 0, 1.f, c, c, c, 1.f));
+            vertices.push_back(Vertex( x1, i * step_y, 0, 1.f, c, c, c, 1.f));
         }
-        vertices.push_back(Vertex( -100.f, 0.f, 0, 1.f, 1.f, 1.f, 1.f, 1.f));
-        vertices.push_back(Vertex( 100.f, 0.f,  0, 1.f, 1.f, 1.f, 1.f, 1.f));
-        vertices.push_back(Vertex( 0.f, -100.f, 0, 1.f, 1.f, 1.f, 1.f, 1.f));
-        vertices.push_back(Vertex( 0.f, 100.f,  0, 1.f, 1.f, 1.f, 1.f, 1.f));
 
-        ga = program->gpu_create_asset(vertices);
+        if (cache.program != program)
+        {
+            cache.release();
+            cache.program = program;
+            cache.lines = program->gpu_create_asset(vertices.data(), (int) vertices.size());
+        }
+        else
+        {
+            program->gpu_update_asset(cache.lines, vertices.data(), (int) vertices.size());
+        }
     }
-    assert(ga);
+    assert(cache.lines);
 
-    program->gpu_draw_lines(ga);
+    int const vertical = 2 * (cache.ix1 - cache.ix0 + 1);
+    if (queue)
+    {
+        queue->draw_lines(cache.lines, 2 * (vx0 - cache.ix0), 2 * (vx1 - vx0 + 1), RenderQueue::BACKGROUND);
+        queue->draw_lines(cache.lines, vertical + 2 * (vy0 - cache.iy0), 2 * (vy1 - vy0 + 1), RenderQueue::BACKGROUND);
+        return;
+    }
+    program->gpu_draw_lines(cache.lines, 2 * (vx0 - cache.ix0), 2 * (vx1 - vx0 + 1));
+    program->gpu_draw_lines(cache.lines, vertical + 2 * (vy0 - cache.iy0), 2 * (vy1 - vy0 + 1));
 }
 
-template <typename precision, int rows>
-void draw_mesh_1D(Matrix<precision, rows, 1> const & x,
-                  Matrix<precision, rows, 1> const & u,
-                  VertexColorShaderProgram * program)
+/*
+ * Curve and optionally heights of a field asset, queued on the content
+ * layer when a queue is given.
+ */
+static inline void draw_field(FieldAsset const * field,
+                              VertexColorShaderProgram * program,
+                              int first, int count,
+                              RenderQueue * queue = NULL,
+                              bool heights = true)
 {
-    assert(program);
+    if (queue)
+    {
+        queue->draw_field_curve(field, first, count);
+        if (heights)
+            queue->draw_field_heights(field, first, count);
+        return;
+    }
+    program->gpu_draw_field_curve(field, first, count);
+    if (heights)
+        program->gpu_draw_field_heights(field, first, count);
+}
 
-    precision max = u(0);
-    precision min = u(0);
-    for (unsigned i = 0; i < rows; ++i)
+/*
+ * Non-owning handle to a 1D solution (node coordinates x and state u).
+ * Whoever owns the data calls touch() after changing x or u, which bumps
+ * the version and tells renderers that their cached vertices are stale.
+ *
+ * A handle may also refer to a sweep: several solutions on the same
+ * nodes, with u holding one column of size values per instance.
+ */
+template <typename precision>
+class SolutionHandle1D
+{
+public:
+    SolutionHandle1D()
+    : _x(NULL)
+    , _u(NULL)
+    , _size(0)
+    , _instances(1)
+    , _version(0)
+    {}
+    template <int rows>
+    void set(Matrix<precision, rows, 1> const & x, Matrix<precision, rows, 1> const & u)
+    {
+        assert(x.size() == u.size());
+        set(x.data(), u.data(), (int) x.size());
+    }
+    template <int rows, int cols>
+    void set(Matrix<precision, rows, 1> const & x, Matrix<precision, rows, cols> const & u)
+    {
+        assert(x.size() == u.rows());
+        set(x.data(), u.data(), (int) x.size(), (int) u.cols());
+    }
+    void set(precision const * x, precision const * u, int size, int instances = 1)
+    {
+        assert(instances >= 1);
+        _x = x;
+        _u = u;
+        _size = size;
+        _instances = instances;
+        touch();
+    }
+    void touch()
     {
-        if (max < u(i))
-            max = u(i);
-        if (min > u(i))
-            min = u(i);
+        ++_version;
     }
+    precision const * x() const { return _x; }
+    precision const * u() const { return _u; }
+    int size() const { return _size; }
+    int instances() const { return _instances; }
+    unsigned long version() const { return _version; }
+
+private:
+    precision const * _x;
+    precision const * _u;
+    int _size;
+    int _instances;
+    unsigned long _version;
+};
 
-    std::vector<Vertex> curve_vertices;
-    curve_vertices.reserve(rows);
-    for (unsigned i = 0; i < rows; ++i)
+/*
+ * Per-instance gpu asset of a drawn 1D mesh, along with the solution
+ * version it was built from. Must be destroyed while the program
+ * (and its gl context) that created the asset is still alive.
+ */
+class Mesh1DRenderCache
+{
+public:
+    explicit Mesh1DRenderCache(bool streaming_ = false)
+    : streaming(streaming_)
+    , program(NULL)
+    , field(NULL)
+    , source(NULL)
+    , version(0)
+    {}
+    ~Mesh1DRenderCache()
     {
-        precision ui = (u(i) - min) / (max - min);
-        curve_vertices.push_back(Vertex(x(i), u(i), 0.f, 1.f, ui, 0.f, 1.f - ui, 1.f));
+        release();
     }
+    void release()
+    {
+        if (program)
+        {
+            program->gpu_destroy_field_asset(field);
+        }
+        program = NULL;
+        field = NULL;
+        pyramid.clear();
+        source = NULL;
+        version = 0;
+    }
+
+    bool streaming;              // set for solutions that change every frame
+    VertexColorShaderProgram * program;
+    FieldAsset * field;
+    DecimationPyramid pyramid;   // only built for large meshes
+    std::vector<float> staging;  // conversion buffer for non-float solutions
+    void const * source;         // handle the asset was built from
+    unsigned long version;       // version of that handle
+
+private:
+    Mesh1DRenderCache(Mesh1DRenderCache const &);
+    Mesh1DRenderCache & operator=(Mesh1DRenderCache const &);
+};
+
+/*
+ * Returns the values as floats, converting through the
+ * staging buffer only when they aren't floats already.
+ */
+template <typename precision>
+float const * as_floats(precision const * values, int size, std::vector<float> & staging)
+{
+    staging.assign(values, values + size);
+    return staging.data();
+}
 
-    std::vector<Vertex> height_vertices;
-    height_vertices.reserve(2*rows);
-    for (unsigned i = 0; i < rows; ++i)
+inline float const * as_floats(float const * values, int, std::vector<float> &)
+{
+    return values;
+}
+
+/*
+ * True if the nodes are equally spaced (to float precision),
+ * in which case they can be reconstructed from x0 and dx.
+ */
+template <typename precision>
+bool is_uniform_mesh(precision const * x, int size)
+{
+    if (size < 2)
+        return true;
+
+    precision const dx = (x[size - 1] - x[0]) / (size - 1);
+    precision const tolerance = (precision) 1.0e-6 * (std::abs(x[0]) + std::abs(x[size - 1]) + std::abs(dx));
+    for (int i = 1; i < size; ++i)
     {
-        precision ui = (u(i) - min) / (max - min);
-        height_vertices.push_back(Vertex(x(i), 0.f, 0.f, 1.f, ui, 0.f, 1.f - ui, 1.f));
-        height_vertices.push_back(Vertex(x(i), u(i), 0.f, 1.f, ui, 0.f, 1.f - ui, 1.f));
+        if (std::abs(x[i] - (x[0] + i * dx)) > tolerance)
+            return false;
     }
+    return true;
+}
 
-    static GpuAsset * ga_curve = NULL;
-    static GpuAsset * ga_heights = NULL;
-    if (!ga_curve || !ga_heights)
+/*
+ * Meshes with at least this many nodes are drawn through a decimation
+ * pyramid, which costs about twice the memory but keeps the number of
+ * vertices drawn proportional to the screen width.
+ */
+static int const DECIMATION_THRESHOLD = 8192;
+
+/*
+ * Draws the level of an uploaded pyramid with about one min/max pair
+ * per pixel column, and only the part of it that is on screen.
+ */
+static inline void draw_decimated(DecimationPyramid const & pyramid,
+                                  FieldAsset * field,
+                                  VertexColorShaderProgram * program,
+                                  RenderView const & view,
+                                  RenderQueue * queue)
+{
+    int level = 0;
+    int first = pyramid.levels[0].offset;
+    int count = pyramid.levels[0].size;
+    if (view.is_known())
     {
-        ga_curve = program->gpu_create_asset(curve_vertices);
-        ga_heights = program->gpu_create_asset(height_vertices);
+        float const length = pyramid.x_last - pyramid.x_first;
+        float const nodes_per_unit = length > 0.f ? (pyramid.nodes - 1) / length : 0.f;
+        level = pyramid.select_level(nodes_per_unit / view.pixels_per_unit_x);
+        pyramid.visible_range(level, view.xmin, view.xmax, &first, &count);
     }
-    else
+
+    draw_field(field, program, first, count, queue);
+}
+
+template <typename precision>
+void draw_mesh_1D(SolutionHandle1D<precision> const & solution,
+                  Mesh1DRenderCache & cache,
+                  VertexColorShaderProgram * program,
+                  RenderView const & view = RenderView(),
+                  RenderQueue * queue = NULL)
+{
+    assert(program);
+
+    int const size = solution.size();
+    int const instances = solution.instances();
+    if (size == 0)
+        return;
+
+    // re-upload only when the solution changed since the last time
+    bool const stale = cache.program != program
+                    || cache.source != &solution
+                    || cache.version != solution.version();
+    if (stale)
     {
-        program->gpu_update_asset(ga_curve, curve_vertices);
-        program->gpu_update_asset(ga_heights, height_vertices);
+        if (cache.program != program)
+        {
+            cache.release();
+            cache.program = program;
+            cache.field = program->gpu_create_field_asset(cache.streaming);
+        }
+
+        precision const * x = solution.x();
+        precision const * u = solution.u();
+
+        // sweeps are drawn at full detail, one pyramid per instance
+        // would cost more than the vertices it saves
+        if (instances == 1 && size >= DECIMATION_THRESHOLD)
+        {
+            // upload every level at once, levels are picked at draw time
+            cache.pyramid.build(x, u, size);
+            cache.field->u_min = cache.pyramid.u_min;
+            cache.field->u_max = cache.pyramid.u_max;
+            program->gpu_update_field_asset(cache.field, cache.pyramid.x.data(),
+                                            cache.pyramid.u.data(), cache.pyramid.size());
+        }
+        else
+        {
+            cache.pyramid.clear();
+
+            precision max = u[0];
+            precision min = u[0];
+            for (int i = 0; i < size * instances; ++i)
+            {
+                if (max < u[i])
+                    max = u[i];
+                if (min > u[i])
+                    min = u[i];
+            }
+            cache.field->u_min = min;
+            cache.field->u_max = max;
+
+            // only u is uploaded on uniform meshes, x is
+            // reconstructed in the vertex shader
+            if (is_uniform_mesh(x, size))
+            {
+                float dx = size > 1 ? (x[size - 1] - x[0]) / (size - 1) : 0.f;
+                program->gpu_update_field_asset(cache.field, x[0], dx,
+                                                as_floats(u, size * instances, cache.staging), size, instances);
+            }
+            else
+            {
+                std::vector<float> x_staging;
+                program->gpu_update_field_asset(cache.field, as_floats(x, size, x_staging),
+                                                as_floats(u, size * instances, cache.staging), size, instances);
+            }
+        }
+        cache.source = &solution;
+        cache.version = solution.version();
+    }
+
+    if (cache.pyramid.levels.empty())
+    {
+        // nodes on screen, plus one on either side
+        int first = 0;
+        int count = size;
+        if (view.is_known())
+        {
+            precision const * x = solution.x();
+            int lo = (int) (std::lower_bound(x, x + size, (precision) view.xmin) - x);
+            int hi = (int) (std::upper_bound(x, x + size, (precision) view.xmax) - x);
+            first = std::max(lo - 1, 0);
+            count = std::max(std::min(hi + 1, size) - first, 0);
+        }
+        // height lines of a whole sweep would only clutter the curves
+        draw_field(cache.field, program, first, count, queue, instances == 1);
+        return;
+    }
+
+    draw_decimated(cache.pyramid, cache.field, program, view, queue);
+}
+
+/*
+ * Draws a pyramid built elsewhere, e.g. incrementally from a file
+ * too large to load, through the render cache. It is uploaded on the
+ * first draw; after rebuilding it in place set cache.source to NULL.
+ */
+static inline void draw_pyramid_1D(DecimationPyramid const & pyramid,
+                                   Mesh1DRenderCache & cache,
+                                   VertexColorShaderProgram * program,
+                                   RenderView const & view = RenderView(),
+                                   RenderQueue * queue = NULL)
+{
+    assert(program);
+
+    if (pyramid.levels.empty())
+        return;
+
+    if (cache.program != program || cache.source != &pyramid)
+    {
+        if (cache.program != program)
+        {
+            cache.release();
+            cache.program = program;
+            cache.field = program->gpu_create_field_asset(cache.streaming);
+        }
+        cache.field->u_min = pyramid.u_min;
+        cache.field->u_max = pyramid.u_max;
+        program->gpu_update_field_asset(cache.field, pyramid.x.data(), pyramid.u.data(), pyramid.size());
+        cache.source = &pyramid;
     }
 
-    program->gpu_draw_line_strip(ga_curve);
-    program->gpu_draw_lines(ga_heights);
+    draw_decimated(pyramid, cache.field, program, view, queue);
 }
 
 #endif  // __DRAW_H
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include "image.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+#ifdef ARC_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+bool write_ppm(Image const & image, char const * path)
+{
+    FILE * file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Error: could not open %s for writing\n", path);
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", image.width, image.height);
+    std::vector<unsigned char> rgb(3 * image.width);
+    bool ok = true;
+    for (int y = 0; y < image.height && ok; ++y)
+    {
+        unsigned char const * src = image.row(y);
+        for (int x = 0; x < image.width; ++x)
+        {
+            rgb[3 * x + 0] = src[4 * x + 0];
+            rgb[3 * x + 1] = src[4 * x + 1];
+            rgb[3 * x + 2] = src[4 * x + 2];
+        }
+        ok = fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+    }
+
+    return fclose(file) == 0 && ok;
+}
+
+// built during static initialization, so writers on several threads can share it
+static struct Crc32Table
+{
+    Crc32Table()
+    {
+        for (unsigned long n = 0; n < 256; ++n)
+        {
+            unsigned long c = n;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+            values[n] = c;
+        }
+    }
+    unsigned long values[256];
+} const crc32_table;
+
+static unsigned long crc32_update(unsigned long crc, unsigned char const * data, size_t size)
+{
+    crc ^= 0xffffffffUL;
+    for (size_t i = 0; i < size; ++i)
+        crc = crc32_table.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffUL;
+}
+
+static void put_u32(std::vector<unsigned char> & out, unsigned long value)
+{
+    out.push_back((unsigned char) (value >> 24));
+    out.push_back((unsigned char) (value >> 16));
+    out.push_back((unsigned char) (value >> 8));
+    out.push_back((unsigned char) value);
+}
+
+static bool write_png_chunk(FILE * file, char const * type, std::vector<unsigned char> const & data)
+{
+    std::vector<unsigned char> chunk;
+    chunk.reserve(data.size() + 12);
+    put_u32(chunk, (unsigned long) data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    put_u32(chunk, crc32_update(0, &chunk[4], data.size() + 4));
+    return fwrite(chunk.data(), 1, chunk.size(), file) == chunk.size();
+}
+
+/*
+ * A zlib stream of stored (uncompressed) deflate blocks, which needs
+ * no zlib to write.
+ */
+static void store_zlib(std::vector<unsigned char> const & raw, std::vector<unsigned char> & data)
+{
+    size_t const max_block = 65535;
+    data.clear();
+    data.reserve(raw.size() + 5 * (raw.size() / max_block + 1) + 6);
+    data.push_back(0x78);
+    data.push_back(0x01);
+    size_t offset = 0;
+    do
+    {
+        size_t const size = raw.size() - offset < max_block ? raw.size() - offset : max_block;
+        bool const last = offset + size == raw.size();
+        data.push_back(last ? 1 : 0);
+        data.push_back((unsigned char) size);
+        data.push_back((unsigned char) (size >> 8));
+        data.push_back((unsigned char) ~size);
+        data.push_back((unsigned char) (~size >> 8));
+        data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + size);
+        offset += size;
+    } while (offset < raw.size());
+
+    unsigned long a = 1, b = 0;
+    for (size_t i = 0; i < raw.size(); ++i)
+    {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_u32(data, (b << 16) | a);
+}
+
+#ifdef ARC_HAVE_ZLIB
+// a compressed zlib stream, false if zlib fails
+static bool deflate_zlib(std::vector<unsigned char> const & raw, std::vector<unsigned char> & data)
+{
+    uLongf size = compressBound((uLong) raw.size());
+    data.resize(size);
+    if (compress2(data.data(), &size, raw.data(), (uLong) raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+        return false;
+    data.resize(size);
+    return true;
+}
+#endif
+
+bool write_png(Image const & image, char const * path)
+{
+    FILE * file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Error: could not open %s for writing\n", path);
+        return false;
+    }
+
+    static unsigned char const signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    bool ok = fwrite(signature, 1, sizeof(signature), file) == sizeof(signature);
+
+    std::vector<unsigned char> header;
+    put_u32(header, image.width);
+    put_u32(header, image.height);
+    header.push_back(8);  // bit depth
+    header.push_back(6);  // truecolor with alpha
+    header.push_back(0);  // deflate
+    header.push_back(0);  // adaptive filtering, only filter type 0 is used
+    header.push_back(0);  // no interlacing
+    ok = ok && write_png_chunk(file, "IHDR", header);
+
+    // scanlines, each prefixed by its filter type
+    size_t const stride = 4 * image.width + 1;
+    std::vector<unsigned char> raw(stride * image.height);
+    for (int y = 0; y < image.height; ++y)
+    {
+        raw[stride * y] = 0;
+        if (image.width > 0)
+            memcpy(&raw[stride * y + 1], image.row(y), stride - 1);
+    }
+
+    std::vector<unsigned char> data;
+#ifdef ARC_HAVE_ZLIB
+    if (!deflate_zlib(raw, data))
+#endif
+        store_zlib(raw, data);
+
+    ok = ok && write_png_chunk(file, "IDAT", data);
+    ok = ok && write_png_chunk(file, "IEND", std::vector<unsigned char>());
+
+    return fclose(file) == 0 && ok;
+}
+
+bool write_image(Image const & image, char const * path)
+{
+    std::string const name(path);
+    std::string::size_type const dot = name.rfind('.');
+    if (dot != std::string::npos)
+    {
+        std::string extension = name.substr(dot + 1);
+        for (size_t i = 0; i < extension.size(); ++i)
+            extension[i] = (char) tolower(extension[i]);
+        if (extension == "ppm")
+            return write_ppm(image, path);
+    }
+    return write_png(image, path);
+}
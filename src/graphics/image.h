@@ -0,0 +1,45 @@
+#ifndef __IMAGE_H
+#define __IMAGE_H
+
+#include <string>
+#include <vector>
+
+/*
+ * 8 bit RGBA pixels, rows stored top to bottom.
+ */
+struct Image
+{
+    Image() : width(0), height(0) {}
+    Image(int w, int h) : width(w), height(h), pixels(4 * w * h) {}
+
+    unsigned char * row(int y)
+    {
+        return &pixels[4 * width * y];
+    }
+    unsigned char const * row(int y) const
+    {
+        return &pixels[4 * width * y];
+    }
+
+    int width, height;
+    std::vector<unsigned char> pixels;
+};
+
+/*
+ * Binary PPM (P6), alpha is dropped.
+ */
+bool write_ppm(Image const & image, char const * path);
+
+/*
+ * Truecolor PNG with alpha. The image data is compressed when built
+ * with zlib, and otherwise written as stored (uncompressed) deflate
+ * blocks, which need no dependencies.
+ */
+bool write_png(Image const & image, char const * path);
+
+/*
+ * Picks the format from the file extension, PNG unless it is .ppm.
+ */
+bool write_image(Image const & image, char const * path);
+
+#endif  // __IMAGE_H
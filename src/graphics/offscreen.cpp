@@ -0,0 +1,248 @@
+#include "offscreen.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef ARC_HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef ARC_HAVE_EGL
+static bool has_extension(char const * extensions, char const * name)
+{
+    if (!extensions)
+        return false;
+
+    size_t const length = strlen(name);
+    for (char const * p = strstr(extensions, name); p; p = strstr(p + length, name))
+    {
+        bool const starts = p == extensions || p[-1] == ' ';
+        bool const ends = p[length] == ' ' || p[length] == '\0';
+        if (starts && ends)
+            return true;
+    }
+    return false;
+}
+#endif
+
+OffscreenContext::OffscreenContext()
+: _backend("none")
+, _egl_display(NULL)
+, _egl_context(NULL)
+, _window(NULL)
+{
+    if (!create_egl_context() && !create_glfw_context())
+    {
+        fprintf(stderr, "Error: could not create an offscreen OpenGL context\n");
+        return;
+    }
+
+    // load opengl extensions (required)
+#ifdef ARC_HAVE_EGL
+    if (_egl_context)
+    {
+        gladLoadGLLoader((GLADloadproc) eglGetProcAddress);
+        return;
+    }
+#endif
+    gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+}
+
+OffscreenContext::~OffscreenContext()
+{
+#ifdef ARC_HAVE_EGL
+    if (_egl_context)
+    {
+        // the display is shared by all contexts of the process, so it is
+        // left initialized rather than terminated under their feet
+        eglMakeCurrent((EGLDisplay) _egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext((EGLDisplay) _egl_display, (EGLContext) _egl_context);
+    }
+#endif
+    if (_window)
+    {
+        glfwDestroyWindow(_window);
+        glfwTerminate();
+    }
+}
+
+bool OffscreenContext::is_valid() const
+{
+    return _egl_context || _window;
+}
+
+void OffscreenContext::make_current()
+{
+#ifdef ARC_HAVE_EGL
+    if (_egl_context)
+    {
+        eglMakeCurrent((EGLDisplay) _egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, (EGLContext) _egl_context);
+        return;
+    }
+#endif
+    if (_window)
+        glfwMakeContextCurrent(_window);
+}
+
+char const * OffscreenContext::get_backend() const
+{
+    return _backend;
+}
+
+bool OffscreenContext::create_egl_context()
+{
+#ifdef ARC_HAVE_EGL
+    // prefer mesa's surfaceless platform, which never touches a display
+    // server, over whatever the default display happens to be
+    EGLDisplay display = EGL_NO_DISPLAY;
+    char const * client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (has_extension(client_extensions, "EGL_MESA_platform_surfaceless"))
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display)
+            display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY)
+        return false;
+
+    EGLint major, minor;
+    if (!eglInitialize(display, &major, &minor))
+        return false;
+    if (!has_extension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context"))
+        return false;
+    if (!eglBindAPI(EGL_OPENGL_API))
+        return false;
+
+    EGLint const config_attributes[] = {
+        EGL_SURFACE_TYPE, EGL_DONT_CARE,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configs = 0;
+    if (!eglChooseConfig(display, config_attributes, &config, 1, &configs) || configs < 1)
+        return false;
+
+    EGLint const context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+    if (context == EGL_NO_CONTEXT)
+        return false;
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        eglDestroyContext(display, context);
+        return false;
+    }
+
+    _egl_display = display;
+    _egl_context = context;
+    _backend = "egl";
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Not to be mixed with a Window in the same process,
+ * the window system is terminated along with the context.
+ */
+bool OffscreenContext::create_glfw_context()
+{
+    if (!glfwInit())
+        return false;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    _window = glfwCreateWindow(1, 1, "", NULL, NULL);
+    if (!_window)
+    {
+        glfwTerminate();
+        return false;
+    }
+
+    glfwMakeContextCurrent(_window);
+    _backend = "glfw";
+    return true;
+}
+
+RenderTarget::RenderTarget(int width, int height)
+: _width(width)
+, _height(height)
+, _framebuffer(0)
+, _renderbuffer(0)
+, _complete(false)
+{
+    glGenRenderbuffers(1, &_renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, _renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _renderbuffer);
+    _complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (!_complete)
+        fprintf(stderr, "Error: incomplete %dx%d render target\n", width, height);
+}
+
+RenderTarget::~RenderTarget()
+{
+    glDeleteFramebuffers(1, &_framebuffer);
+    glDeleteRenderbuffers(1, &_renderbuffer);
+}
+
+bool RenderTarget::is_complete() const
+{
+    return _complete;
+}
+
+void RenderTarget::bind()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glViewport(0, 0, _width, _height);
+}
+
+void RenderTarget::unbind()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+int RenderTarget::get_width() const
+{
+    return _width;
+}
+
+int RenderTarget::get_height() const
+{
+    return _height;
+}
+
+void RenderTarget::read_pixels(Image & image)
+{
+    image = Image(_width, _height);
+    if (_width == 0 || _height == 0)
+        return;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, _framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    std::vector<unsigned char> pixels(4 * _width * _height);
+    glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+    // gl rows go bottom to top
+    for (int y = 0; y < _height; ++y)
+        memcpy(image.row(y), &pixels[4 * _width * (_height - 1 - y)], 4 * _width);
+}
@@ -0,0 +1,70 @@
+#ifndef __OFFSCREEN_H
+#define __OFFSCREEN_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "image.h"
+
+/*
+ * OpenGL 3.3 core context that needs no display. With EGL available
+ * (ARC_HAVE_EGL) it is a surfaceless EGL context, which works on headless
+ * machines and, through Mesa's llvmpipe, without any gpu at all. Otherwise
+ * it falls back to the context of a hidden GLFW window, which still needs
+ * a display server.
+ *
+ * Every context draws into framebuffer objects only, see RenderTarget.
+ * EGL contexts can be created on any thread, one per thread; the GLFW
+ * fallback is restricted to the main thread like Window.
+ */
+class OffscreenContext
+{
+public:
+    OffscreenContext();
+    ~OffscreenContext();
+    bool is_valid() const;
+    void make_current();
+    char const * get_backend() const;
+
+private:
+    OffscreenContext(OffscreenContext const &);
+    OffscreenContext & operator=(OffscreenContext const &);
+
+    bool create_egl_context();
+    bool create_glfw_context();
+
+    char const * _backend;
+    void * _egl_display;
+    void * _egl_context;
+    GLFWwindow * _window;
+};
+
+/*
+ * Framebuffer object with a single RGBA8 color renderbuffer.
+ */
+class RenderTarget
+{
+public:
+    RenderTarget(int width, int height);
+    ~RenderTarget();
+    bool is_complete() const;
+    void bind();
+    void unbind();
+    int get_width() const;
+    int get_height() const;
+
+    /*
+     * Copies the rendered pixels out, flipped to rows top to bottom.
+     */
+    void read_pixels(Image & image);
+
+private:
+    RenderTarget(RenderTarget const &);
+    RenderTarget & operator=(RenderTarget const &);
+
+    int _width, _height;
+    GLuint _framebuffer, _renderbuffer;
+    bool _complete;
+};
+
+#endif  // __OFFSCREEN_H
@@ -0,0 +1,206 @@
+#ifndef __RENDER_QUEUE_H
+#define __RENDER_QUEUE_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "shader.h"
+
+/*
+ * Draw commands collected from all elements during a RenderElementsEvent
+ * and submitted in one go afterwards. Submission sorts the commands by
+ * layer first, so the stacking of elements no longer depends on the order
+ * in which the event manager happens to call them, and then by gl state,
+ * so that every run of commands sharing an asset and primitive mode goes
+ * out as a single glMultiDrawArrays with one set of binds.
+ */
+class RenderQueue
+{
+public:
+    typedef VertexColorShaderProgram::GpuAsset GpuAsset;
+    typedef VertexColorShaderProgram::FieldAsset FieldAsset;
+
+    enum Layer { BACKGROUND = 0, CONTENT = 1, OVERLAY = 2 };
+
+    RenderQueue()
+    : _sequence(0)
+    , _draw_calls(0)
+    {}
+
+    void clear()
+    {
+        // keeps the capacity, the queue is refilled every frame
+        _commands.clear();
+        _sequence = 0;
+    }
+
+    bool empty() const
+    {
+        return _commands.empty();
+    }
+
+    int size() const
+    {
+        return (int) _commands.size();
+    }
+
+    void draw_triangles(GpuAsset const * ga, int first, int count, Layer layer = CONTENT)
+    {
+        push(Command::ASSET, layer, ga, ga->vao, GL_TRIANGLES, first, count);
+    }
+    void draw_lines(GpuAsset const * ga, int first, int count, Layer layer = CONTENT)
+    {
+        push(Command::ASSET, layer, ga, ga->vao, GL_LINES, first, count);
+    }
+    void draw_line_strip(GpuAsset const * ga, int first, int count, Layer layer = CONTENT)
+    {
+        push(Command::ASSET, layer, ga, ga->vao, GL_LINE_STRIP, first, count);
+    }
+
+    void draw_field_curve(FieldAsset const * fa, int first, int count, Layer layer = CONTENT)
+    {
+        push(Command::FIELD_CURVE, layer, fa, fa->u[0].tbo, GL_LINE_STRIP, first, count);
+    }
+    void draw_field_heights(FieldAsset const * fa, int first, int count, Layer layer = CONTENT)
+    {
+        push(Command::FIELD_HEIGHTS, layer, fa, fa->u[0].tbo, GL_LINES, first, count);
+    }
+
+    /*
+     * Issues all queued commands, merging runs with the same layer,
+     * asset and mode into one multi draw. The queue is left intact.
+     */
+    void submit(VertexColorShaderProgram * program)
+    {
+        assert(program);
+
+        _draw_calls = 0;
+        if (_commands.empty())
+            return;
+
+        _order.resize(_commands.size());
+        for (size_t i = 0; i < _commands.size(); ++i)
+            _order[i] = &_commands[i];
+        std::sort(_order.begin(), _order.end(), before);
+
+        size_t begin = 0;
+        while (begin < _order.size())
+        {
+            Command const & head = *_order[begin];
+            _firsts.clear();
+            _counts.clear();
+
+            size_t end = begin;
+            for (; end < _order.size() && same_state(head, *_order[end]); ++end)
+            {
+                Command const & c = *_order[end];
+                // contiguous ranges of separate primitives can share one entry,
+                // strips can not, as that would join their ends
+                if (head.mode != GL_LINE_STRIP && !_firsts.empty() &&
+                    _firsts.back() + _counts.back() == c.first)
+                {
+                    _counts.back() += c.count;
+                }
+                else
+                {
+                    _firsts.push_back(c.first);
+                    _counts.push_back(c.count);
+                }
+            }
+
+            int draws = (int) _firsts.size();
+            switch (head.kind)
+            {
+            case Command::ASSET:
+                _draw_calls += program->gpu_multi_draw(static_cast<GpuAsset const *>(head.asset), head.mode,
+                                                       _firsts.data(), _counts.data(), draws);
+                break;
+            case Command::FIELD_CURVE:
+            case Command::FIELD_HEIGHTS:
+                _draw_calls += program->gpu_multi_draw_field(static_cast<FieldAsset const *>(head.asset),
+                                                             head.kind == Command::FIELD_HEIGHTS,
+                                                             _firsts.data(), _counts.data(), draws);
+                break;
+            }
+            begin = end;
+        }
+    }
+
+    /*
+     * Number of gl draw calls issued by the last submit.
+     */
+    int get_draw_calls() const
+    {
+        return _draw_calls;
+    }
+
+private:
+    struct Command
+    {
+        enum Kind { ASSET = 0, FIELD_CURVE = 1, FIELD_HEIGHTS = 2 };
+
+        Kind kind;
+        Layer layer;
+        void const * asset;
+        GLuint name;        // vao or value buffer, orders assets by creation
+        GLenum mode;
+        int first;
+        int count;
+        unsigned sequence;  // submission order, the final tie breaker
+    };
+
+    void push(Command::Kind kind, Layer layer, void const * asset, GLuint name,
+              GLenum mode, int first, int count)
+    {
+        assert(asset);
+        assert(first >= 0);
+
+        if (count <= 0)
+            return;
+
+        Command c;
+        c.kind = kind;
+        c.layer = layer;
+        c.asset = asset;
+        c.name = name;
+        c.mode = mode;
+        c.first = first;
+        c.count = count;
+        c.sequence = _sequence++;
+        _commands.push_back(c);
+    }
+
+    static bool same_state(Command const & a, Command const & b)
+    {
+        return a.layer == b.layer && a.kind == b.kind && a.asset == b.asset && a.mode == b.mode;
+    }
+
+    // sorts by gl names rather than pointers, so that the
+    // order is the same from one run to the next
+    static bool before(Command const * a, Command const * b)
+    {
+        if (a->layer != b->layer)
+            return a->layer < b->layer;
+        if (a->kind != b->kind)
+            return a->kind < b->kind;
+        if (a->name != b->name)
+            return a->name < b->name;
+        if (a->asset != b->asset)
+            return a->asset < b->asset;
+        if (a->mode != b->mode)
+            return a->mode < b->mode;
+        if (a->first != b->first)
+            return a->first < b->first;
+        return a->sequence < b->sequence;
+    }
+
+    std::vector<Command> _commands;
+    std::vector<Command const *> _order;
+    std::vector<GLint> _firsts;
+    std::vector<GLsizei> _counts;
+    unsigned _sequence;
+    int _draw_calls;
+};
+
+#endif  // __RENDER_QUEUE_H
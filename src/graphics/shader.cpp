@@ -1,9 +1,39 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
 #include "shader.h"
+#include "stats.h"
 
 #define STRINGIFY(A) #A
 
 typedef VertexColorShaderProgram::Vertex Vertex;
 typedef VertexColorShaderProgram::GpuAsset GpuAsset;
+typedef VertexColorShaderProgram::FieldAsset FieldAsset;
+typedef VertexColorShaderProgram::FieldBuffer FieldBuffer;
+
+/*
+ * GL_CHECK calls glGetError after every call, which stalls the driver
+ * until the call has gone through. Building with ARC_NO_GL_CHECK
+ * (cmake -DARC_GL_CHECK=OFF) compiles the checks out; errors are then
+ * reported asynchronously through the debug output callback instead,
+ * where the context supports it.
+ */
+#ifdef ARC_NO_GL_CHECK
+
+#define GL_CHECK(stmt) \
+    { \
+        stmt; \
+    }
+
+static void APIENTRY debug_output_callback(GLenum, GLenum type, GLuint id, GLenum, GLsizei,
+                                           GLchar const * message, void const *)
+{
+    fprintf(stderr, "OpenGL %s 0x%x: %s\n",
+            type == GL_DEBUG_TYPE_ERROR ? "error" : "message", id, message);
+}
+
+#else
 
 void CheckOpenGLError(const char* stmt, const char* fname, int line)
 {
@@ -21,6 +51,8 @@ void CheckOpenGLError(const char* stmt, const char* fname, int line)
         CheckOpenGLError(#stmt, __FILE__, __LINE__); \
     }
 
+#endif
+
 static char const * vertex_shader_text =
     "#version 330\n" STRINGIFY(
     uniform mat4 MVP;
@@ -42,12 +74,68 @@ static char const * fragment_shader_text =
         fragment_color = color;
     });
 
+/*
+ * Scalar field shader: draws a 1D solution straight from its node
+ * values, without any per-vertex attributes. Nodes are fetched from
+ * buffer textures by gl_VertexID; x is either stored per node or
+ * reconstructed as x0 + i * dx on uniform meshes. Instanced draws
+ * share x and read u u_stride values further along per instance. Height lines use two
+ * vertices per node, (x, 0) and (x, u). Colour comes from the colormap,
+ * indexed by u normalized to u_range.
+ */
+static char const * field_vertex_shader_text =
+    "#version 330\n"
+    "uniform mat4 MVP;\n"
+    "uniform samplerBuffer x_values;\n"
+    "uniform samplerBuffer u_values;\n"
+    "uniform sampler1D colormap;\n"
+    "uniform bool uniform_x;\n"
+    "uniform vec2 x_affine;\n"
+    "uniform vec2 u_range;\n"
+    "uniform bool heights;\n"
+    "uniform int u_stride;\n"
+    "out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    int node = heights ? gl_VertexID / 2 : gl_VertexID;\n"
+    "    float u = texelFetch(u_values, gl_InstanceID * u_stride + node).r;\n"
+    "    float x = uniform_x ? x_affine.x + x_affine.y * float(node)\n"
+    "                        : texelFetch(x_values, node).r;\n"
+    "    float y = (heights && (gl_VertexID & 1) == 0) ? 0.0 : u;\n"
+    "    float t = clamp((u - u_range.x) / (u_range.y - u_range.x), 0.0, 1.0);\n"
+    "    float n = float(textureSize(colormap, 0));\n"
+    "    color = textureLod(colormap, (t * (n - 1.0) + 0.5) / n, 0.0);\n"
+    "    gl_Position = MVP * vec4(x, y, 0.0, 1.0);\n"
+    "}\n";
+
+// texture units used by the field shader
+enum { COLORMAP_UNIT = 0, X_VALUES_UNIT = 1, U_VALUES_UNIT = 2 };
+
 void VertexColorShaderProgram::initialize()
 {
+    // persistently mapped buffers for streaming need GL 4.4 or ARB_buffer_storage,
+    // ARC_NO_PERSISTENT_MAPPING forces the glBufferSubData path (e.g. for testing)
+    persistent_mapping = (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage)
+                      && !getenv("ARC_NO_PERSISTENT_MAPPING");
+
+#ifdef ARC_NO_GL_CHECK
+    if (GLAD_GL_VERSION_4_3 || GLAD_GL_KHR_debug)
+    {
+        // asynchronous, so reports may arrive a few calls late,
+        // skip the notifications, they are mostly driver chatter
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(debug_output_callback, NULL);
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE);
+    }
+#endif
+
+    invalidate_state_cache();
+    initialize_mvp();
+
     compile();
     link();
     initialize_buffers();
-    initialize_mvp();
+    initialize_field_program();
 }
 
 void VertexColorShaderProgram::set_m(mat4x4 m)
@@ -70,12 +158,12 @@ void VertexColorShaderProgram::set_p(mat4x4 p)
 
 void VertexColorShaderProgram::draw_vertices(std::vector<Vertex> const & vv, GLint mode)
 {
-    GL_CHECK(glUseProgram(program));
+    use_program(program);
+    bind_vertex_array(vao);
     GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo));
-    GL_CHECK(glBindVertexArray(vao));
     GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vv.size(), vv.data(), GL_DYNAMIC_DRAW));
+    Stats::instance().add_upload_bytes(sizeof(Vertex) * vv.size());
     GL_CHECK(glDrawArrays(mode, 0, vv.size()));
-    GL_CHECK(glBindVertexArray(0));
 }
 
 void VertexColorShaderProgram::draw_triangles(std::vector<Vertex> const & vv)
@@ -94,155 +182,498 @@ void VertexColorShaderProgram::draw_line_strip(std::vector<Vertex> const & vv)
 }
 
 GpuAsset * VertexColorShaderProgram::gpu_create_asset(std::vector<Vertex> const & vv)
+{
+    return gpu_create_asset(vv.data(), (int) vv.size());
+}
+
+GpuAsset * VertexColorShaderProgram::gpu_create_asset(Vertex const * vv, int size)
 {
     GpuAsset * res = new GpuAsset;
     assert(res);
 
-    GL_CHECK(glUseProgram(program));
     res->program = program;
 
     GL_CHECK(glGenVertexArrays(1, &res->vao));
-    GL_CHECK(glBindVertexArray(res->vao));
+    bind_vertex_array(res->vao);
 
     GL_CHECK(glGenBuffers(1, &res->vbo));
     GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, res->vbo));
     
-    GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vv.size(), vv.data(), GL_STATIC_DRAW));
-    res->size = vv.size();
+    GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * size, vv, GL_STATIC_DRAW));
+    Stats::instance().add_upload_bytes(sizeof(Vertex) * size);
+    res->size = size;
+    res->capacity = size;
 
     GL_CHECK(glEnableVertexAttribArray(vpos_location));
     GL_CHECK(glVertexAttribPointer(vpos_location, 4, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (void*) 0));
     GL_CHECK(glEnableVertexAttribArray(vcol_location));
     GL_CHECK(glVertexAttribPointer(vcol_location, 4, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (void*) (sizeof(float) * 4)));
 
-    GL_CHECK(glBindVertexArray(0));
-
     return res;
 }
 
 void VertexColorShaderProgram::gpu_update_asset(GpuAsset * ga, std::vector<Vertex> const & vv)
 {
-    assert(ga);
+    gpu_update_asset(ga, vv.data(), (int) vv.size());
+}
 
-    GL_CHECK(glUseProgram(ga->program));
+void VertexColorShaderProgram::gpu_update_asset(GpuAsset * ga, Vertex const * vv, int size)
+{
+    assert(ga);
 
-    GL_CHECK(glBindVertexArray(ga->vao));
+    // the array buffer binding isn't vertex array state,
+    // so there is no need to bind the asset's vertex array
     GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, ga->vbo));
-    
-    GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vv.size(), vv.data(), GL_DYNAMIC_DRAW));
-    ga->size = vv.size();
 
-    GL_CHECK(glBindVertexArray(0));
+    // reuse the storage when it is big enough, growing it
+    // geometrically otherwise, instead of reallocating every time
+    if (size > ga->capacity)
+    {
+        ga->capacity = std::max(size, ga->capacity + ga->capacity / 2);
+        GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * ga->capacity, NULL, GL_DYNAMIC_DRAW));
+    }
+    GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * size, vv));
+    Stats::instance().add_upload_bytes(sizeof(Vertex) * size);
+    ga->size = size;
 }
 
-void VertexColorShaderProgram::gpu_draw_vertices(GpuAsset const * ga, GLint mode)
+void VertexColorShaderProgram::gpu_destroy_asset(GpuAsset * ga)
+{
+    assert(ga);
+
+    // deleting bound objects unbinds them
+    if (bound_vao == ga->vao)
+        bound_vao = 0;
+
+    GL_CHECK(glDeleteBuffers(1, &ga->vbo));
+    GL_CHECK(glDeleteVertexArrays(1, &ga->vao));
+    delete ga;
+}
+
+void VertexColorShaderProgram::gpu_draw_vertices(GpuAsset const * ga, GLint mode, int first, int count)
 {
     assert(ga);
     assert(ga->program == program);
+    assert(first >= 0 && first + count <= ga->size);
 
-    GL_CHECK(glUseProgram(program));
-    GL_CHECK(glBindVertexArray(ga->vao));
-    GL_CHECK(glDrawArrays(mode, 0, ga->size));
-    GL_CHECK(glBindVertexArray(0));
+    if (count <= 0)
+        return;
+
+    use_program(program);
+    bind_vertex_array(ga->vao);
+    GL_CHECK(glDrawArrays(mode, first, count));
+}
+
+int VertexColorShaderProgram::gpu_multi_draw(GpuAsset const * ga, GLenum mode,
+                                             GLint const * firsts, GLsizei const * counts, int draws)
+{
+    assert(ga);
+    assert(ga->program == program);
+    assert(firsts);
+    assert(counts);
+
+    if (draws <= 0)
+        return 0;
+
+    use_program(program);
+    bind_vertex_array(ga->vao);
+    GL_CHECK(glMultiDrawArrays(mode, firsts, counts, draws));
+    return 1;
 }
 
 void VertexColorShaderProgram::gpu_draw_triangles(GpuAsset const * ga)
 {
-    gpu_draw_vertices(ga, GL_TRIANGLES);
+    assert(ga);
+    gpu_draw_vertices(ga, GL_TRIANGLES, 0, ga->size);
 }
 
 void VertexColorShaderProgram::gpu_draw_lines(GpuAsset const * ga)
 {
-    gpu_draw_vertices(ga, GL_LINES);
+    assert(ga);
+    gpu_draw_vertices(ga, GL_LINES, 0, ga->size);
+}
+
+void VertexColorShaderProgram::gpu_draw_lines(GpuAsset const * ga, int first, int count)
+{
+    gpu_draw_vertices(ga, GL_LINES, first, count);
 }
 
 void VertexColorShaderProgram::gpu_draw_line_strip(GpuAsset const * ga)
 {
-    gpu_draw_vertices(ga, GL_LINE_STRIP);
+    assert(ga);
+    gpu_draw_vertices(ga, GL_LINE_STRIP, 0, ga->size);
+}
+
+void VertexColorShaderProgram::gpu_draw_line_strip(GpuAsset const * ga, int first, int count)
+{
+    gpu_draw_vertices(ga, GL_LINE_STRIP, first, count);
 }
 
 void VertexColorShaderProgram::gpu_draw_points(GpuAsset const * ga)
 {
-    gpu_draw_vertices(ga, GL_POINTS);
+    assert(ga);
+    gpu_draw_vertices(ga, GL_POINTS, 0, ga->size);
 }
 
-void VertexColorShaderProgram::compile()
+void VertexColorShaderProgram::set_colormap(float const * rgba, int entries)
 {
-    GL_CHECK(vertex_shader = glCreateShader(GL_VERTEX_SHADER));
-    GL_CHECK(glShaderSource(vertex_shader, 1, &vertex_shader_text, NULL));
-    GL_CHECK(glCompileShader(vertex_shader));
-    GLint isCompiled = 0;
-    GL_CHECK(glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &isCompiled));
-    if(isCompiled == GL_FALSE)
+    assert(rgba);
+    assert(entries > 0);
+
+    bind_texture(COLORMAP_UNIT, GL_TEXTURE_1D, colormap);
+    GL_CHECK(glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA32F, entries, 0, GL_RGBA, GL_FLOAT, rgba));
+}
+
+FieldAsset * VertexColorShaderProgram::gpu_create_field_asset(bool streaming)
+{
+    FieldAsset * res = new FieldAsset;
+    assert(res);
+
+    res->slots = streaming ? FieldAsset::RING : 1;
+    for (int i = 0; i < res->slots; ++i)
     {
-        GLint maxLength = 0;
-        GL_CHECK(glGetShaderiv(vertex_shader, GL_INFO_LOG_LENGTH, &maxLength));
+        GL_CHECK(glGenBuffers(1, &res->x[i].vbo));
+        GL_CHECK(glGenBuffers(1, &res->u[i].vbo));
+        GL_CHECK(glGenTextures(1, &res->x[i].tbo));
+        GL_CHECK(glGenTextures(1, &res->u[i].tbo));
+    }
 
-        // The maxLength includes the NULL character
-        std::vector<GLchar> errorLog(maxLength);
-        GL_CHECK(glGetShaderInfoLog(vertex_shader, maxLength, &maxLength, &errorLog[0]));
-        std::string str(errorLog.begin(),errorLog.end());
-        std::cout << str << std::endl;
+    return res;
+}
 
-        // Provide the infolog in whatever manor you deem best.
-        // Exit with failure.
-        GL_CHECK(glDeleteShader(vertex_shader)); // Don't leak the shader.
-        exit(1);
+/*
+ * Blocks until the gpu no longer reads from the buffer,
+ * which streaming assets should make a rare event.
+ */
+static void wait_for_fence(GLsync & fence)
+{
+    if (!fence)
+        return;
+
+    GLenum status;
+    GL_CHECK(status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0));
+    while (status == GL_TIMEOUT_EXPIRED)
+    {
+        GL_CHECK(status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000));
     }
+    GL_CHECK(glDeleteSync(fence));
+    fence = 0;
+}
 
-    GL_CHECK(fragment_shader = glCreateShader(GL_FRAGMENT_SHADER));
-    GL_CHECK(glShaderSource(fragment_shader, 1, &fragment_shader_text, NULL));
-    GL_CHECK(glCompileShader(fragment_shader));
-    isCompiled = 0;
-    GL_CHECK(glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &isCompiled));
+/*
+ * Streaming assets move on to the next set of buffers in the ring,
+ * others keep overwriting their only one.
+ */
+static int next_field_slot(FieldAsset * fa)
+{
+    int slot = (fa->current + 1) % fa->slots;
+    wait_for_fence(fa->fence[slot]);
+    return slot;
+}
+
+void VertexColorShaderProgram::gpu_update_field_asset(FieldAsset * fa, float const * x, float const * u, int size, int instances)
+{
+    assert(fa);
+    assert(x);
+    assert(instances >= 1);
+
+    int slot = next_field_slot(fa);
+    upload_field_values(fa->x[slot], x, size, fa->slots > 1);
+    upload_field_values(fa->u[slot], u, size * instances, fa->slots > 1);
+    fa->current = slot;
+    fa->size = size;
+    fa->instances = instances;
+    fa->uniform_x = false;
+}
+
+void VertexColorShaderProgram::gpu_update_field_asset(FieldAsset * fa, float x0, float dx, float const * u, int size, int instances)
+{
+    assert(fa);
+    assert(instances >= 1);
+
+    int slot = next_field_slot(fa);
+    upload_field_values(fa->u[slot], u, size * instances, fa->slots > 1);
+    fa->current = slot;
+    fa->size = size;
+    fa->instances = instances;
+    fa->uniform_x = true;
+    fa->x0 = x0;
+    fa->dx = dx;
+}
+
+void VertexColorShaderProgram::gpu_destroy_field_asset(FieldAsset * fa)
+{
+    assert(fa);
+
+    for (int i = 0; i < fa->slots; ++i)
+    {
+        if (fa->fence[i])
+        {
+            GL_CHECK(glDeleteSync(fa->fence[i]));
+        }
+        unbind_texture(fa->x[i].tbo);
+        unbind_texture(fa->u[i].tbo);
+        GL_CHECK(glDeleteTextures(1, &fa->x[i].tbo));
+        GL_CHECK(glDeleteTextures(1, &fa->u[i].tbo));
+        GL_CHECK(glDeleteBuffers(1, &fa->x[i].vbo));
+        GL_CHECK(glDeleteBuffers(1, &fa->u[i].vbo));
+    }
+    delete fa;
+}
+
+void VertexColorShaderProgram::gpu_draw_field_curve(FieldAsset const * fa)
+{
+    assert(fa);
+    gpu_draw_field(fa, false, 0, fa->size);
+}
+
+void VertexColorShaderProgram::gpu_draw_field_curve(FieldAsset const * fa, int first, int count)
+{
+    gpu_draw_field(fa, false, first, count);
+}
+
+void VertexColorShaderProgram::gpu_draw_field_heights(FieldAsset const * fa)
+{
+    assert(fa);
+    gpu_draw_field(fa, true, 0, fa->size);
+}
+
+void VertexColorShaderProgram::gpu_draw_field_heights(FieldAsset const * fa, int first, int count)
+{
+    gpu_draw_field(fa, true, first, count);
+}
+
+/*
+ * Only streaming assets are written through a persistent mapping: their
+ * fences make the writes wait for the gpu to finish drawing the set.
+ * Assets with a single set rely on glBufferSubData to synchronize.
+ */
+void VertexColorShaderProgram::upload_field_values(FieldBuffer & fb, float const * values, int size, bool streaming)
+{
+    assert(values);
+
+    GLsizeiptr const bytes = sizeof(float) * size;
+    if (size > fb.capacity)
+    {
+        // grow geometrically, so slowly growing fields don't reallocate every update
+        fb.capacity = std::max(size, fb.capacity + fb.capacity / 2);
+        GLsizeiptr const capacity_bytes = sizeof(float) * fb.capacity;
+
+        if (persistent_mapping && streaming)
+        {
+            // immutable storage can't be resized, so start over with a new buffer
+            GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            GL_CHECK(glDeleteBuffers(1, &fb.vbo));
+            GL_CHECK(glGenBuffers(1, &fb.vbo));
+            GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, fb.vbo));
+            GL_CHECK(glBufferStorage(GL_TEXTURE_BUFFER, capacity_bytes, NULL, flags));
+            GL_CHECK(fb.mapped = glMapBufferRange(GL_TEXTURE_BUFFER, 0, capacity_bytes, flags));
+        }
+        else
+        {
+            GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, fb.vbo));
+            GL_CHECK(glBufferData(GL_TEXTURE_BUFFER, capacity_bytes, NULL, GL_DYNAMIC_DRAW));
+        }
+
+        bind_texture(U_VALUES_UNIT, GL_TEXTURE_BUFFER, fb.tbo);
+        GL_CHECK(glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, fb.vbo));
+    }
+
+    if (fb.mapped)
+    {
+        // coherent mapping, visible to the gpu without flushing
+        memcpy(fb.mapped, values, bytes);
+    }
+    else
+    {
+        GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, fb.vbo));
+        GL_CHECK(glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, values));
+    }
+    GL_CHECK(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+    Stats::instance().add_upload_bytes(bytes);
+}
+
+void VertexColorShaderProgram::gpu_draw_field(FieldAsset const * fa, bool heights, int first, int count)
+{
+    assert(fa);
+    assert(first >= 0 && first + count <= fa->size);
+
+    if (count <= 0)
+        return;
+
+    bind_field(fa, heights);
+
+    // gl_VertexID counts from first, so sub ranges need no extra uniforms
+    if (heights)
+        draw_field_arrays(fa, GL_LINES, 2 * first, 2 * count);
+    else
+        draw_field_arrays(fa, GL_LINE_STRIP, first, count);
+
+    fence_field(fa);
+}
+
+int VertexColorShaderProgram::gpu_multi_draw_field(FieldAsset const * fa, bool heights,
+                                                   GLint const * firsts, GLsizei const * counts, int draws)
+{
+    assert(fa);
+    assert(firsts);
+    assert(counts);
+
+    if (draws <= 0)
+        return 0;
+
+    bind_field(fa, heights);
+
+    if (heights)
+    {
+        // two vertices per node
+        std::vector<GLint> vertex_firsts(firsts, firsts + draws);
+        std::vector<GLsizei> vertex_counts(counts, counts + draws);
+        for (int i = 0; i < draws; ++i)
+        {
+            vertex_firsts[i] *= 2;
+            vertex_counts[i] *= 2;
+        }
+        if (fa->instances > 1)
+        {
+            for (int i = 0; i < draws; ++i)
+                draw_field_arrays(fa, GL_LINES, vertex_firsts[i], vertex_counts[i]);
+        }
+        else
+        {
+            GL_CHECK(glMultiDrawArrays(GL_LINES, vertex_firsts.data(), vertex_counts.data(), draws));
+        }
+    }
+    else if (fa->instances > 1)
+    {
+        // there is no instanced multi draw before indirect draws
+        for (int i = 0; i < draws; ++i)
+            draw_field_arrays(fa, GL_LINE_STRIP, firsts[i], counts[i]);
+    }
+    else
+    {
+        GL_CHECK(glMultiDrawArrays(GL_LINE_STRIP, firsts, counts, draws));
+    }
+
+    fence_field(fa);
+    // one instanced call per range, as there is no instanced multi draw
+    return fa->instances > 1 ? draws : 1;
+}
+
+void VertexColorShaderProgram::bind_field(FieldAsset const * fa, bool heights)
+{
+    use_program(field_program);
+    bind_vertex_array(field_vao);
+
+    bind_texture(COLORMAP_UNIT, GL_TEXTURE_1D, colormap);
+    if (!fa->uniform_x)
+        bind_texture(X_VALUES_UNIT, GL_TEXTURE_BUFFER, fa->x[fa->current].tbo);
+    bind_texture(U_VALUES_UNIT, GL_TEXTURE_BUFFER, fa->u[fa->current].tbo);
+
+    float u_max = fa->u_max > fa->u_min ? fa->u_max : fa->u_min + 1.f;
+    GL_CHECK(glUniform1i(field_locations.uniform_x, fa->uniform_x));
+    GL_CHECK(glUniform2f(field_locations.x_affine, fa->x0, fa->dx));
+    GL_CHECK(glUniform2f(field_locations.u_range, fa->u_min, u_max));
+    GL_CHECK(glUniform1i(field_locations.heights, heights));
+    GL_CHECK(glUniform1i(field_locations.u_stride, fa->size));
+}
+
+void VertexColorShaderProgram::draw_field_arrays(FieldAsset const * fa, GLenum mode, GLint first, GLsizei count)
+{
+    if (fa->instances > 1)
+    {
+        GL_CHECK(glDrawArraysInstanced(mode, first, count, fa->instances));
+    }
+    else
+    {
+        GL_CHECK(glDrawArrays(mode, first, count));
+    }
+}
+
+void VertexColorShaderProgram::fence_field(FieldAsset const * fa)
+{
+    // streaming assets must not overwrite these buffers until the gpu is done
+    if (fa->slots > 1)
+    {
+        GLsync & fence = fa->fence[fa->current];
+        if (fence)
+        {
+            GL_CHECK(glDeleteSync(fence));
+        }
+        GL_CHECK(fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    }
+}
+
+void VertexColorShaderProgram::compile()
+{
+    vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_shader_text);
+    fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_shader_text);
+}
+
+void VertexColorShaderProgram::link()
+{
+    program = link_program(vertex_shader, fragment_shader);
+}
+
+GLuint VertexColorShaderProgram::compile_shader(GLenum type, char const * text)
+{
+    GLuint shader;
+    GL_CHECK(shader = glCreateShader(type));
+    GL_CHECK(glShaderSource(shader, 1, &text, NULL));
+    GL_CHECK(glCompileShader(shader));
+    GLint isCompiled = 0;
+    GL_CHECK(glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled));
     if(isCompiled == GL_FALSE)
     {
         GLint maxLength = 0;
-        GL_CHECK(glGetShaderiv(fragment_shader, GL_INFO_LOG_LENGTH, &maxLength));
+        GL_CHECK(glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &maxLength));
 
         // The maxLength includes the NULL character
         std::vector<GLchar> errorLog(maxLength);
-        GL_CHECK(glGetShaderInfoLog(fragment_shader, maxLength, &maxLength, &errorLog[0]));
+        GL_CHECK(glGetShaderInfoLog(shader, maxLength, &maxLength, &errorLog[0]));
         std::string str(errorLog.begin(),errorLog.end());
         std::cout << str << std::endl;
 
         // Provide the infolog in whatever manor you deem best.
         // Exit with failure.
-        GL_CHECK(glDeleteShader(fragment_shader)); // Don't leak the shader.
+        GL_CHECK(glDeleteShader(shader)); // Don't leak the shader.
         exit(1);
     }
+    return shader;
 }
 
-void VertexColorShaderProgram::link()
+GLuint VertexColorShaderProgram::link_program(GLuint vs, GLuint fs)
 {
-    GL_CHECK(program = glCreateProgram());
-    GL_CHECK(glAttachShader(program, vertex_shader));
-    GL_CHECK(glAttachShader(program, fragment_shader));
-    GL_CHECK(glLinkProgram(program));
+    GLuint res;
+    GL_CHECK(res = glCreateProgram());
+    GL_CHECK(glAttachShader(res, vs));
+    GL_CHECK(glAttachShader(res, fs));
+    GL_CHECK(glLinkProgram(res));
     GLint isLinked = 0;
-    GL_CHECK(glGetProgramiv(program, GL_LINK_STATUS, &isLinked));
+    GL_CHECK(glGetProgramiv(res, GL_LINK_STATUS, &isLinked));
     if(isLinked == GL_FALSE)
     {
         GLint maxLength = 0;
-        GL_CHECK(glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength));
+        GL_CHECK(glGetProgramiv(res, GL_INFO_LOG_LENGTH, &maxLength));
 
         // The maxLength includes the NULL character
         std::vector<GLchar> errorLog(maxLength);
-        GL_CHECK(glGetProgramInfoLog(program, maxLength, &maxLength, &errorLog[0]));
+        GL_CHECK(glGetProgramInfoLog(res, maxLength, &maxLength, &errorLog[0]));
         std::string str(errorLog.begin(),errorLog.end());
         std::cout << str << std::endl;
 
         // Provide the infolog in whatever manor you deem best.
         // Exit with failure.
-        GL_CHECK(glDeleteProgram(program)); // Don't leak the program.
+        GL_CHECK(glDeleteProgram(res)); // Don't leak the program.
         exit(1);
     }
+    return res;
 }
 
 void VertexColorShaderProgram::initialize_buffers()
 {
     GL_CHECK(glGenVertexArrays(1, &vao));
-    GL_CHECK(glBindVertexArray(vao));
+    bind_vertex_array(vao);
 
     GL_CHECK(glGenBuffers(1, &vbo));
     GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo));
@@ -259,7 +690,41 @@ void VertexColorShaderProgram::initialize_buffers()
                           sizeof(float) * 8, (void*) (sizeof(float) * 4)));
 
     GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
-    GL_CHECK(glBindVertexArray(0));
+}
+
+void VertexColorShaderProgram::initialize_field_program()
+{
+    GLuint vs = compile_shader(GL_VERTEX_SHADER, field_vertex_shader_text);
+    GLuint fs = compile_shader(GL_FRAGMENT_SHADER, fragment_shader_text);
+    field_program = link_program(vs, fs);
+    GL_CHECK(glDeleteShader(vs));
+    GL_CHECK(glDeleteShader(fs));
+
+    GL_CHECK(field_locations.mvp = glGetUniformLocation(field_program, "MVP"));
+    GL_CHECK(field_locations.uniform_x = glGetUniformLocation(field_program, "uniform_x"));
+    GL_CHECK(field_locations.x_affine = glGetUniformLocation(field_program, "x_affine"));
+    GL_CHECK(field_locations.u_range = glGetUniformLocation(field_program, "u_range"));
+    GL_CHECK(field_locations.heights = glGetUniformLocation(field_program, "heights"));
+    GL_CHECK(field_locations.u_stride = glGetUniformLocation(field_program, "u_stride"));
+
+    use_program(field_program);
+    GL_CHECK(glUniform1i(glGetUniformLocation(field_program, "colormap"), COLORMAP_UNIT));
+    GL_CHECK(glUniform1i(glGetUniformLocation(field_program, "x_values"), X_VALUES_UNIT));
+    GL_CHECK(glUniform1i(glGetUniformLocation(field_program, "u_values"), U_VALUES_UNIT));
+
+    // the field shader has no vertex attributes,
+    // but core profile still wants a vertex array bound
+    GL_CHECK(glGenVertexArrays(1, &field_vao));
+
+    // default colormap, blue (low) to red (high)
+    GL_CHECK(glGenTextures(1, &colormap));
+    bind_texture(COLORMAP_UNIT, GL_TEXTURE_1D, colormap);
+    GL_CHECK(glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    GL_CHECK(glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    GL_CHECK(glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    float const blue_red[] = { 0.f, 0.f, 1.f, 1.f,
+                               1.f, 0.f, 0.f, 1.f };
+    set_colormap(blue_red, 2);
 }
 
 void VertexColorShaderProgram::initialize_mvp()
@@ -267,15 +732,84 @@ void VertexColorShaderProgram::initialize_mvp()
     mat4x4_identity(_m);
     mat4x4_identity(_v);
     mat4x4_identity(_p);
+    update_mvp();
 }
 
+/*
+ * The mvp is only uploaded to a program the next time it is used,
+ * so moving the view doesn't switch programs back and forth.
+ */
 void VertexColorShaderProgram::update_mvp()
 {
-    mat4x4 mvp;
-    mat4x4_identity(mvp);
-    mat4x4_mul(mvp, _v, _m);
-    mat4x4_mul(mvp, _p, mvp);
-    GL_CHECK(glUseProgram(program));
-    GL_CHECK(glUniformMatrix4fv(mvp_location, 1, GL_FALSE, (GLfloat const *) mvp));
+    mat4x4_identity(_mvp);
+    mat4x4_mul(_mvp, _v, _m);
+    mat4x4_mul(_mvp, _p, _mvp);
+    mvp_dirty = true;
+    field_mvp_dirty = true;
+}
+
+void VertexColorShaderProgram::invalidate_state_cache()
+{
+    bound_program = 0;
+    bound_vao = 0;
+    active_unit = 0;
+    for (int i = 0; i < TEXTURE_UNITS; ++i)
+        bound_textures[i] = 0;
+    GL_CHECK(glUseProgram(0));
+    GL_CHECK(glBindVertexArray(0));
+    GL_CHECK(glActiveTexture(GL_TEXTURE0));
+}
+
+void VertexColorShaderProgram::use_program(GLuint p)
+{
+    if (p != bound_program)
+    {
+        GL_CHECK(glUseProgram(p));
+        bound_program = p;
+    }
+
+    if (p == program && mvp_dirty)
+    {
+        GL_CHECK(glUniformMatrix4fv(mvp_location, 1, GL_FALSE, (GLfloat const *) _mvp));
+        mvp_dirty = false;
+    }
+    else if (p == field_program && field_mvp_dirty)
+    {
+        GL_CHECK(glUniformMatrix4fv(field_locations.mvp, 1, GL_FALSE, (GLfloat const *) _mvp));
+        field_mvp_dirty = false;
+    }
 }
 
+void VertexColorShaderProgram::bind_vertex_array(GLuint v)
+{
+    if (v != bound_vao)
+    {
+        GL_CHECK(glBindVertexArray(v));
+        bound_vao = v;
+    }
+}
+
+void VertexColorShaderProgram::bind_texture(int unit, GLenum target, GLuint texture)
+{
+    assert(unit >= 0 && unit < TEXTURE_UNITS);
+
+    if (bound_textures[unit] == texture)
+        return;
+
+    if (unit != active_unit)
+    {
+        GL_CHECK(glActiveTexture(GL_TEXTURE0 + unit));
+        active_unit = unit;
+    }
+    GL_CHECK(glBindTexture(target, texture));
+    bound_textures[unit] = texture;
+}
+
+void VertexColorShaderProgram::unbind_texture(GLuint texture)
+{
+    for (int i = 0; i < TEXTURE_UNITS; ++i)
+    {
+        if (bound_textures[i] == texture)
+            bound_textures[i] = 0;
+    }
+}
@@ -23,10 +23,59 @@ public:
     };
     struct GpuAsset
     {  
-        GpuAsset() : vbo(0), vao(0), program(0) {}
-        GpuAsset(GLuint vbo_, GLuint vao_, GLuint program_) : vbo(vbo_), vao(vao_), program(program_) {}
+        GpuAsset() : vbo(0), vao(0), program(0), size(0), capacity(0) {}
+        GpuAsset(GLuint vbo_, GLuint vao_, GLuint program_) : vbo(vbo_), vao(vao_), program(program_), size(0), capacity(0) {}
         GLuint vbo, vao, program;
         int size;
+        int capacity;  // vertices the buffer can hold without reallocating
+    };
+    /*
+     * One float per node, in a buffer texture. The storage only ever
+     * grows, so updates of the same size reuse it. The buffers of
+     * streaming assets are persistently mapped where supported and
+     * written through the mapping instead of glBufferSubData.
+     */
+    struct FieldBuffer
+    {
+        FieldBuffer() : vbo(0), tbo(0), capacity(0), mapped(NULL) {}
+        GLuint vbo, tbo;
+        int capacity;
+        void * mapped;
+    };
+    /*
+     * Compact gpu copy of a 1D scalar field: one float per node for u,
+     * and either one float per node for x or just x0 and dx on uniform
+     * meshes. Colours are not stored, they are looked up from the
+     * colormap using u normalized to [u_min, u_max].
+     *
+     * Sweeps of several fields over the same nodes are stored as one
+     * asset with that many instances: x once, and the u of every
+     * instance back to back, instance i at [i * size, (i + 1) * size).
+     * They are drawn with a single instanced draw call.
+     *
+     * Streaming assets, meant for fields that change every frame, cycle
+     * through RING sets of buffers, so that an update never has to wait
+     * for the gpu to finish drawing the previous frames.
+     */
+    struct FieldAsset
+    {
+        enum { RING = 3 };
+        FieldAsset()
+        : slots(1), current(0), size(0), instances(1)
+        , uniform_x(false), x0(0.f), dx(0.f), u_min(0.f), u_max(1.f)
+        {
+            for (int i = 0; i < RING; ++i)
+                fence[i] = 0;
+        }
+        FieldBuffer x[RING], u[RING];
+        mutable GLsync fence[RING];  // signalled once the gpu is done drawing a set
+        int slots;                   // buffer sets in use, 1 or RING
+        int current;                 // buffer set holding the latest update
+        int size;                    // nodes per instance
+        int instances;
+        bool uniform_x;
+        float x0, dx;
+        float u_min, u_max;
     };
     void initialize();
     void set_m(mat4x4 m);
@@ -36,22 +85,71 @@ public:
     void draw_lines(std::vector<Vertex> const & vv);
     void draw_line_strip(std::vector<Vertex> const & vv);
     GpuAsset * gpu_create_asset(std::vector<Vertex> const & vv);
+    GpuAsset * gpu_create_asset(Vertex const * vv, int size);
     void gpu_update_asset(GpuAsset * ga, std::vector<Vertex> const & vv);
+    void gpu_update_asset(GpuAsset * ga, Vertex const * vv, int size);
+    void gpu_destroy_asset(GpuAsset * ga);
     void gpu_draw_triangles(GpuAsset const * ga);
     void gpu_draw_lines(GpuAsset const * ga);
+    void gpu_draw_lines(GpuAsset const * ga, int first, int count);
     void gpu_draw_line_strip(GpuAsset const * ga);
+    void gpu_draw_line_strip(GpuAsset const * ga, int first, int count);
     void gpu_draw_points(GpuAsset const * ga);
+    // the multi draws return the number of gl draw calls they issued
+    int gpu_multi_draw(GpuAsset const * ga, GLenum mode,
+                       GLint const * firsts, GLsizei const * counts, int draws);
+    void set_colormap(float const * rgba, int entries);
+    FieldAsset * gpu_create_field_asset(bool streaming = false);
+    void gpu_update_field_asset(FieldAsset * fa, float const * x, float const * u, int size, int instances = 1);
+    void gpu_update_field_asset(FieldAsset * fa, float x0, float dx, float const * u, int size, int instances = 1);
+    void gpu_destroy_field_asset(FieldAsset * fa);
+    void gpu_draw_field_curve(FieldAsset const * fa);
+    void gpu_draw_field_curve(FieldAsset const * fa, int first, int count);
+    void gpu_draw_field_heights(FieldAsset const * fa);
+    void gpu_draw_field_heights(FieldAsset const * fa, int first, int count);
+    int gpu_multi_draw_field(FieldAsset const * fa, bool heights,
+                             GLint const * firsts, GLsizei const * counts, int draws);
+
+    /*
+     * Program, vertex array and texture bindings are cached to skip
+     * redundant binds, so they should only be changed through this
+     * class. Code that changes them directly must call this afterwards.
+     */
+    void invalidate_state_cache();
 private:
+    enum { TEXTURE_UNITS = 3 };
     void compile();
     void link();
+    GLuint compile_shader(GLenum type, char const * text);
+    GLuint link_program(GLuint vs, GLuint fs);
     void initialize_buffers();
+    void initialize_field_program();
     void initialize_mvp();
     void update_mvp();
+    void use_program(GLuint p);
+    void bind_vertex_array(GLuint v);
+    void bind_texture(int unit, GLenum target, GLuint texture);
+    void unbind_texture(GLuint texture);
     void draw_vertices(std::vector<Vertex> const & vv, GLint mode);
-    void gpu_draw_vertices(GpuAsset const * ga, GLint mode);
+    void gpu_draw_vertices(GpuAsset const * ga, GLint mode, int first, int count);
+    void upload_field_values(FieldBuffer & fb, float const * values, int size, bool streaming);
+    void gpu_draw_field(FieldAsset const * fa, bool heights, int first, int count);
+    void bind_field(FieldAsset const * fa, bool heights);
+    void draw_field_arrays(FieldAsset const * fa, GLenum mode, GLint first, GLsizei count);
+    void fence_field(FieldAsset const * fa);
     GLuint vbo, vao, vertex_shader, fragment_shader, program;
     GLint mvp_location, vpos_location, vcol_location;
-    mat4x4 _m, _v, _p;
+    GLuint field_program, field_vao, colormap;
+    bool persistent_mapping;
+    struct
+    {
+        GLint mvp, uniform_x, x_affine, u_range, heights, u_stride;
+    } field_locations;
+    mat4x4 _m, _v, _p, _mvp;
+    bool mvp_dirty, field_mvp_dirty;
+    GLuint bound_program, bound_vao;
+    GLuint bound_textures[TEXTURE_UNITS];
+    int active_unit;
 };
 
 #endif  // __SHADER_H
\ No newline at end of file
@@ -0,0 +1,83 @@
+#ifndef __STROKE_FONT_H
+#define __STROKE_FONT_H
+
+#include <cctype>
+#include <vector>
+
+#include "shader.h"
+
+/*
+ * Tiny line segment font for overlays, drawn with the vertex colour
+ * program so that it needs no textures. Glyphs live on a 3 x 5 grid of
+ * points, x in [0, 2] and y in [0, 4] from the bottom left, each line
+ * given by four digits x0 y0 x1 y1. Lowercase is drawn as uppercase,
+ * characters without a glyph are left blank.
+ */
+inline char const * stroke_glyph(char c)
+{
+    switch (toupper((unsigned char) c))
+    {
+    case '0': return "0020 2024 2404 0400 0024";
+    case '1': return "1014 0314";
+    case '2': return "0424 2422 2202 0200 0020";
+    case '3': return "0424 2420 2000 0222";
+    case '4': return "0402 0222 2420";
+    case '5': return "2404 0402 0222 2220 2000";
+    case '6': return "2404 0400 0020 2022 2202";
+    case '7': return "0424 2420";
+    case '8': return "0020 2024 2404 0400 0222";
+    case '9': return "0222 0204 0424 2420 2000";
+    case '.': return "1011";
+    case ':': return "1011 1314";
+    case '-': return "0222";
+    case '/': return "0024";
+    case '%': return "0024 0313 1011";
+    case 'A': return "0004 0424 2420 0222";
+    case 'B': return "0004 0414 1423 2322 0222 2221 2110 1000";
+    case 'C': return "2404 0400 0020";
+    case 'D': return "0004 0414 1423 2321 2110 1000";
+    case 'E': return "2404 0400 0020 0212";
+    case 'F': return "2404 0400 0212";
+    case 'G': return "2404 0400 0020 2022 2212";
+    case 'H': return "0004 2024 0222";
+    case 'I': return "1014 0424 0020";
+    case 'K': return "0004 0224 0220";
+    case 'L': return "0400 0020";
+    case 'M': return "0004 0412 1224 2420";
+    case 'N': return "0004 0420 2024";
+    case 'O': return "0020 2024 2404 0400";
+    case 'P': return "0004 0424 2422 2202";
+    case 'R': return "0004 0424 2422 2202 0220";
+    case 'S': return "2404 0402 0222 2220 2000";
+    case 'T': return "0424 1410";
+    case 'U': return "0400 0020 2024";
+    case 'V': return "0410 1024";
+    case 'W': return "0400 0012 1220 2024";
+    case 'X': return "0024 0420";
+    case 'Y': return "0412 2412 1210";
+    default: return "";
+    }
+}
+
+/*
+ * Appends the lines of a string starting with its bottom left corner
+ * at (x, y), scale being the size of one grid step. Characters advance
+ * by three steps, so a glyph is followed by a one step gap.
+ */
+inline void append_text(std::vector<VertexColorShaderProgram::Vertex> & vertices,
+                        char const * text, float x, float y, float scale_x, float scale_y,
+                        float r, float g, float b)
+{
+    typedef VertexColorShaderProgram::Vertex Vertex;
+
+    for (char const * c = text; *c; ++c, x += 3.f * scale_x)
+    {
+        for (char const * s = stroke_glyph(*c); s[0] && s[1] && s[2] && s[3]; s += s[4] ? 5 : 4)
+        {
+            vertices.push_back(Vertex(x + (s[0] - '0') * scale_x, y + (s[1] - '0') * scale_y, 0.f, 1.f, r, g, b, 1.f));
+            vertices.push_back(Vertex(x + (s[2] - '0') * scale_x, y + (s[3] - '0') * scale_y, 0.f, 1.f, r, g, b, 1.f));
+        }
+    }
+}
+
+#endif  // __STROKE_FONT_H
@@ -102,6 +102,14 @@ void Window::poll_events()
 {
     glfwPollEvents();
 }
+void Window::wait_events()
+{
+    glfwWaitEvents();
+}
+void Window::wait_events_timeout(double timeout)
+{
+    glfwWaitEventsTimeout(timeout);
+}
 void Window::print_info()
 {
     // print opengl info
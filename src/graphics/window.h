@@ -27,6 +27,8 @@ public:
     void set_should_close();
     void swap_buffers();
     void poll_events();
+    void wait_events();
+    void wait_events_timeout(double timeout);
     void print_info();
     void get_window_size(int * x, int * y);
     void get_framebuffer_size(int * x, int * y);
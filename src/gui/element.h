@@ -1,15 +1,53 @@
 #ifndef __ELEMENT_H
 #define __ELEMENT_H
 
+#include "arena.h"
 #include "events.h"
+#include "render_queue.h"
 #include "shader.h"
 
+/*
+ * World-space rectangle covered by the current view and its resolution
+ * in framebuffer pixels. A zero resolution means unknown, in which
+ * case elements should draw everything at full detail.
+ */
+struct RenderView
+{
+    RenderView()
+    : xmin(0.f)
+    , xmax(0.f)
+    , ymin(0.f)
+    , ymax(0.f)
+    , pixels_per_unit_x(0.f)
+    , pixels_per_unit_y(0.f)
+    {}
+
+    bool is_known() const
+    {
+        return pixels_per_unit_x > 0.f && pixels_per_unit_y > 0.f;
+    }
+
+    float xmin, xmax;
+    float ymin, ymax;
+    float pixels_per_unit_x;
+    float pixels_per_unit_y;
+};
+
 class RenderElementsEvent : public Event
 {
 public:
     public:
-    RenderElementsEvent(VertexColorShaderProgram * p = NULL) : program(p) {};
+    RenderElementsEvent(VertexColorShaderProgram * p = NULL, RenderView const & v = RenderView(),
+                        RenderQueue * q = NULL, Fem::Arena * a = NULL)
+    : program(p)
+    , view(v)
+    , queue(q)
+    , arena(a)
+    {};
     VertexColorShaderProgram * program;
+    RenderView view;
+    RenderQueue * queue;  // elements queue their draws here when set
+    Fem::Arena * arena;   // scratch for the frame, e.g. vertices before upload, when set
 };
 
 class Element
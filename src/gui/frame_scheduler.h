@@ -0,0 +1,196 @@
+#ifndef __FRAME_SCHEDULER_H
+#define __FRAME_SCHEDULER_H
+
+/*
+ * Frame timing summary, all times in seconds. The mean values
+ * are taken over the most recent window of rendered frames,
+ * the rest over the whole session.
+ */
+struct FrameStatistics
+{
+    FrameStatistics()
+    : frames(0)
+    , wakeups(0)
+    , last_frame_time(0.0)
+    , min_frame_time(0.0)
+    , max_frame_time(0.0)
+    , mean_frame_time(0.0)
+    , mean_frame_interval(0.0)
+    {}
+
+    unsigned long frames;        // number of frames rendered
+    unsigned long wakeups;       // number of times the event loop woke up
+    double last_frame_time;      // duration of the last rendered frame
+    double min_frame_time;
+    double max_frame_time;
+    double mean_frame_time;
+    double mean_frame_interval;  // time between consecutive frame starts
+};
+
+/*
+ * Decides when the gui needs to redraw and how long the event loop
+ * may sleep in between. A frame is rendered only once something has
+ * been invalidated (input, resize, elements added or removed), and
+ * never more often than the frame rate cap allows. When nothing is
+ * dirty the event loop blocks for up to the idle timeout instead of
+ * spinning.
+ */
+class FrameScheduler
+{
+public:
+    enum { WINDOW = 64 };
+
+    FrameScheduler(double max_frame_rate = 60.0, double idle_timeout = 0.5)
+    : _dirty(true)
+    , _refresh_interval(0.0)
+    , _last_frame_start(-1.0)
+    , _window_count(0)
+    , _window_next(0)
+    {
+        set_max_frame_rate(max_frame_rate);
+        set_idle_timeout(idle_timeout);
+    }
+
+    /*
+     * Caps the number of frames rendered per second,
+     * zero or less means uncapped.
+     */
+    void set_max_frame_rate(double max_frame_rate)
+    {
+        _min_frame_interval = max_frame_rate > 0.0 ? 1.0 / max_frame_rate : 0.0;
+    }
+    double get_max_frame_rate() const
+    {
+        return _min_frame_interval > 0.0 ? 1.0 / _min_frame_interval : 0.0;
+    }
+
+    /*
+     * Longest time the event loop sleeps while nothing is dirty,
+     * a negative timeout sleeps until the next event arrives.
+     */
+    void set_idle_timeout(double idle_timeout)
+    {
+        _idle_timeout = idle_timeout;
+    }
+    double get_idle_timeout() const
+    {
+        return _idle_timeout;
+    }
+
+    /*
+     * While positive, a frame is due at least this often even when
+     * nothing is dirty, for content that changes on its own, such as
+     * statistics.
+     */
+    void set_refresh_interval(double refresh_interval)
+    {
+        _refresh_interval = refresh_interval;
+    }
+    double get_refresh_interval() const
+    {
+        return _refresh_interval;
+    }
+
+    void invalidate()
+    {
+        _dirty = true;
+    }
+    bool is_dirty() const
+    {
+        return _dirty;
+    }
+
+    bool is_frame_due(double now) const
+    {
+        if (_last_frame_start < 0.0)
+            return _dirty;
+        if (_dirty)
+            return now - _last_frame_start >= _min_frame_interval;
+        return _refresh_interval > 0.0 && now - _last_frame_start >= _refresh_interval;
+    }
+
+    /*
+     * Time the event loop may wait for events before the next frame is
+     * due, negative when it may wait indefinitely.
+     */
+    double get_wait_timeout(double now) const
+    {
+        if (!_dirty && _refresh_interval > 0.0 && _last_frame_start >= 0.0)
+        {
+            double refresh = _last_frame_start + _refresh_interval - now;
+            refresh = refresh > 0.0 ? refresh : 0.0;
+            return _idle_timeout >= 0.0 && _idle_timeout < refresh ? _idle_timeout : refresh;
+        }
+        if (!_dirty)
+            return _idle_timeout;
+
+        double remaining = _last_frame_start + _min_frame_interval - now;
+        return remaining > 0.0 ? remaining : 0.0;
+    }
+
+    void count_wakeup()
+    {
+        ++_stats.wakeups;
+    }
+
+    void begin_frame(double now)
+    {
+        // clear first, so that anything invalidated while
+        // rendering is picked up by the next frame
+        _dirty = false;
+
+        if (_last_frame_start >= 0.0)
+            _intervals[_window_next] = now - _last_frame_start;
+        else
+            _intervals[_window_next] = 0.0;
+        _last_frame_start = now;
+    }
+
+    void end_frame(double now)
+    {
+        double frame_time = now - _last_frame_start;
+
+        if (_stats.frames == 0 || frame_time < _stats.min_frame_time)
+            _stats.min_frame_time = frame_time;
+        if (_stats.frames == 0 || frame_time > _stats.max_frame_time)
+            _stats.max_frame_time = frame_time;
+        _stats.last_frame_time = frame_time;
+        ++_stats.frames;
+
+        _frame_times[_window_next] = frame_time;
+        _window_next = (_window_next + 1) % WINDOW;
+        if (_window_count < WINDOW)
+            ++_window_count;
+
+        double time_sum = 0.0;
+        double interval_sum = 0.0;
+        for (int i = 0; i < _window_count; ++i)
+        {
+            time_sum += _frame_times[i];
+            interval_sum += _intervals[i];
+        }
+        _stats.mean_frame_time = time_sum / _window_count;
+        // the very first frame has no interval
+        int intervals = _stats.frames < (unsigned long) WINDOW ? _window_count - 1 : _window_count;
+        _stats.mean_frame_interval = intervals > 0 ? interval_sum / intervals : 0.0;
+    }
+
+    FrameStatistics const & get_statistics() const
+    {
+        return _stats;
+    }
+
+private:
+    bool _dirty;
+    double _refresh_interval;
+    double _min_frame_interval;
+    double _idle_timeout;
+    double _last_frame_start;
+    double _frame_times[WINDOW];
+    double _intervals[WINDOW];
+    int _window_count;
+    int _window_next;
+    FrameStatistics _stats;
+};
+
+#endif  // __FRAME_SCHEDULER_H
@@ -1,9 +1,18 @@
 #include "gui.h"
 
+// seconds between redraws while statistics are shown
+static double const STATS_REFRESH_INTERVAL = 0.25;
+
 Gui::Gui()
 : _pan(NULL)
 , _shaderprogram(NULL)
 , _zoom(NULL)
+, _window_width(0)
+, _window_height(0)
+, _framebuffer_width(0)
+, _framebuffer_height(0)
+, _last_dispatch_count(0)
+, _last_upload_bytes(0)
 {}
 
 Gui::~Gui()
@@ -89,6 +98,7 @@ bool Gui::add_element(Element * element)
         return false;
 
     element->addEventHooks(&_window.event_manager);
+    invalidate();
 
     return true;
 }
@@ -102,33 +112,93 @@ bool Gui::remove_element(Element * element)
         return false;
 
     element->removeEventHooks(&_window.event_manager);
+    invalidate();
 
     return true;
 }
 
-bool Gui::step(double dt)
+bool Gui::step()
 {
-    // trigger render event...
-    render();
+    _scheduler.count_wakeup();
+
+    // shown statistics change without any input
+    _scheduler.set_refresh_interval(Stats::instance().is_shown() ? STATS_REFRESH_INTERVAL : 0.0);
+
+    // only redraw when something changed, and no faster than the cap
+    if (_scheduler.is_frame_due(get_time()))
+    {
+        render();
+    }
 
-    // poll events...
-    static double last_time = get_time();
-    do
+    // block until events arrive or the next frame is due
+    double timeout = _scheduler.get_wait_timeout(get_time());
+    if (timeout < 0.0)
+    {
+        _window.wait_events();
+    }
+    else
     {
-        _window.poll_events();
-    } while ((get_time() - last_time) < dt);
-    last_time = get_time();
+        _window.wait_events_timeout(timeout);
+    }
 
     return true;
 }
 
+void Gui::invalidate()
+{
+    _scheduler.invalidate();
+}
+
+void Gui::set_max_frame_rate(double max_frame_rate)
+{
+    _scheduler.set_max_frame_rate(max_frame_rate);
+}
+
+void Gui::set_idle_timeout(double idle_timeout)
+{
+    _scheduler.set_idle_timeout(idle_timeout);
+}
+
+FrameStatistics const & Gui::get_frame_statistics() const
+{
+    return _scheduler.get_statistics();
+}
+
+RenderView const & Gui::get_view() const
+{
+    return _view;
+}
+
 // change to an event (render event)
 bool Gui::render()
 {
+    _scheduler.begin_frame(get_time());
+
     glClear(GL_COLOR_BUFFER_BIT);
-    _window.event_manager.triggerEvent(new RenderElementsEvent(_shaderprogram));
+
+    // collect the draws of all elements first, then submit them sorted
+    // by layer and state, independent of the order of the hooks
+    _queue.clear();
+    RenderElementsEvent event(_shaderprogram, _view, &_queue, &_frame_arena);
+    _window.event_manager.triggerEvent(&event);
+    _queue.submit(_shaderprogram);
+    _frame_arena.reset();
+
     _window.swap_buffers();
 
+    _scheduler.end_frame(get_time());
+
+    // publish for the hud, counting events and uploads since the last frame
+    Stats & stats = Stats::instance();
+    unsigned long const dispatch_count = _window.event_manager.get_dispatch_count();
+    unsigned long const upload_bytes = stats.get_upload_bytes();
+    stats.frame_times.push(_scheduler.get_statistics().last_frame_time);
+    stats.frame_dispatches.push(dispatch_count - _last_dispatch_count);
+    stats.frame_draw_calls.push(_queue.get_draw_calls());
+    stats.frame_uploads.push(upload_bytes - _last_upload_bytes);
+    _last_dispatch_count = dispatch_count;
+    _last_upload_bytes = upload_bytes;
+
     return true;
 }
 
@@ -136,6 +206,8 @@ void Gui::keyInputEventHook(KeyInputEvent const * event)
 {
     assert(event);
 
+    invalidate();
+
     if (event->key == GLFW_KEY_ESCAPE && event->action == GLFW_PRESS)
     {
        _window.set_should_close();
@@ -148,6 +220,7 @@ void Gui::keyInputEventHook(KeyInputEvent const * event)
 void Gui::mouseButtonEventHook(MouseButtonEvent const * event)
 {
     assert(event);
+    invalidate();
 }
 
 void Gui::mouseCursorEventHook(MouseCursorEvent const * event)
@@ -157,6 +230,12 @@ void Gui::mouseCursorEventHook(MouseCursorEvent const * event)
     assert(_pan);
     assert(_shaderprogram);
 
+    // the view only moves while panning or zooming
+    if (_pan->is_dragging() || _zoom->is_dragging())
+    {
+        invalidate();
+    }
+
     // update controls
     _zoom->set_position(event->xpos, event->ypos);
     _pan->set_position(event->xpos, event->ypos);
@@ -171,6 +250,7 @@ void Gui::mouseCursorEventHook(MouseCursorEvent const * event)
     // TODO: more general solution using pan (z) and pan constructor
     mat4x4_translate_in_place(v, 0.f, 0.f, -8.f);
     _shaderprogram->set_v(v);
+    update_view();
 }
 
 void Gui::windowSizeEventHook(WindowSizeEvent const * event)
@@ -180,6 +260,8 @@ void Gui::windowSizeEventHook(WindowSizeEvent const * event)
     assert(_zoom);
     assert(_shaderprogram);
 
+    invalidate();
+
     // update controls
     _zoom->set_in_range(0, event->width, event->height, 0);
     _pan->set_in_range(0, event->width, event->height, 0);
@@ -189,21 +271,54 @@ void Gui::windowSizeEventHook(WindowSizeEvent const * event)
     mat4x4 p;
     mat4x4_ortho(p, -event->width, event->width, -event->height, event->height, 0.1f, 10.f);
     _shaderprogram->set_p(p);
+    _window_width = event->width;
+    _window_height = event->height;
+    update_view();
 }
 
 void Gui::framebufferSizeEventHook(FramebufferSizeEvent const * event)
 {
     assert(event);
     glViewport(0, 0, event->width, event->height);
+    _framebuffer_width = event->width;
+    _framebuffer_height = event->height;
+    update_view();
+    invalidate();
 }
 
 void Gui::windowRefreshEventHook(WindowRefreshEvent const * event)
 {
     assert(event);
+    // some platforms block the event loop while resizing,
+    // so the contents have to be redrawn right away
     render();
 }
 
 
+/*
+ * Inverts the view set up in mouseCursorEventHook and windowSizeEventHook:
+ * a world point lands at zoom * (p + pan) in a projection spanning
+ * [-width, width] x [-height, height], which covers the framebuffer.
+ */
+void Gui::update_view()
+{
+    if (!_pan || !_zoom || _window_width <= 0 || _window_height <= 0)
+        return;
+
+    float const zoom_x = _zoom->get_pixels_per_unit_x();
+    float const zoom_y = _zoom->get_pixels_per_unit_y();
+    float const half_width = _window_width / zoom_x;
+    float const half_height = _window_height / zoom_y;
+    float const center_x = -_pan->get_translation_x();
+    float const center_y = -_pan->get_translation_y();
+    _view.xmin = center_x - half_width;
+    _view.xmax = center_x + half_width;
+    _view.ymin = center_y - half_height;
+    _view.ymax = center_y + half_height;
+    _view.pixels_per_unit_x = zoom_x * _framebuffer_width / (2.f * _window_width);
+    _view.pixels_per_unit_y = zoom_y * _framebuffer_height / (2.f * _window_height);
+}
+
 double Gui::get_time()
 {
     return _window.get_time();
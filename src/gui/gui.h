@@ -14,10 +14,14 @@
 #include "element.h"
 #include "events.h"
 #include "draw.h"
+#include "frame_scheduler.h"
+#include "gui_events.h"
 #include "window.h"
 #include "window_events.h"
 #include "shader.h"
 #include "pan.h"
+#include "render_queue.h"
+#include "stats.h"
 #include "zoom.h"
 
 /*
@@ -32,13 +36,24 @@ public:
     bool add_element(Element * element);
     bool remove_element(Element * element);
 
-    bool step(double dt = 1.0/60.0);
-    
+    /*
+     * Renders a frame if anything changed since the last one, then
+     * sleeps until new events arrive or the next frame is due.
+     */
+    bool step();
+    void invalidate();
+
+    void set_max_frame_rate(double max_frame_rate);
+    void set_idle_timeout(double idle_timeout);
+    FrameStatistics const & get_frame_statistics() const;
+    RenderView const & get_view() const;
+
     double get_time();
     bool should_close();
 
 private:
     bool render();
+    void update_view();
 
     // event hooks
     void keyInputEventHook(KeyInputEvent const * event);
@@ -49,10 +64,18 @@ private:
     void windowRefreshEventHook(WindowRefreshEvent const * event);
 
     Window _window;
+    FrameScheduler _scheduler;
     Pan * _pan;
     VertexColorShaderProgram * _shaderprogram;
     Zoom * _zoom;
     std::set<Element *> _elements;
+    RenderView _view;
+    RenderQueue _queue;
+    Fem::Arena _frame_arena;  // reset after every frame
+    int _window_width, _window_height;
+    int _framebuffer_width, _framebuffer_height;
+    unsigned long _last_dispatch_count;
+    unsigned long _last_upload_bytes;
 };
 
 
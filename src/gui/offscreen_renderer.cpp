@@ -0,0 +1,145 @@
+#include "offscreen_renderer.h"
+
+OffscreenRenderer::OffscreenRenderer(int width, int height)
+: _target(NULL)
+, _shaderprogram(NULL)
+, _width(width)
+, _height(height)
+{
+    // same default view as a gui window of this size
+    set_view(-0.01f * width, 0.01f * width, -0.01f * height, 0.01f * height);
+}
+
+OffscreenRenderer::~OffscreenRenderer()
+{
+    // elements may still hold gpu assets, so the context has to outlive them;
+    // only what the renderer created itself is released here
+    if (_shaderprogram)
+    {
+        delete _shaderprogram;
+        _shaderprogram = NULL;
+    }
+    if (_target)
+    {
+        delete _target;
+        _target = NULL;
+    }
+}
+
+bool OffscreenRenderer::initialize()
+{
+    if (!_context.is_valid())
+        return false;
+
+    _target = new RenderTarget(_width, _height);
+    if (!_target->is_complete())
+    {
+        delete _target;
+        _target = NULL;
+        return false;
+    }
+
+    _shaderprogram = new VertexColorShaderProgram;
+    _shaderprogram->initialize();
+    set_view(_view.xmin, _view.xmax, _view.ymin, _view.ymax);
+
+    return true;
+}
+
+bool OffscreenRenderer::add_element(Element * element)
+{
+    if (!element)
+        return false;
+
+    if (!_elements.insert(element).second)
+        return false;
+
+    element->addEventHooks(&event_manager);
+
+    return true;
+}
+
+bool OffscreenRenderer::remove_element(Element * element)
+{
+    if (!element)
+        return false;
+
+    if (_elements.erase(element) == 0)
+        return false;
+
+    element->removeEventHooks(&event_manager);
+
+    return true;
+}
+
+void OffscreenRenderer::set_view(float xmin, float xmax, float ymin, float ymax)
+{
+    assert(xmax > xmin);
+    assert(ymax > ymin);
+
+    _view.xmin = xmin;
+    _view.xmax = xmax;
+    _view.ymin = ymin;
+    _view.ymax = ymax;
+    _view.pixels_per_unit_x = _width / (xmax - xmin);
+    _view.pixels_per_unit_y = _height / (ymax - ymin);
+
+    if (_shaderprogram)
+    {
+        mat4x4 v;
+        mat4x4_identity(v);
+        _shaderprogram->set_v(v);
+
+        mat4x4 p;
+        mat4x4_ortho(p, xmin, xmax, ymin, ymax, -1.f, 1.f);
+        _shaderprogram->set_p(p);
+    }
+}
+
+RenderView const & OffscreenRenderer::get_view() const
+{
+    return _view;
+}
+
+int OffscreenRenderer::get_width() const
+{
+    return _width;
+}
+
+int OffscreenRenderer::get_height() const
+{
+    return _height;
+}
+
+char const * OffscreenRenderer::get_backend() const
+{
+    return _context.get_backend();
+}
+
+bool OffscreenRenderer::render(Image & image)
+{
+    if (!_target || !_shaderprogram)
+        return false;
+
+    // opaque, so images look like the window rather than transparent
+    _target->bind();
+    glClearColor(0.f, 0.f, 0.f, 1.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    _queue.clear();
+    RenderElementsEvent event(_shaderprogram, _view, &_queue, &_frame_arena);
+    event_manager.triggerEvent(&event);
+    _queue.submit(_shaderprogram);
+    _frame_arena.reset();
+
+    _target->read_pixels(image);
+    _target->unbind();
+
+    return true;
+}
+
+bool OffscreenRenderer::render_to_file(char const * path)
+{
+    Image image;
+    return render(image) && write_image(image, path);
+}
@@ -0,0 +1,59 @@
+#ifndef __OFFSCREEN_RENDERER_H
+#define __OFFSCREEN_RENDERER_H
+
+#include <set>
+
+#include <linmath.h>
+
+#include "element.h"
+#include "events.h"
+#include "image.h"
+#include "offscreen.h"
+#include "render_queue.h"
+#include "shader.h"
+
+/*
+ * Renders the same elements as Gui, but into an offscreen render target
+ * instead of a window, for writing plots to image files on machines
+ * without a display. The view is set explicitly as a world rectangle
+ * rather than through pan and zoom.
+ *
+ * Owns its gl context, so it must be used from the thread that created it,
+ * and elements can't be shared with a Gui or another renderer at the
+ * same time (their gpu caches belong to one context).
+ */
+class OffscreenRenderer
+{
+public:
+    OffscreenRenderer(int width = 640, int height = 480);
+    ~OffscreenRenderer();
+    bool initialize();
+    bool add_element(Element * element);
+    bool remove_element(Element * element);
+
+    void set_view(float xmin, float xmax, float ymin, float ymax);
+    RenderView const & get_view() const;
+    int get_width() const;
+    int get_height() const;
+    char const * get_backend() const;
+
+    bool render(Image & image);
+    bool render_to_file(char const * path);
+
+    EventManager event_manager;
+
+private:
+    OffscreenRenderer(OffscreenRenderer const &);
+    OffscreenRenderer & operator=(OffscreenRenderer const &);
+
+    OffscreenContext _context;
+    RenderTarget * _target;
+    VertexColorShaderProgram * _shaderprogram;
+    std::set<Element *> _elements;
+    RenderView _view;
+    RenderQueue _queue;
+    Fem::Arena _frame_arena;  // reset after every frame
+    int _width, _height;
+};
+
+#endif  // __OFFSCREEN_RENDERER_H
@@ -0,0 +1,225 @@
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+/*
+ * Lock-free statistics shared between whatever produces them (the gui
+ * loop, the shader program, solvers on any thread) and whatever shows
+ * them (the hud overlay). Producers only ever do relaxed atomic stores
+ * and adds, so measuring never blocks or perturbs what is measured;
+ * readers take snapshots that may be a sample or so out of date.
+ */
+
+/*
+ * Seconds on a monotonic clock, for timing intervals.
+ */
+inline double stats_now()
+{
+    typedef std::chrono::steady_clock clock;
+    return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Ring of the most recent samples of one quantity, for a single
+ * producer. Readers copy the samples out without synchronizing with
+ * the producer, so a sample being overwritten during the copy shows
+ * up as either its old or its new value, never as a torn one.
+ */
+class SampleRing
+{
+public:
+    enum { CAPACITY = 256 };
+
+    SampleRing()
+    : _count(0)
+    {
+        for (int i = 0; i < CAPACITY; ++i)
+            _samples[i].store(0.0, std::memory_order_relaxed);
+    }
+
+    void push(double value)
+    {
+        unsigned long count = _count.load(std::memory_order_relaxed);
+        _samples[count % CAPACITY].store(value, std::memory_order_relaxed);
+        _count.store(count + 1, std::memory_order_release);
+    }
+
+    /*
+     * Total number of samples pushed so far.
+     */
+    unsigned long count() const
+    {
+        return _count.load(std::memory_order_acquire);
+    }
+
+    /*
+     * Copies the most recent samples, oldest first.
+     */
+    void snapshot(std::vector<double> & samples) const
+    {
+        unsigned long const count = _count.load(std::memory_order_acquire);
+        unsigned long const size = std::min<unsigned long>(count, CAPACITY);
+        samples.resize(size);
+        for (unsigned long i = 0; i < size; ++i)
+            samples[i] = _samples[(count - size + i) % CAPACITY].load(std::memory_order_relaxed);
+    }
+
+    double last() const
+    {
+        unsigned long const count = _count.load(std::memory_order_acquire);
+        return count ? _samples[(count - 1) % CAPACITY].load(std::memory_order_relaxed) : 0.0;
+    }
+
+private:
+    std::atomic<double> _samples[CAPACITY];
+    std::atomic<unsigned long> _count;
+};
+
+/*
+ * Wall clock time spent in the phases of the last linear solve,
+ * in seconds. Phases a solver doesn't have stay zero.
+ */
+struct SolveTiming
+{
+    SolveTiming()
+    : assembly(0.0)
+    , factor(0.0)
+    , solve(0.0)
+    , unknowns(0)
+    {}
+
+    double total() const
+    {
+        return assembly + factor + solve;
+    }
+
+    double assembly;
+    double factor;
+    double solve;
+    int unknowns;
+};
+
+class Stats
+{
+public:
+    static Stats & instance()
+    {
+        static Stats stats;
+        return stats;
+    }
+
+    /*
+     * Bytes of vertex and field data sent to the gpu, counted by the
+     * shader program at every upload.
+     */
+    void add_upload_bytes(unsigned long bytes)
+    {
+        _upload_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    unsigned long get_upload_bytes() const
+    {
+        return _upload_bytes.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * Published by solvers once a solve is done. Threads publishing at
+     * the same time take turns, the last one wins.
+     */
+    void publish_solve(SolveTiming const & timing)
+    {
+        // seqlock: odd sequence numbers mark a write in progress; a writer
+        // claims it by making the sequence odd, waiting out other writers
+        unsigned long sequence = _solve_sequence.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            if (sequence & 1)
+                sequence = _solve_sequence.load(std::memory_order_relaxed);
+            else if (_solve_sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire,
+                                                           std::memory_order_relaxed))
+                break;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        _solve_assembly.store(timing.assembly, std::memory_order_relaxed);
+        _solve_factor.store(timing.factor, std::memory_order_relaxed);
+        _solve_solve.store(timing.solve, std::memory_order_relaxed);
+        _solve_unknowns.store(timing.unknowns, std::memory_order_relaxed);
+        _solve_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /*
+     * False until the first solve has been published, or while one is
+     * being published, in which case the reader just tries again later.
+     */
+    bool read_solve(SolveTiming & timing) const
+    {
+        unsigned long const before = _solve_sequence.load(std::memory_order_acquire);
+        if (before == 0 || before & 1)
+            return false;
+        timing.assembly = _solve_assembly.load(std::memory_order_relaxed);
+        timing.factor = _solve_factor.load(std::memory_order_relaxed);
+        timing.solve = _solve_solve.load(std::memory_order_relaxed);
+        timing.unknowns = _solve_unknowns.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return _solve_sequence.load(std::memory_order_relaxed) == before;
+    }
+
+    /*
+     * Set while something shows these statistics, such as the hud, so
+     * the gui keeps redrawing at a low rate to show them current.
+     */
+    void set_shown(bool shown)
+    {
+        _shown.store(shown, std::memory_order_relaxed);
+    }
+    bool is_shown() const
+    {
+        return _shown.load(std::memory_order_relaxed);
+    }
+
+    // per frame samples, pushed by the gui loop
+    SampleRing frame_times;       // seconds
+    SampleRing frame_dispatches;  // event hooks called since the previous frame
+    SampleRing frame_draw_calls;
+    SampleRing frame_uploads;     // bytes uploaded since the previous frame
+
+private:
+    Stats()
+    : _upload_bytes(0)
+    , _shown(false)
+    , _solve_sequence(0)
+    , _solve_assembly(0.0)
+    , _solve_factor(0.0)
+    , _solve_solve(0.0)
+    , _solve_unknowns(0)
+    {}
+    Stats(Stats const &);
+    Stats & operator=(Stats const &);
+
+    std::atomic<unsigned long> _upload_bytes;
+    std::atomic<bool> _shown;
+    std::atomic<unsigned long> _solve_sequence;
+    std::atomic<double> _solve_assembly;
+    std::atomic<double> _solve_factor;
+    std::atomic<double> _solve_solve;
+    std::atomic<int> _solve_unknowns;
+};
+
+/*
+ * Value below which the given fraction of the samples lie,
+ * reorders the samples.
+ */
+inline double percentile(std::vector<double> & samples, double fraction)
+{
+    if (samples.empty())
+        return 0.0;
+
+    size_t rank = (size_t) (fraction * (samples.size() - 1) + 0.5);
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+#endif  // __STATS_H